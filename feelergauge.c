@@ -0,0 +1,7093 @@
+/**
+ * @file feelergauge.c
+ * @author Nathan McFadden <nmcfadd2@andrew.cmu.edu>
+ * @brief Feeler Gauge library
+ * @version 0.1
+ * @date 2022-03-02
+ * 
+ * 
+ * Dependencies:
+ *  - libmagic
+ *  - zlib
+ *  - libzstd (optional, enables zstd compressed disk images)
+ */
+
+#include "feelergauge_internal.h"
+
+// The volume the calling thread is working on, set by the fg_ entry points and the worker threads
+static __thread struct fg_volume *fg = NULL;
+
+// Where fatal() returns to on a worker thread, set by each worker around the job it is doing
+static __thread jmp_buf *worker_fail = NULL;
+
+/**
+ * @brief Flags the volume as failed from a worker thread.  The fg_ call that waits for the worker
+ * fails once every worker is done.
+ */
+static void fail_worker(void){
+    __atomic_store_n(&fg->worker_failed, true, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Gives up on the volume after an error that was already printed.  Inside an fg_ call this
+ * returns to the entry point, which fails.  On a worker thread (e.g. a hashing thread) only the
+ * current job is given up on, and the fg_ call waiting for the workers fails.
+ */
+static void fatal(void){
+    if (fg != NULL && pthread_equal(fg->api_thread, pthread_self())){
+        fg->failed = true;
+        longjmp(fg->fail, 1);
+    }
+    if (fg != NULL && worker_fail != NULL){
+        fail_worker();
+        longjmp(*worker_fail, 1);
+    }
+    // Every thread the library starts sets worker_fail, so this is not reached
+    abort();
+}
+
+/**
+ * @brief Fails the current fg_ call if a worker thread gave up on a job.  Called after the workers
+ * are done.
+ */
+static void check_workers(void){
+    if (__atomic_load_n(&fg->worker_failed, __ATOMIC_RELAXED))
+        fatal();
+}
+
+/**
+ * @brief Writes to the report of the current volume
+ */
+static void report(const char *format, ...){
+    va_list ap;
+
+    if (fg->out == NULL)
+        return;
+    va_start(ap, format);
+    vfprintf(fg->out, format, ap);
+    va_end(ap);
+}
+
+/**
+ * @brief Convert Cluster to Sector
+ * 
+ * @return uint64_t sector
+ */
+static uint64_t cts(uint32_t cluster){
+    return ((uint64_t)(cluster - 2) * (fg->spc * fg->bps) + fg->reserved_and_fats);
+}
+
+/**
+ * @brief Returns the first sector of the data area
+ */
+static uint64_t first_data_sector(struct fat_boot_sector *fat_sector){
+    uint32_t fat_sectors = fat_sector->is_fat32 ? fat_sector->fat32_size_in_sectors : fat_sector->fat_size_in_sectors;
+    uint32_t root_dir_sectors = ((fat_sector->max_files_in_root * 32) + (fg->bps - 1)) / fg->bps;
+    return fat_sector->reserved_area_size + (uint64_t)fat_sector->number_of_fats * fat_sectors + root_dir_sectors;
+}
+
+/**
+ * @brief Returns the number of clusters in the data area.  Valid cluster numbers are 2 to count + 1.
+ */
+static uint64_t data_cluster_count(struct fat_boot_sector *fat_sector){
+    uint64_t total_sectors = fat_sector->sector_count_16b ? fat_sector->sector_count_16b : fat_sector->sector_count_32b;
+    uint64_t first = first_data_sector(fat_sector);
+    uint64_t count = total_sectors > first ? (total_sectors - first) / fg->spc : 0;
+
+    // Clusters the FAT has no entries for cannot be used
+    if (fat_sector->is_fat32 && count + 2 > fg->fat_size_in_bytes / 4)
+        count = fg->fat_size_in_bytes / 4 > 2 ? fg->fat_size_in_bytes / 4 - 2 : 0;
+    return count;
+}
+
+/**
+ * @brief Verfies that the user supplied a valid/support file system type.
+ * @param args 
+ * @return int : returns 0 if no errors, or 1 if invalid file sytem type detected
+ */
+static int verify_fs_arg(struct fg_options *args){
+    if (!strncmp("fat32", args->file_system, 5)){
+        args->fs_type = FAT32;
+        return 0;
+    }
+    if (!strncmp("fat16", args->file_system, 5)){
+        args->fs_type = FAT16;
+        return 0;
+    }
+    if (!strncmp("fat12", args->file_system, 5)){
+        args->fs_type = FAT12;
+        return 0;
+    }
+    if (!strncmp("ntfs", args->file_system, 4)){
+        args->fs_type = NTFS;
+        return 0;
+    }
+    if (!strncmp("raw", args->file_system, 3)){
+        args->fs_type = RAW;
+        return 0;
+    }
+
+    fprintf(stderr, 
+       "Aborting... invalid file system type: %s.  Please refer to the program usage for valid file system types.\n",
+       args->file_system);
+    fatal();
+}
+
+/**
+ * @brief Little endian helpers for decoding on-disk structures out of a byte buffer
+ */
+static uint16_t le16(const uint8_t *p){
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Reads exactly length bytes from the file on disk, retrying short reads
+ *
+ * @return int : 0 if successful, -1 on a read error or if the file ends early
+ */
+static int read_full(int fp, void *buffer, size_t length, uint64_t offset){
+    size_t done = 0;
+    while (done < length){
+        ssize_t n = pread(fp, (uint8_t *)buffer + done, length - done, offset + done);
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Grows the block index of a compressed image so it can hold at least count + 1 blocks
+ *
+ * @return int : 0 if successful, -1 if out of memory
+ */
+static int grow_block_index(struct image_backend *img, uint64_t count, uint64_t *capacity){
+    if (count + 1 < *capacity)
+        return 0;
+    while (count + 1 >= *capacity)
+        *capacity = *capacity ? *capacity * 2 : 64;
+    img->block_start = realloc(img->block_start, *capacity * sizeof(uint64_t));
+    img->frame_offset = realloc(img->frame_offset, *capacity * sizeof(uint64_t));
+    img->points = realloc(img->points, *capacity * sizeof(struct gzip_access_point));
+    if (img->block_start == NULL || img->frame_offset == NULL || img->points == NULL)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Records a gzip access point.  The 32K window is stored deflate compressed, since on a
+ * disk image most of them are mostly zeros and this keeps the index small.
+ *
+ * @param left bytes of window that have not been written yet by inflate
+ * @return int : 0 if successful, -1 on error
+ */
+static int add_gzip_access_point(struct gzip_access_point *point, uint64_t in, int bits, uint32_t left, uint8_t *window){
+    uint8_t linear[GZIP_WINDOW_SIZE];
+    uLongf length = compressBound(GZIP_WINDOW_SIZE);
+
+    // The window is circular, unroll it so the oldest byte comes first
+    if (left)
+        memcpy(linear, window + GZIP_WINDOW_SIZE - left, left);
+    if (left < GZIP_WINDOW_SIZE)
+        memcpy(linear + left, window, GZIP_WINDOW_SIZE - left);
+
+    point->in = in;
+    point->bits = bits;
+    point->window = malloc(length);
+    if (point->window == NULL || compress2(point->window, &length, linear, GZIP_WINDOW_SIZE, Z_BEST_SPEED) != Z_OK)
+        return -1;
+    point->window_length = length;
+    return 0;
+}
+
+/**
+ * @brief Decompresses the whole gzip image once, recording an access point roughly every
+ * GZIP_INDEX_SPAN bytes of output so later reads only have to inflate from the nearest point.
+ *
+ * @return int : 0 if successful, -1 if the stream is corrupt or truncated
+ */
+static int build_gzip_index(struct image_backend *img){
+    z_stream strm = {0};
+    uint8_t input[GZIP_READ_CHUNK];
+    uint8_t window[GZIP_WINDOW_SIZE] = {0};
+    uint64_t read_off = 0;
+    uint64_t totout = 0;
+    uint64_t last = 0;
+    uint64_t capacity = 0;
+    bool member_start = true;
+    int ret = Z_OK;
+
+    if (inflateInit2(&strm, 47) != Z_OK) // 47: gzip or zlib header, 32K window
+        return -1;
+
+    for (;;){
+        if (strm.avail_in == 0){
+            ssize_t n = pread(img->fp, input, sizeof(input), read_off);
+            if (n <= 0)
+                break;
+            read_off += n;
+            strm.next_in = input;
+            strm.avail_in = n;
+        }
+        if (strm.avail_out == 0){
+            strm.next_out = window;
+            strm.avail_out = GZIP_WINDOW_SIZE;
+        }
+        uint32_t avail_out = strm.avail_out;
+        ret = inflate(&strm, Z_BLOCK);
+        totout += avail_out - strm.avail_out;
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+            break;
+
+        if (ret == Z_STREAM_END){
+            // pigz and concatenated files are made of several gzip members
+            if (strm.avail_in == 0){
+                ssize_t n = pread(img->fp, input, sizeof(input), read_off);
+                if (n <= 0)
+                    break;
+                read_off += n;
+                strm.next_in = input;
+                strm.avail_in = n;
+            }
+            if (strm.next_in[0] != 0x1f) // trailing padding after the last member
+                break;
+            inflateReset(&strm);
+            member_start = true;
+            continue;
+        }
+
+        // Only deflate block boundaries (or the end of a header) are usable access points.  One is
+        // always placed at the start of a member so blocks never straddle two members.
+        if ((strm.data_type & 128) && !(strm.data_type & 64) && (member_start || totout - last > GZIP_INDEX_SPAN)){
+            if (grow_block_index(img, img->block_count, &capacity) ||
+                add_gzip_access_point(&img->points[img->block_count], read_off - strm.avail_in,
+                    strm.data_type & 7, strm.avail_out, window)){
+                ret = Z_MEM_ERROR;
+                break;
+            }
+            img->block_start[img->block_count++] = totout;
+            last = totout;
+            member_start = false;
+        }
+    }
+    inflateEnd(&strm);
+    if (ret != Z_STREAM_END || img->block_count == 0)
+        return -1;
+    img->block_start[img->block_count] = totout;
+    return 0;
+}
+
+/**
+ * @brief Frees the access points of a gzip image and empties its index
+ */
+static void free_gzip_index(struct image_backend *img){
+    for (uint64_t i = 0; i < img->block_count; i++)
+        free(img->points[i].window);
+    free(img->points);
+    free(img->block_start);
+    free(img->frame_offset);
+    img->points = NULL;
+    img->block_start = NULL;
+    img->frame_offset = NULL;
+    img->block_count = 0;
+}
+
+/**
+ * @brief Saves the access points of a gzip image next to it, so later runs on the same image do
+ * not have to inflate all of it again.  The index is only a cache, if it cannot be written, e.g.
+ * the image is on read only media, the next run builds it again.
+ */
+static void save_gzip_index(struct image_backend *img, const char *index_path, int64_t modified){
+    struct gzip_index_header header = {.magic = "FGGZIDX", .version = GZIP_SAVED_INDEX_VERSION};
+    char tmp_path[PATH_MAX];
+    FILE *file;
+    bool ok;
+
+    header.file_size = img->file_size;
+    header.modified = modified;
+    header.block_count = img->block_count;
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path) >= (int)sizeof(tmp_path))
+        return;
+    file = fopen(tmp_path, "wb");
+    if (file == NULL)
+        return;
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(img->block_start, sizeof(uint64_t), img->block_count + 1, file) == img->block_count + 1;
+    for (uint64_t i = 0; ok && i < img->block_count; i++){
+        struct gzip_access_point *point = &img->points[i];
+        ok = fwrite(&point->in, sizeof(point->in), 1, file) == 1 && fwrite(&point->bits, sizeof(point->bits), 1, file) == 1 &&
+            fwrite(&point->window_length, sizeof(point->window_length), 1, file) == 1 &&
+            fwrite(point->window, 1, point->window_length, file) == point->window_length;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path, index_path))
+        unlink(tmp_path);
+}
+
+/**
+ * @brief Loads the access points saved by an earlier run on the same gzip image
+ *
+ * @return int : 0 if successful, -1 if there is none, it is for another image, or it is damaged
+ */
+static int load_gzip_index(struct image_backend *img, const char *index_path, int64_t modified){
+    struct gzip_index_header header;
+    FILE *file = fopen(index_path, "rb");
+    uint64_t capacity = 0;
+    bool ok;
+
+    if (file == NULL)
+        return -1;
+    ok = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, "FGGZIDX", 8) &&
+        header.version == GZIP_SAVED_INDEX_VERSION && header.file_size == img->file_size && header.modified == modified &&
+        header.block_count > 0 && header.block_count < img->file_size && grow_block_index(img, header.block_count, &capacity) == 0 &&
+        fread(img->block_start, sizeof(uint64_t), header.block_count + 1, file) == header.block_count + 1;
+    if (ok){
+        // Counted up front with empty windows so free_gzip_index can clean up a partial load
+        memset(img->points, 0, header.block_count * sizeof(struct gzip_access_point));
+        img->block_count = header.block_count;
+    }
+    for (uint64_t i = 0; ok && i < header.block_count; i++){
+        struct gzip_access_point *point = &img->points[i];
+        ok = img->block_start[i] < img->block_start[i + 1] && fread(&point->in, sizeof(point->in), 1, file) == 1 &&
+            fread(&point->bits, sizeof(point->bits), 1, file) == 1 &&
+            fread(&point->window_length, sizeof(point->window_length), 1, file) == 1 &&
+            point->in <= img->file_size && point->bits >= 0 && point->bits < 8 && point->window_length <= compressBound(GZIP_WINDOW_SIZE);
+        point->window = ok ? malloc(point->window_length) : NULL;
+        ok = ok && point->window != NULL && fread(point->window, 1, point->window_length, file) == point->window_length;
+    }
+    fclose(file);
+    if (!ok){
+        free_gzip_index(img);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Inflates one block of a gzip image starting from its access point
+ *
+ * @return int : 0 if successful, -1 on error
+ */
+static int inflate_gzip_block(struct image_backend *img, uint64_t block, uint8_t *out, uint32_t length){
+    struct gzip_access_point *point = &img->points[block];
+    z_stream strm = {0};
+    uint8_t input[GZIP_READ_CHUNK];
+    uint8_t window[GZIP_WINDOW_SIZE];
+    uLongf window_length = GZIP_WINDOW_SIZE;
+    uint64_t read_off = point->in;
+    int ret = Z_OK;
+
+    if (uncompress(window, &window_length, point->window, point->window_length) != Z_OK)
+        return -1;
+    if (inflateInit2(&strm, -15) != Z_OK) // raw deflate, the header was consumed while indexing
+        return -1;
+    if (point->bits){
+        uint8_t byte;
+        if (read_full(img->fp, &byte, 1, point->in - 1)){
+            inflateEnd(&strm);
+            return -1;
+        }
+        inflatePrime(&strm, point->bits, byte >> (8 - point->bits));
+    }
+    inflateSetDictionary(&strm, window, GZIP_WINDOW_SIZE);
+
+    strm.next_out = out;
+    strm.avail_out = length;
+    while (strm.avail_out){
+        if (strm.avail_in == 0){
+            ssize_t n = pread(img->fp, input, sizeof(input), read_off);
+            if (n <= 0)
+                break;
+            read_off += n;
+            strm.next_in = input;
+            strm.avail_in = n;
+        }
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+            break;
+    }
+    inflateEnd(&strm);
+    return strm.avail_out ? -1 : 0;
+}
+
+/**
+ * @brief Loads the seek table of a zstd seekable image, which lists the compressed and
+ * decompressed size of every frame.  Reading it does not need libzstd.
+ *
+ * @return int : 0 if successful, -1 on error
+ */
+static int read_zstd_seek_table(struct image_backend *img, uint8_t *footer){
+    uint32_t frames = le32(footer);
+    uint32_t entry_size = (footer[4] & 0x80) ? 12 : 8; // entries carry a checksum if bit 7 is set
+    uint64_t table_size = (uint64_t)frames * entry_size;
+    uint64_t capacity = 0;
+
+    if (table_size + ZSTD_SEEK_TABLE_FOOTER_SIZE + 8 > img->file_size)
+        return -1;
+    uint8_t *table = malloc(table_size + 1);
+    if (table == NULL || read_full(img->fp, table, table_size, img->file_size - ZSTD_SEEK_TABLE_FOOTER_SIZE - table_size)){
+        free(table);
+        return -1;
+    }
+
+    if (grow_block_index(img, frames, &capacity) == 0){
+        img->block_start[0] = 0;
+        img->frame_offset[0] = 0;
+        for (uint32_t i = 0; i < frames; i++){
+            uint32_t decompressed = le32(table + i * entry_size + 4);
+            if (decompressed > ZSTD_MAX_FRAME_SIZE){
+                fprintf(stderr, "zstd frame %u is %u bytes decompressed, more than the %u bytes frames are limited to.  Please recompress the image with smaller frames.\n",
+                    i, decompressed, ZSTD_MAX_FRAME_SIZE);
+                free(table);
+                return -1;
+            }
+            img->frame_offset[i + 1] = img->frame_offset[i] + le32(table + i * entry_size);
+            img->block_start[i + 1] = img->block_start[i] + decompressed;
+        }
+        img->block_count = frames;
+    }
+    free(table);
+
+    // The frames must end exactly where the skippable frame holding the seek table begins
+    if (img->block_count != frames ||
+        img->frame_offset[frames] != img->file_size - ZSTD_SEEK_TABLE_FOOTER_SIZE - table_size - 8)
+        return -1;
+    return 0;
+}
+
+#ifdef FG_HAVE_ZSTD
+/**
+ * @brief Indexes a zstd image without a seek table by walking the frame and block headers.
+ * Only works when every frame records its decompressed size, and it is small enough to be
+ * decompressed and cached whole.  A plain zstd file is usually one frame of the whole image.
+ *
+ * @return int : 0 if successful, -1 on error
+ */
+static int walk_zstd_frames(struct image_backend *img){
+    uint8_t header[18]; // largest possible frame header
+    uint64_t off = 0;
+    uint64_t capacity = 0;
+    uint32_t did_size[4] = {0, 1, 2, 4};
+    uint32_t fcs_size[4] = {0, 2, 4, 8};
+
+    while (off < img->file_size){
+        size_t n = img->file_size - off < sizeof(header) ? img->file_size - off : sizeof(header);
+        if (n < 8 || read_full(img->fp, header, n, off))
+            return -1;
+        if ((le32(header) & 0xFFFFFFF0) == ZSTD_SKIPPABLE_SIG){
+            off += 8 + le32(header + 4);
+            continue;
+        }
+        unsigned long long content = ZSTD_getFrameContentSize(header, n);
+        if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR){
+            fprintf(stderr, "zstd frame at offset %ju does not record its size.  Please recompress the image in the zstd seekable format.\n", (uintmax_t)off);
+            return -1;
+        }
+        if (content > ZSTD_MAX_FRAME_SIZE){
+            fprintf(stderr, "zstd frame at offset %ju is %ju bytes decompressed, more than the %u bytes frames are limited to.  Please recompress the image in the zstd seekable format.\n",
+                (uintmax_t)off, (uintmax_t)content, ZSTD_MAX_FRAME_SIZE);
+            return -1;
+        }
+
+        // Frame header: magic, descriptor, optional window byte, dictionary id and content size
+        uint8_t descriptor = header[4];
+        bool single_segment = descriptor & 0x20;
+        uint32_t fcs = (descriptor >> 6) ? fcs_size[descriptor >> 6] : single_segment;
+        uint64_t pos = off + 5 + !single_segment + did_size[descriptor & 3] + fcs;
+
+        // Each block starts with a 3 byte header: last block flag, type, and size
+        for (;;){
+            uint8_t block_header[3];
+            if (read_full(img->fp, block_header, 3, pos))
+                return -1;
+            uint32_t value = block_header[0] | (block_header[1] << 8) | (block_header[2] << 16);
+            pos += 3 + (((value >> 1) & 3) == 1 ? 1 : (value >> 3)); // RLE blocks store a single byte
+            if (value & 1)
+                break;
+        }
+        if (descriptor & 0x4) // content checksum
+            pos += 4;
+
+        if (grow_block_index(img, img->block_count, &capacity))
+            return -1;
+        if (img->block_count == 0)
+            img->block_start[0] = 0;
+        img->frame_offset[img->block_count] = off;
+        img->block_start[img->block_count + 1] = img->block_start[img->block_count] + content;
+        img->frame_offset[img->block_count + 1] = pos;
+        img->block_count++;
+        off = pos;
+    }
+    return img->block_count ? 0 : -1;
+}
+#endif
+
+/**
+ * @brief Indexes a zstd image, preferring the seek table of the zstd seekable format
+ *
+ * @return int : 0 if successful, -1 on error
+ */
+static int build_zstd_index(struct image_backend *img){
+    uint8_t footer[ZSTD_SEEK_TABLE_FOOTER_SIZE];
+
+    if (img->file_size < ZSTD_SEEK_TABLE_FOOTER_SIZE ||
+        read_full(img->fp, footer, ZSTD_SEEK_TABLE_FOOTER_SIZE, img->file_size - ZSTD_SEEK_TABLE_FOOTER_SIZE))
+        return -1;
+    if (le32(footer + 5) == ZSTD_SEEKABLE_SIG)
+        return read_zstd_seek_table(img, footer);
+#ifdef FG_HAVE_ZSTD
+    return walk_zstd_frames(img);
+#else
+    return -1;
+#endif
+}
+
+#ifdef FG_HAVE_ZSTD
+
+/**
+ * @brief Decompresses one frame of a zstd image
+ *
+ * @return int : 0 if successful, -1 on error
+ */
+static int decompress_zstd_frame(struct image_backend *img, uint64_t block, uint8_t *out, uint32_t length){
+    uint64_t in_length = img->frame_offset[block + 1] - img->frame_offset[block];
+    uint8_t *in = malloc(in_length + 1);
+    size_t ret = 0;
+
+    if (in == NULL || read_full(img->fp, in, in_length, img->frame_offset[block])){
+        free(in);
+        return -1;
+    }
+    ret = ZSTD_decompress(out, length, in, in_length);
+    free(in);
+    return (ZSTD_isError(ret) || ret != length) ? -1 : 0;
+}
+#endif
+
+/**
+ * @brief Returns a decompressed block of the image, decompressing it into the LRU cache on a
+ * miss.  The least recently used blocks are evicted to keep the cache under img->cache_limit.
+ * Must be called with img->lock held.
+ *
+ * @return struct cached_block* : NULL if the block could not be decompressed
+ */
+static struct cached_block* get_image_block(struct image_backend *img, uint64_t block){
+    uint32_t length = img->block_start[block + 1] - img->block_start[block];
+    struct cached_block *slot = NULL;
+    int ret = -1;
+
+    img->cache_tick++;
+    for (int i = 0; i < COMPRESSED_CACHE_SLOTS; i++){
+        if (img->cache[i].data != NULL && img->cache[i].block == block){
+            img->cache[i].last_used = img->cache_tick;
+            return &img->cache[i];
+        }
+    }
+
+    for (;;){
+        struct cached_block *lru = NULL;
+        slot = NULL;
+        for (int i = 0; i < COMPRESSED_CACHE_SLOTS; i++){
+            if (img->cache[i].data == NULL)
+                slot = slot ? slot : &img->cache[i];
+            else if (lru == NULL || img->cache[i].last_used < lru->last_used)
+                lru = &img->cache[i];
+        }
+        if ((slot != NULL && img->cache_bytes + length <= img->cache_limit) || lru == NULL)
+            break;
+        img->cache_bytes -= lru->length;
+        free(lru->data);
+        lru->data = NULL;
+    }
+
+    slot->data = malloc(length ? length : 1);
+    if (slot->data == NULL)
+        return NULL;
+    if (img->format == IMAGE_GZIP)
+        ret = inflate_gzip_block(img, block, slot->data, length);
+#ifdef FG_HAVE_ZSTD
+    if (img->format == IMAGE_ZSTD)
+        ret = decompress_zstd_frame(img, block, slot->data, length);
+#endif
+    if (ret){
+        free(slot->data);
+        slot->data = NULL;
+        return NULL;
+    }
+    slot->block = block;
+    slot->length = length;
+    slot->last_used = img->cache_tick;
+    img->cache_bytes += length;
+    return slot;
+}
+
+/**
+ * @brief Drop in replacement for pread that transparently serves reads from compressed disk
+ * images.  Like pread, a read past the end of the image is short.
+ *
+ * @return ssize_t : number of bytes read, or -1 on error
+ */
+static ssize_t image_pread(int fp, void *buffer, size_t count, off_t offset){
+    size_t done = 0;
+
+    if (fg->image.format == IMAGE_RAW)
+        return pread(fp, buffer, count, offset);
+
+    pthread_mutex_lock(&fg->image.lock);
+    while (done < count && offset + done < fg->image.size){
+        uint64_t pos = offset + done;
+        uint64_t low = 0;
+        uint64_t high = fg->image.block_count - 1;
+
+        // Binary search for the block containing pos
+        while (low < high){
+            uint64_t mid = (low + high + 1) / 2;
+            if (fg->image.block_start[mid] <= pos)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+        struct cached_block *cached = get_image_block(&fg->image, low);
+        if (cached == NULL){
+            pthread_mutex_unlock(&fg->image.lock);
+            return -1;
+        }
+        size_t n = cached->length - (pos - fg->image.block_start[low]);
+        if (n > count - done)
+            n = count - done;
+        memcpy((uint8_t *)buffer + done, cached->data + (pos - fg->image.block_start[low]), n);
+        done += n;
+    }
+    pthread_mutex_unlock(&fg->image.lock);
+    return done;
+}
+
+/**
+ * @brief Detects whether the disk image is gzip or zstd compressed, and if so builds the index
+ * needed to serve random reads from it.  Raw images are read directly.
+ *
+ * @param fp
+ * @param args
+ */
+static void open_image_backend(int fp, struct fg_options *args){
+    uint8_t magic[4] = {0};
+    struct stat st;
+    int ret = -1;
+
+    if (fstat(fp, &st) < 0 || pread(fp, magic, 4, 0) < 0)
+        read_error();
+    fg->image.fp = fp;
+    fg->image.format = IMAGE_RAW;
+    fg->image.file_size = st.st_size;
+    fg->image.size = st.st_size;
+
+    if (le16(magic) == GZIP_SIG)
+        fg->image.format = IMAGE_GZIP;
+    if (le32(magic) == ZSTD_FRAME_SIG || (le32(magic) & 0xFFFFFFF0) == ZSTD_SKIPPABLE_SIG)
+        fg->image.format = IMAGE_ZSTD;
+    if (fg->image.format == IMAGE_RAW)
+        return;
+
+    pthread_mutex_init(&fg->image.lock, NULL);
+    fg->image.cache_limit = COMPRESSED_CACHE_LIMIT;
+    if (args->max_memory && fg->image.cache_limit > args->max_memory / 4)
+        fg->image.cache_limit = args->max_memory / 4;
+    if (fg->image.format == IMAGE_GZIP){
+        char index_path[PATH_MAX];
+        bool saved = snprintf(index_path, sizeof(index_path), "%s.fgzi", args->image_path) < (int)sizeof(index_path);
+        ret = saved ? load_gzip_index(&fg->image, index_path, st.st_mtime) : -1;
+        if (ret){
+            ret = build_gzip_index(&fg->image);
+            if (ret == 0 && saved)
+                save_gzip_index(&fg->image, index_path, st.st_mtime);
+        }
+    }
+    if (fg->image.format == IMAGE_ZSTD)
+        ret = build_zstd_index(&fg->image);
+#ifndef FG_HAVE_ZSTD
+    // The seek table can be read without libzstd, but not the frames
+    if (fg->image.format == IMAGE_ZSTD){
+        fprintf(stderr, "This build of feeler gauge does not include zstd support (libzstd was not found).\n");
+        ret = -1;
+    }
+#endif
+    if (ret){
+        fprintf(stderr, "Aborting... Could not index the compressed disk image at: %s\n", args->image_path);
+        fatal();
+    }
+    fg->image.size = fg->image.block_start[fg->image.block_count];
+
+    if (args->v_flag)
+        report("Detected %s compressed disk image.  Indexed %ju blocks, %ju bytes decompressed.\n",
+            fg->image.format == IMAGE_GZIP ? "gzip" : "zstd", (uintmax_t)fg->image.block_count, (uintmax_t)fg->image.size);
+}
+
+/**
+ * @brief Frees the index and cache of a compressed disk image
+ */
+static void close_image_backend(struct image_backend *img){
+    if (img->format == IMAGE_RAW)
+        return;
+    for (int i = 0; i < COMPRESSED_CACHE_SLOTS; i++)
+        free(img->cache[i].data);
+    if (img->format == IMAGE_GZIP)
+        free_gzip_index(img);
+    free(img->points);
+    free(img->block_start);
+    free(img->frame_offset);
+    pthread_mutex_destroy(&img->lock);
+}
+
+/**
+ * @brief Sets up the cluster cache once the cluster size is known
+ *
+ * @param block_size bytes per cluster
+ * @param memory_cap total bytes of cluster data the cache may hold, 0 disables the cache
+ */
+static void init_block_cache(struct block_cache *bc, uint32_t block_size, uint64_t memory_cap){
+    uint64_t capacity = memory_cap / block_size / BLOCK_CACHE_SHARDS;
+
+    if (capacity == 0)
+        return;
+    if (capacity > UINT32_MAX / 2)
+        capacity = UINT32_MAX / 2;
+    bc->block_size = block_size;
+    bc->readahead_max = BLOCK_CACHE_READAHEAD_MAX / block_size ? BLOCK_CACHE_READAHEAD_MAX / block_size : 1;
+    bc->readahead_window = 1;
+    for (int i = 0; i < BLOCK_CACHE_SHARDS; i++){
+        struct cache_shard *shard = &bc->shards[i];
+        uint32_t buckets = 1;
+        while (buckets < capacity * 2)
+            buckets <<= 1;
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->buckets = calloc(buckets, sizeof(struct cache_entry *));
+        if (shard->buckets == NULL)
+            return;
+        shard->bucket_mask = buckets - 1;
+        shard->capacity = capacity;
+    }
+    bc->enabled = true;
+}
+
+/**
+ * @brief Hash used to pick both the shard and the bucket within the shard for a cluster
+ */
+static uint32_t cluster_hash(uint32_t cluster){
+    return cluster * 0x9E3779B1;
+}
+
+static struct cache_shard* get_cache_shard(struct block_cache *bc, uint32_t cluster){
+    return &bc->shards[(cluster_hash(cluster) >> 28) & (BLOCK_CACHE_SHARDS - 1)];
+}
+
+/**
+ * @brief Unlinks an entry from its shard's LRU list.  Caller must hold the shard lock.
+ */
+static void lru_unlink(struct cache_shard *shard, struct cache_entry *entry){
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        shard->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        shard->lru_tail = entry->lru_prev;
+}
+
+/**
+ * @brief Marks an entry as the most recently used.  Caller must hold the shard lock.
+ */
+static void lru_push_front(struct cache_shard *shard, struct cache_entry *entry){
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head)
+        shard->lru_head->lru_prev = entry;
+    shard->lru_head = entry;
+    if (shard->lru_tail == NULL)
+        shard->lru_tail = entry;
+}
+
+/**
+ * @brief Copies part of a cluster out of the cache if it is present
+ *
+ * @return bool : true on a cache hit
+ */
+static bool cache_lookup(struct block_cache *bc, uint32_t cluster, uint8_t *buffer, uint32_t offset, uint32_t length){
+    struct cache_shard *shard = get_cache_shard(bc, cluster);
+    struct cache_entry *entry;
+
+    pthread_mutex_lock(&shard->lock);
+    entry = shard->buckets[cluster_hash(cluster) & shard->bucket_mask];
+    while (entry != NULL && entry->cluster != cluster)
+        entry = entry->hash_next;
+    if (entry != NULL){
+        lru_unlink(shard, entry);
+        lru_push_front(shard, entry);
+        memcpy(buffer, entry->data + offset, length);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return entry != NULL;
+}
+
+/**
+ * @brief Adds a cluster to the cache, evicting the shard's least recently used cluster if it is full
+ */
+static void cache_insert(struct block_cache *bc, uint32_t cluster, uint8_t *data){
+    struct cache_shard *shard = get_cache_shard(bc, cluster);
+    struct cache_entry **bucket = &shard->buckets[cluster_hash(cluster) & shard->bucket_mask];
+    struct cache_entry *entry;
+
+    pthread_mutex_lock(&shard->lock);
+    // Another thread may have read the same cluster in the meantime
+    for (entry = *bucket; entry != NULL; entry = entry->hash_next){
+        if (entry->cluster == cluster){
+            pthread_mutex_unlock(&shard->lock);
+            return;
+        }
+    }
+
+    if (shard->count >= shard->capacity){
+        entry = shard->lru_tail;
+        lru_unlink(shard, entry);
+        struct cache_entry **link = &shard->buckets[cluster_hash(entry->cluster) & shard->bucket_mask];
+        while (*link != entry)
+            link = &(*link)->hash_next;
+        *link = entry->hash_next;
+        shard->count--;
+    }
+    else{
+        entry = malloc(sizeof(struct cache_entry) + bc->block_size);
+        if (entry == NULL){
+            pthread_mutex_unlock(&shard->lock);
+            return;
+        }
+        entry->data = (uint8_t *)(entry + 1);
+    }
+
+    entry->cluster = cluster;
+    memcpy(entry->data, data, bc->block_size);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    lru_push_front(shard, entry);
+    shard->count++;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Reads part of a cluster through the block cache.  On a miss the whole cluster is read
+ * and cached, and when clusters are being missed in order the read is extended to the following
+ * clusters (doubling up to readahead_max) so sequential scans turn into large reads.
+ *
+ * @param cluster cluster number as stored in the FAT
+ * @param offset offset within the cluster
+ * @return int : 0 if successful, -1 on a read error
+ */
+static int read_cluster_cached(int fp, struct block_cache *bc, uint32_t cluster, void *buffer, uint32_t offset, uint32_t length){
+    uint32_t count = 1;
+
+    if (!bc->enabled)
+        return image_pread(fp, buffer, length, cts(cluster) + offset) < 0 ? -1 : 0;
+
+    if (cache_lookup(bc, cluster, buffer, offset, length)){
+        __atomic_fetch_add(&bc->hits, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    __atomic_fetch_add(&bc->misses, 1, __ATOMIC_RELAXED);
+
+    if (__atomic_load_n(&bc->next_expected, __ATOMIC_RELAXED) == cluster){
+        count = __atomic_load_n(&bc->readahead_window, __ATOMIC_RELAXED) * 2;
+        if (count > bc->readahead_max)
+            count = bc->readahead_max;
+    }
+    __atomic_store_n(&bc->readahead_window, count, __ATOMIC_RELAXED);
+    __atomic_store_n(&bc->next_expected, cluster + count, __ATOMIC_RELAXED);
+
+    uint8_t *run = malloc((size_t)count * bc->block_size);
+    if (run == NULL)
+        return -1;
+    ssize_t n = image_pread(fp, run, (size_t)count * bc->block_size, cts(cluster));
+    if (n < offset + length){
+        free(run);
+        return -1;
+    }
+    // Only whole clusters are cached, a short read at the end of the image is passed through
+    for (uint32_t i = 0; i < count && (i + 1) * (ssize_t)bc->block_size <= n; i++)
+        cache_insert(bc, cluster + i, run + (size_t)i * bc->block_size);
+    if (count > 1)
+        __atomic_fetch_add(&bc->readahead_blocks, count - 1, __ATOMIC_RELAXED);
+    memcpy(buffer, run + offset, length);
+    free(run);
+    return 0;
+}
+
+/**
+ * @brief Frees every cached cluster
+ */
+static void free_block_cache(struct block_cache *bc){
+    if (!bc->enabled)
+        return;
+    for (int i = 0; i < BLOCK_CACHE_SHARDS; i++){
+        struct cache_entry *entry = bc->shards[i].lru_head;
+        while (entry != NULL){
+            struct cache_entry *next = entry->lru_next;
+            free(entry);
+            entry = next;
+        }
+        free(bc->shards[i].buckets);
+        pthread_mutex_destroy(&bc->shards[i].lock);
+    }
+    bc->enabled = false;
+}
+
+/**
+ * @brief Adds to a progress counter.  Relaxed ordering is enough, the counters are only read for
+ * reporting.
+ */
+static void progress_add(uint64_t *counter, uint64_t value){
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void progress_set(uint64_t *counter, uint64_t value){
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static void progress_phase(int phase){
+    __atomic_store_n(&fg->progress.phase, phase, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Returns the offset of the first non-zero byte in a buffer, or length if it is all zeros.
+ * Tests four vectors (128 bytes) per iteration.
+ */
+static size_t find_nonzero(const uint8_t *buffer, size_t length){
+    size_t i = 0;
+
+    for (; i + 4 * SCAN_VECTOR_SIZE <= length; i += 4 * SCAN_VECTOR_SIZE){
+        byte_vector v[4];
+        uint64_t words[SCAN_VECTOR_SIZE / 8];
+        memcpy(v, buffer + i, sizeof(v));
+        byte_vector any = v[0] | v[1] | v[2] | v[3];
+        memcpy(words, &any, sizeof(words));
+        if (words[0] | words[1] | words[2] | words[3])
+            break;
+    }
+    for (; i < length; i++){
+        if (buffer[i])
+            return i;
+    }
+    return length;
+}
+
+/**
+ * @brief Parses one line of the pattern file
+ *
+ * @return int : 0 if successful, -1 if the line is not a valid pattern
+ */
+static int parse_pattern(char *line, struct pattern *p){
+    size_t length = strlen(line);
+
+    p->text = strdup(line);
+    p->bytes = malloc(length + 1);
+    p->length = 0;
+    if (p->text == NULL || p->bytes == NULL)
+        return -1;
+    if (strncmp(line, "hex:", 4)){
+        memcpy(p->bytes, line, length);
+        p->length = length;
+        return 0;
+    }
+    for (char *c = line + 4; *c;){
+        unsigned int byte;
+        if (isspace((unsigned char)*c)){
+            c++;
+            continue;
+        }
+        if (!isxdigit((unsigned char)c[0]) || !isxdigit((unsigned char)c[1]) || sscanf(c, "%2x", &byte) != 1)
+            return -1;
+        p->bytes[p->length++] = byte;
+        c += 2;
+    }
+    return p->length ? 0 : -1;
+}
+
+/**
+ * @brief Adds a state to the pattern automaton
+ */
+static uint32_t add_matcher_state(struct pattern_matcher *m, uint32_t *capacity){
+    if (m->state_count == *capacity){
+        *capacity = *capacity ? *capacity * 2 : 256;
+        m->next = realloc(m->next, *capacity * sizeof(*m->next));
+        m->match = realloc(m->match, *capacity * sizeof(uint32_t));
+        m->match_link = realloc(m->match_link, *capacity * sizeof(uint32_t));
+        if (m->next == NULL || m->match == NULL || m->match_link == NULL){
+            fprintf(stderr, "Aborting... Out of memory while building the pattern matcher.\n");
+            fatal();
+        }
+    }
+    memset(m->next[m->state_count], 0, sizeof(*m->next));
+    m->match[m->state_count] = 0;
+    m->match_link[m->state_count] = 0;
+    return m->state_count++;
+}
+
+/**
+ * @brief Reads the pattern file and builds the Aho-Corasick automaton.  The patterns are first
+ * added to a trie, then a breadth first pass fills in the failure transitions so every state has
+ * a transition for every byte.
+ *
+ * @param path
+ */
+static void load_patterns(struct pattern_matcher *m, const char *path){
+    FILE *file = fopen(path, "r");
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    uint32_t capacity = 0;
+    uint32_t line_number = 0;
+
+    if (file == NULL){
+        fprintf(stderr, "Aborting... Unable to open the pattern file at: %s\n", path);
+        fatal();
+    }
+    add_matcher_state(m, &capacity); // root
+    while ((length = getline(&line, &line_size, file)) >= 0){
+        line_number++;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = 0;
+        if (length == 0 || line[0] == '#')
+            continue;
+        m->patterns = realloc(m->patterns, (m->pattern_count + 1) * sizeof(struct pattern));
+        if (m->patterns == NULL || parse_pattern(line, &m->patterns[m->pattern_count])){
+            fprintf(stderr, "Aborting... Invalid pattern on line %u of %s\n", line_number, path);
+            fatal();
+        }
+
+        // Add the pattern to the trie
+        struct pattern *p = &m->patterns[m->pattern_count++];
+        uint32_t state = 0;
+        for (uint32_t i = 0; i < p->length; i++){
+            if (m->next[state][p->bytes[i]] == 0){
+                uint32_t child = add_matcher_state(m, &capacity);
+                m->next[state][p->bytes[i]] = child;
+            }
+            state = m->next[state][p->bytes[i]];
+        }
+        if (m->match[state] == 0)
+            m->match[state] = m->pattern_count;
+    }
+    free(line);
+    fclose(file);
+    if (m->pattern_count == 0){
+        fprintf(stderr, "Aborting... No patterns found in %s\n", path);
+        fatal();
+    }
+
+    // Breadth first over the trie.  A state's row is completed when it is dequeued, so any
+    // non-zero transition seen at that point is a trie edge.
+    uint32_t *fail = calloc(m->state_count, sizeof(uint32_t));
+    uint32_t *queue = malloc(m->state_count * sizeof(uint32_t));
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    if (fail == NULL || queue == NULL){
+        fprintf(stderr, "Aborting... Out of memory while building the pattern matcher.\n");
+        fatal();
+    }
+    for (int c = 0; c < 256; c++){
+        if (m->next[0][c])
+            queue[tail++] = m->next[0][c];
+    }
+    while (head < tail){
+        uint32_t state = queue[head++];
+        for (int c = 0; c < 256; c++){
+            uint32_t child = m->next[state][c];
+            if (child == 0){
+                m->next[state][c] = m->next[fail[state]][c];
+                continue;
+            }
+            fail[child] = m->next[fail[state]][c];
+            m->match_link[child] = m->match[fail[child]] ? fail[child] : m->match_link[fail[child]];
+            queue[tail++] = child;
+        }
+    }
+    free(fail);
+    free(queue);
+    m->skip_zeros = m->next[0][0] == 0;
+    m->enabled = true;
+}
+
+static void free_patterns(struct pattern_matcher *m){
+    for (uint32_t i = 0; i < m->pattern_count; i++){
+        free(m->patterns[i].bytes);
+        free(m->patterns[i].text);
+    }
+    free(m->patterns);
+    free(m->next);
+    free(m->match);
+    free(m->match_link);
+    m->enabled = false;
+}
+
+/**
+ * @brief Prints a pattern hit
+ *
+ * @param end offset within the disk image of the last byte of the match
+ */
+static void report_pattern_hit(struct pattern_matcher *m, struct region_scan *scan, uint32_t index, uint64_t end){
+    struct pattern *p = &m->patterns[index];
+
+    m->hits++;
+    if (scan->label)
+        report("Pattern \"%s\" found in the %s (%s) at offset 0x%jx\n", p->text, region_type_txt[scan->type], scan->label, (uintmax_t)(end + 1 - p->length));
+    else
+        report("Pattern \"%s\" found in the %s at offset 0x%jx\n", p->text, region_type_txt[scan->type], (uintmax_t)(end + 1 - p->length));
+}
+
+/**
+ * @brief Runs the pattern automaton over part of a region.  While the automaton is in its root
+ * state zero bytes cannot start a match, so zero runs are skipped with find_nonzero.
+ *
+ * @param offset offset within the disk image of the first byte of buffer
+ */
+static void match_patterns(struct pattern_matcher *m, struct region_scan *scan, const uint8_t *buffer, size_t length, uint64_t offset){
+    uint32_t state = scan->match_state;
+
+    for (size_t i = 0; i < length; i++){
+        if (state == 0 && m->skip_zeros){
+            i += find_nonzero(buffer + i, length - i);
+            if (i == length)
+                break;
+        }
+        state = m->next[state][buffer[i]];
+        if (m->match[state])
+            report_pattern_hit(m, scan, m->match[state] - 1, offset + i);
+        for (uint32_t link = m->match_link[state]; link; link = m->match_link[link])
+            report_pattern_hit(m, scan, m->match[link] - 1, offset + i);
+    }
+    scan->match_state = state;
+}
+
+/**
+ * @brief Feeds part of a region to its scan.  Runs of zeros are skipped with find_nonzero, so only
+ * blocks that actually contain data are looked at byte by byte.
+ *
+ * @param offset offset within the disk image of the first byte of buffer
+ */
+static void scan_buffer(struct region_scan *scan, const uint8_t *buffer, size_t length, uint64_t offset){
+    size_t i = find_nonzero(buffer, length);
+    uint32_t bank[HISTOGRAM_BANKS][256];
+
+    if (fg->matcher.enabled)
+        match_patterns(&fg->matcher, scan, buffer, length, offset);
+    scan->scanned += length;
+    progress_add(&fg->progress.bytes, length);
+    if (i == length)
+        return;
+    if (scan->nonzero == 0)
+        scan->first_nonzero = offset + i;
+
+    // Blocks with data are counted into the byte histogram, four bytes at a time with one bank
+    // each.  Zeros are not stored, they are whatever is left of the scanned bytes.
+    memset(bank, 0, sizeof(bank));
+    while (i < length){
+        size_t block_end = (i | (4 * SCAN_VECTOR_SIZE - 1)) + 1;
+        if (block_end > length)
+            block_end = length;
+        for (; i + HISTOGRAM_BANKS <= block_end; i += HISTOGRAM_BANKS){
+            bank[0][buffer[i]]++;
+            bank[1][buffer[i + 1]]++;
+            bank[2][buffer[i + 2]]++;
+            bank[3][buffer[i + 3]]++;
+        }
+        for (; i < block_end; i++)
+            bank[0][buffer[i]]++;
+        i += find_nonzero(buffer + i, length - i);
+    }
+    for (int b = 1; b < 256; b++){
+        uint32_t count = bank[0][b] + bank[1][b] + bank[2][b] + bank[3][b];
+        scan->histogram[b] += count;
+        scan->nonzero += count;
+    }
+}
+
+/**
+ * @brief Computes the entropy and byte classes of a scanned region.  The entropy only covers the
+ * non-zero bytes, so a few bytes of ciphertext in a mostly empty cluster still score high.
+ */
+static void profile_region(struct region_scan *scan, struct byte_profile *profile){
+    uint64_t classes[BYTE_CLASS_COUNT] = {0};
+
+    memset(profile, 0, sizeof(struct byte_profile));
+    classes[BYTE_ZERO] = scan->scanned - scan->nonzero;
+    for (int b = 1; b < 256; b++){
+        if (scan->histogram[b] == 0)
+            continue;
+        double p = (double)scan->histogram[b] / scan->nonzero;
+        profile->entropy -= p * log2(p);
+        if (b >= 0x80)
+            classes[BYTE_HIGH] += scan->histogram[b];
+        else if ((b >= 0x20 && b < 0x7f) || b == '\t' || b == '\n' || b == '\r')
+            classes[BYTE_ASCII] += scan->histogram[b];
+        else
+            classes[BYTE_CONTROL] += scan->histogram[b];
+    }
+    // Zeros are a share of the region, the other classes a share of the data itself
+    profile->class_percent[BYTE_ZERO] = scan->scanned ? 100.0 * classes[BYTE_ZERO] / scan->scanned : 0;
+    for (int c = BYTE_ASCII; c < BYTE_CLASS_COUNT; c++)
+        profile->class_percent[c] = scan->nonzero ? 100.0 * classes[c] / scan->nonzero : 0;
+
+    // A handful of bytes can't have high entropy, so short runs are judged on their classes alone
+    double ascii_share = scan->nonzero ? (double)classes[BYTE_ASCII] / scan->nonzero : 0;
+    if (profile->entropy >= 7.2 && scan->nonzero >= 256)
+        profile->kind = DATA_ENCRYPTED;
+    else if (ascii_share >= 0.9)
+        profile->kind = DATA_TEXT;
+    else if (scan->nonzero < 16)
+        profile->kind = DATA_STRAY_BYTES;
+    else
+        profile->kind = DATA_BINARY;
+
+    // More data and more randomness are both more suspicious
+    profile->suspicion = log2(1.0 + scan->nonzero) * (1.0 + profile->entropy);
+}
+
+static void print_byte_profile(struct byte_profile *profile){
+    report(" Entropy: %.2f bits/byte (%s).  Region is %.1f%% zero, non-zero bytes are %.1f%% ASCII, %.1f%% control, %.1f%% high\n\n",
+        profile->entropy, data_kind_txt[profile->kind], profile->class_percent[BYTE_ZERO], profile->class_percent[BYTE_ASCII],
+        profile->class_percent[BYTE_CONTROL], profile->class_percent[BYTE_HIGH]);
+}
+
+/**
+ * @brief Profiles a region with hidden data and adds it to the findings that are ranked at the end
+ * of the run
+ *
+ * @param label describes the region, copied into the finding
+ * @return struct finding* the new finding
+ */
+static struct finding* record_finding(struct region_scan *scan, const char *label){
+    struct finding *f;
+
+    if (fg->findings.count == fg->findings.capacity){
+        uint64_t capacity = fg->findings.capacity ? fg->findings.capacity * 2 : 64;
+        struct finding *items = realloc(fg->findings.items, capacity * sizeof(struct finding));
+        if (items == NULL){
+            fprintf(stderr, "Aborting... Out of memory while recording findings.\n");
+            fatal();
+        }
+        fg->findings.items = items;
+        fg->findings.capacity = capacity;
+    }
+    f = &fg->findings.items[fg->findings.count++];
+    f->type = scan->type;
+    snprintf(f->label, sizeof(f->label), "%s", label ? label : "");
+    f->offset = scan->first_nonzero;
+    f->nonzero = scan->nonzero;
+    profile_region(scan, &f->profile);
+    if (fg->on_finding){
+        struct fg_finding info = {
+            .region = region_type_txt[f->type], .label = f->label, .offset = scan->offset, .length = scan->length,
+            .nonzero = f->nonzero, .first_nonzero = f->offset, .entropy = f->profile.entropy, .kind = data_kind_txt[f->profile.kind]
+        };
+        fg->on_finding(&info, fg->on_finding_user);
+    }
+    return f;
+}
+
+static int compare_findings(const void *a, const void *b){
+    const struct finding *fa = a;
+    const struct finding *fb = b;
+
+    if (fa->profile.suspicion != fb->profile.suspicion)
+        return fa->profile.suspicion < fb->profile.suspicion ? 1 : -1;
+    return fa->offset < fb->offset ? -1 : fa->offset > fb->offset;
+}
+
+/**
+ * @brief Prints the findings of the run, most suspicious first
+ */
+static void print_ranked_findings(struct finding_list *list){
+    uint64_t shown = list->count;
+
+    if (list->count == 0)
+        return;
+    if (!fg->args.v_flag && shown > RANKED_FINDINGS_MAX)
+        shown = RANKED_FINDINGS_MAX;
+    qsort(list->items, list->count, sizeof(struct finding), compare_findings);
+    report("Findings ranked by suspicion (%ju of %ju):\n", (uintmax_t)shown, (uintmax_t)list->count);
+    for (uint64_t i = 0; i < shown; i++){
+        struct finding *f = &list->items[i];
+        report(" %3ju. score %6.1f  %s (%s) at offset 0x%jx: %ju non-zero bytes, %.2f bits/byte, %s\n",
+            (uintmax_t)i + 1, f->profile.suspicion, region_type_txt[f->type], f->label, (uintmax_t)f->offset,
+            (uintmax_t)f->nonzero, f->profile.entropy, data_kind_txt[f->profile.kind]);
+    }
+    report("\n");
+}
+
+/**
+ * @brief Sweeps part of a region of the disk image with large sequential reads
+ *
+ * @param offset offset within the disk image to start at
+ * @param length bytes to sweep
+ * @return int : 0 if successful, -1 on a read error
+ */
+static int scan_range(int fp, struct region_scan *scan, uint64_t offset, uint64_t length){
+    uint8_t *buffer = malloc(SCAN_CHUNK_SIZE);
+    uint64_t done = 0;
+
+    if (buffer == NULL)
+        return -1;
+    while (done < length){
+        size_t chunk = length - done < SCAN_CHUNK_SIZE ? length - done : SCAN_CHUNK_SIZE;
+        ssize_t n = image_pread(fp, buffer, chunk, offset + done);
+        if (n <= 0){
+            free(buffer);
+            return -1;
+        }
+        scan_buffer(scan, buffer, n, offset + done);
+        done += n;
+    }
+    free(buffer);
+    return 0;
+}
+
+/**
+ * @brief Sweeps a region of the disk image with large sequential reads
+ *
+ * @return int : 0 if successful, -1 on a read error
+ */
+static int scan_region(int fp, struct region_scan *scan){
+    return scan_range(fp, scan, scan->offset, scan->length);
+}
+
+/**
+ * @brief Prints a finding for a swept region if it contained any non-zero bytes
+ *
+ * @param label describes where the region is, e.g. "sectors 3 to 5"
+ * @return bool : true if hidden data was reported
+ */
+static bool report_region(struct region_scan *scan, const char *label){
+    if (scan->nonzero == 0)
+        return false;
+    fg->hidden_data_found = true; // mark the global var as true
+    report("Possible hidden data found in the %s (%s): %ju non-zero bytes, first at offset 0x%jx\n",
+        region_type_txt[scan->type], label, (uintmax_t)scan->nonzero, (uintmax_t)scan->first_nonzero);
+    print_byte_profile(&record_finding(scan, label)->profile);
+    return true;
+}
+
+/**
+ * @brief Returns the monotonic clock in seconds
+ */
+static double now_seconds(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Returns the next number from the sampler's splitmix64 generator
+ */
+static uint64_t sample_random(struct sampler *s){
+    uint64_t z = (s->rng += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Sets up --sample mode
+ *
+ * @param strata number of strata that will run on this image
+ */
+static void init_sampler(struct sampler *s, struct fg_options *args, uint32_t strata){
+    s->enabled = true;
+    s->fraction = args->sample_percent / 100;
+    s->rng = args->seed;
+    s->start = now_seconds();
+    s->strata_pending = strata;
+}
+
+/**
+ * @brief Starts a stratum the first time it is used, giving it an even share of the budgets that
+ * are left.  Strata that finish under budget leave the rest to the ones after them.
+ */
+static struct sample_stratum* begin_stratum(struct sampler *s, int type){
+    struct sample_stratum *stratum = &s->strata[type];
+    uint32_t share = s->strata_pending ? s->strata_pending : 1;
+
+    if (stratum->started)
+        return stratum;
+    stratum->started = true;
+    if (s->strata_pending)
+        s->strata_pending--;
+    if (fg->args.byte_budget)
+        stratum->byte_limit = fg->args.byte_budget > s->bytes ? (fg->args.byte_budget - s->bytes) / share : 1;
+    if (fg->args.time_budget){
+        double left = fg->args.time_budget - (now_seconds() - s->start);
+        stratum->deadline = now_seconds() + (left > 0 ? left / share : 0);
+    }
+    return stratum;
+}
+
+/**
+ * @brief Checks whether a stratum can afford another unit
+ *
+ * @param bytes size of the unit
+ * @return bool : false once the stratum's byte or time budget is used up
+ */
+static bool sample_budget_left(struct sample_stratum *stratum, uint64_t bytes){
+    if (stratum->exhausted)
+        return false;
+    if ((stratum->byte_limit && stratum->bytes + bytes > stratum->byte_limit) ||
+        (stratum->deadline && now_seconds() > stratum->deadline))
+        stratum->exhausted = true;
+    return !stratum->exhausted;
+}
+
+/**
+ * @brief Records a checked unit
+ */
+static void sample_record(struct sampler *s, struct sample_stratum *stratum, uint64_t bytes, bool positive){
+    stratum->sampled++;
+    stratum->positive += positive;
+    stratum->bytes += bytes;
+    s->bytes += bytes;
+}
+
+/**
+ * @brief Returns the number of units to check out of a population
+ */
+static uint64_t sample_target(struct sampler *s, uint64_t population){
+    uint64_t target = ceil(population * s->fraction);
+
+    return target > population ? population : target;
+}
+
+/**
+ * @brief Picks the index of the unit to check in one bin of a stratified sample.  The population is
+ * split into target equal bins and one random unit is taken from each, so the sample covers the
+ * whole stratum evenly.
+ */
+static uint64_t sample_pick(struct sampler *s, uint64_t population, uint64_t target, uint64_t bin){
+    uint64_t first = (uint64_t)((double)bin * population / target);
+    uint64_t end = (uint64_t)((double)(bin + 1) * population / target);
+
+    if (end <= first)
+        return first;
+    return first + sample_random(s) % (end - first);
+}
+
+/**
+ * @brief Checks a stratified sample of a region in SAMPLE_REGION_UNIT sized units.  The region scan
+ * only covers the units that were read.
+ *
+ * @return int : 0 if successful, -1 on a read error
+ */
+static int sample_region(int fp, struct region_scan *scan){
+    struct sample_stratum *stratum = begin_stratum(&fg->sample, STRATUM_REGIONS);
+    uint64_t units = (scan->length + SAMPLE_REGION_UNIT - 1) / SAMPLE_REGION_UNIT;
+    uint64_t target = sample_target(&fg->sample, units);
+    uint8_t *buffer = malloc(SAMPLE_REGION_UNIT);
+
+    if (buffer == NULL)
+        return -1;
+    stratum->population += units;
+    for (uint64_t bin = 0; bin < target; bin++){
+        uint64_t unit = sample_pick(&fg->sample, units, target, bin);
+        uint64_t offset = unit * SAMPLE_REGION_UNIT;
+        uint64_t length = scan->length - offset < SAMPLE_REGION_UNIT ? scan->length - offset : SAMPLE_REGION_UNIT;
+        uint64_t nonzero = scan->nonzero;
+
+        if (!sample_budget_left(stratum, length))
+            break;
+        if (image_pread(fp, buffer, length, scan->offset + offset) != (ssize_t)length){
+            free(buffer);
+            return -1;
+        }
+        scan->match_state = 0; // units are not contiguous
+        scan_buffer(scan, buffer, length, scan->offset + offset);
+        sample_record(&fg->sample, stratum, length, scan->nonzero > nonzero);
+    }
+    free(buffer);
+    return 0;
+}
+
+/**
+ * @brief Returns the one sided 95% upper confidence bound on the share of units holding data
+ * (Wilson score interval)
+ */
+static double sample_upper_bound(uint64_t positive, uint64_t sampled){
+    const double z = 1.645;
+    double n = sampled;
+    double p = n ? positive / n : 0;
+
+    if (sampled == 0)
+        return 1;
+    double bound = (p + z * z / (2 * n) + z * sqrt(p * (1 - p) / n + z * z / (4 * n * n))) / (1 + z * z / n);
+    return bound > 1 ? 1 : bound;
+}
+
+/**
+ * @brief Prints what --sample mode checked and the confidence it reached
+ */
+static void print_sample_report(struct sampler *s){
+    double worst = 0;
+    uint64_t positive = 0;
+
+    report("Sampling summary (%.3g%% of units, seed %ju, %.2f seconds, %ju bytes read):\n",
+        s->fraction * 100, (uintmax_t)fg->args.seed, now_seconds() - s->start, (uintmax_t)s->bytes);
+    for (int i = 0; i < STRATUM_COUNT; i++){
+        struct sample_stratum *stratum = &s->strata[i];
+        if (!stratum->started)
+            continue;
+        double bound = sample_upper_bound(stratum->positive, stratum->sampled);
+        report(" %s: checked %ju of %ju units, %ju held data%s.  With 95%% confidence at most %.2f%% of the units hold data.\n",
+            stratum_txt[i], (uintmax_t)stratum->sampled, (uintmax_t)stratum->population, (uintmax_t)stratum->positive,
+            stratum->exhausted ? " (budget ran out)" : "", bound * 100);
+        positive += stratum->positive;
+        if (bound > worst)
+            worst = bound;
+    }
+    if (positive)
+        report("Hidden data was found in the sample.  Counts in the findings above only cover the sampled units.\n\n");
+    else
+        report("No hidden data was found in the sample.  With 95%% confidence at most %.2f%% of the units in any stratum hold data.\n\n", worst * 100);
+}
+
+/**
+ * @brief Sweeps a region and reports it.  Empty regions are skipped.
+ *
+ * @return bool : true if hidden data was reported
+ */
+static bool check_region(int fp, int type, uint64_t offset, uint64_t length, const char *label){
+    struct region_scan scan = {.type = type, .offset = offset, .length = length, .label = label};
+
+    if (length == 0)
+        return false;
+    if (fg->sample.enabled ? sample_region(fp, &scan) : scan_region(fp, &scan))
+        read_error();
+    return report_region(&scan, label);
+}
+
+/**
+ * @brief Sets up the arena used for the directory tree
+ *
+ * @param spill back the arena with an unlinked temporary file instead of heap memory
+ * @param resident_limit bytes that may be allocated before older chunks are dropped from RSS
+ * @return int : 0 if successful, -1 if the temporary file could not be created
+ */
+static int init_arena(struct arena *a, bool spill, uint64_t resident_limit){
+    const char *tmpdir = getenv("TMPDIR");
+    char path[4096];
+
+    a->fd = -1;
+    if (!spill)
+        return 0;
+    snprintf(path, sizeof(path), "%s/feeler_gauge_XXXXXX", tmpdir ? tmpdir : "/tmp");
+    a->fd = mkstemp(path);
+    if (a->fd < 0)
+        return -1;
+    unlink(path); // the file disappears as soon as it is closed
+    a->resident_limit = resident_limit;
+    return 0;
+}
+
+/**
+ * @brief Drops every chunk but the current one from the resident set.  For spilled chunks the
+ * kernel writes dirty pages back to the temporary file and faults them back in if touched again.
+ */
+static void trim_arena(struct arena *a){
+    if (a->fd < 0 || a->chunks == NULL)
+        return;
+    for (struct arena_chunk *chunk = a->chunks->next; chunk != NULL;){
+        struct arena_chunk *next = chunk->next;
+        madvise(chunk, chunk->size, MADV_DONTNEED);
+        chunk = next;
+    }
+    a->resident = 0;
+}
+
+/**
+ * @brief Allocates zeroed memory from the arena.  Allocations live until free_arena.
+ */
+static void* arena_alloc(struct arena *a, size_t size){
+    struct arena_chunk *chunk = a->chunks;
+
+    size = (size + 7) & ~(size_t)7;
+    if (chunk == NULL || chunk->used + size > chunk->size - sizeof(struct arena_chunk)){
+        size_t chunk_size = ARENA_CHUNK_SIZE;
+        while (chunk_size < size + sizeof(struct arena_chunk))
+            chunk_size *= 2;
+        if (a->fd >= 0){
+            if (ftruncate(a->fd, a->file_size + chunk_size) < 0)
+                chunk = MAP_FAILED;
+            else
+                chunk = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE, MAP_SHARED, a->fd, a->file_size);
+            if (chunk == MAP_FAILED)
+                chunk = NULL;
+            a->file_size += chunk_size;
+        }
+        else
+            chunk = calloc(1, chunk_size);
+        if (chunk == NULL){
+            fprintf(stderr, "Aborting... Out of memory while building the directory tree.\n");
+            fatal();
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = a->chunks;
+        a->chunks = chunk;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    a->resident += size;
+    if (a->resident_limit && a->resident > a->resident_limit)
+        trim_arena(a);
+    return ptr;
+}
+
+/**
+ * @brief Frees every allocation made from the arena
+ */
+static void free_arena(struct arena *a){
+    struct arena_chunk *next;
+
+    for (struct arena_chunk *chunk = a->chunks; chunk != NULL; chunk = next){
+        next = chunk->next;
+        if (a->fd >= 0)
+            munmap(chunk, chunk->size);
+        else
+            free(chunk);
+    }
+    a->chunks = NULL;
+    if (a->fd >= 0)
+        close(a->fd);
+    a->fd = -1;
+}
+
+/**
+ * @brief Returns the resident set size of the process in bytes, or 0 if it cannot be determined
+ */
+static uint64_t current_rss(void){
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm == NULL)
+        return 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief Attempts to open the disk image supplied by the user.
+ * 
+ * @param args : struct containing the various cmd line arguments supplied by the user
+ * @return int : return fp if successful, -1 if an error occurs
+ */
+static int open_disk_image(struct fg_options *args){
+    int fp = open(args->image_path, O_RDONLY);
+    // Ensure the file open was successful
+    if (fp == -1) {
+        fprintf(stderr,
+            "Aborting... Could not read/access the file located at: %s\n",
+            args->image_path);
+        fatal();
+    }
+    open_image_backend(fp, args);
+    return fp;
+}
+
+static int read_mbr_sector(int fp, struct mbr_sector *mbr){
+    int mbr_sector_offsets[4] = {MBR_PART1_OFF, MBR_PART2_OFF, MBR_PART3_OFF, MBR_PART4_OFF};
+    uint8_t buf[1] = {0};
+    uint32_t buf32[1] = {0};
+    bool extended_found = false;
+    uint8_t extended_entry[4] = {0};
+
+    // Parse MBR
+    for (int i = 0; i < 4; i++){
+        // Check for extended partitions within MBR
+        if (image_pread(fp, buf, 1, mbr_sector_offsets[i] + PARTITION_TYPE) < 0)
+            read_error();
+        if (buf[0] == EXTENDED || buf[0] == EXTENDED_LBA){
+            extended_found = true;
+            extended_entry[i] = true;
+        }
+
+        // Get Partiton Type
+        if (image_pread(fp, buf, 1, mbr_sector_offsets[i] + PARTITION_TYPE) < 0)
+            read_error();
+        mbr->entry[i].partition_type = buf[0];
+
+        // Get Boot Indicator Status
+        if (image_pread(fp, buf, 1, mbr_sector_offsets[i] + BOOT_INDICATOR) < 0)
+            read_error();
+        mbr->entry[i].boot_indicator = buf[0];
+
+        // Get Starting Sector
+        if (image_pread(fp, buf32, 4, mbr_sector_offsets[i] + STARTING_SECTOR) < 0)
+            read_error();
+        mbr->entry[i].starting_sector = buf32[0];
+
+        // Get Partition Size
+        if (image_pread(fp, buf32, 4, mbr_sector_offsets[i] + PARTITION_SIZE) < 0)
+            read_error();
+        mbr->entry[i].partition_size = buf32[0];
+    }
+    
+    // Will be used once extended entry support is added
+    if (extended_found){
+        for (int i = 0; i < 4; i++){
+            if (extended_entry[i])
+                continue;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Runs a series of calculations to determine FAT File System Type.  Can differentiate
+ * between FAT12, FAT16, and FAT32.  Formula based on page 229 of File System Forensic Analysis 
+ * book by Brian Carrier
+ * 
+ * @param fat_sector 
+ */
+static void calc_fat_type(struct fat_boot_sector *fat_sector){
+    uint32_t root_dir_sectors = ((fat_sector->max_files_in_root * 32) + (fg->bps - 1)) / fg->bps;
+    uint32_t sectors_to_clusters;
+    if (fat_sector->sector_count_16b)
+        sectors_to_clusters = fat_sector->sector_count_16b - fat_sector->reserved_area_size - (fat_sector->number_of_fats * fat_sector->fat_size_in_sectors) - root_dir_sectors;
+    else
+        sectors_to_clusters = fat_sector->sector_count_32b - fat_sector->reserved_area_size - (fat_sector->number_of_fats * fat_sector->fat_size_in_sectors) - root_dir_sectors;
+    
+    uint32_t final_value = sectors_to_clusters/fat_sector->sectors_per_cluster;
+
+    if (final_value < 4085)
+        fat_sector->is_fat12 = true;
+    if (final_value >= 4085 && final_value < 65525)
+        fat_sector->is_fat16 = true;
+    if (final_value >= 65525)
+        fat_sector->is_fat32 = true;
+}
+
+/**
+ * @brief Decodes the fields common to every FAT boot sector straight from the sector bytes
+ */
+static void decode_fat_boot_sector(const uint8_t *sector, struct fat_boot_sector *fat_sector){
+    memcpy(fat_sector->oem_name, sector + OEM_NAME, 8);
+    fat_sector->bytes_per_sector = le16(sector + BYTES_PER_SECTOR);
+    fat_sector->sectors_per_cluster = sector[SECTORS_PER_CLUSTER];
+    fat_sector->reserved_area_size = le16(sector + RESERVED_AREA_SIZE);
+    fat_sector->number_of_fats = sector[NUMBER_OF_FATS];
+    fat_sector->max_files_in_root = le16(sector + MAX_FILES_IN_ROOT);
+    fat_sector->sector_count_16b = le16(sector + SECTOR_COUNT_16B);
+    fat_sector->media_type = sector[MEDIA_TYPE];
+    fat_sector->fat_size_in_sectors = le16(sector + FAT_SIZE_IN_SECTORS);
+    fat_sector->sectors_per_track = le16(sector + SECTORS_PER_TRACK);
+    fat_sector->head_number = le16(sector + HEAD_NUMBER);
+    fat_sector->sectors_before_partition = le32(sector + SECTORS_BEFORE_PARTITION);
+    fat_sector->sector_count_32b = le32(sector + SECTOR_COUNT_32B);
+    fat_sector->bios_drive_number = sector[BIOS_DRIVE_NUMBER];
+    fat_sector->extended_boot_sig = sector[EXTENDED_BOOT_SIG];
+    fat_sector->volume_serial = le32(sector + VOLUME_SERIAL);
+    memcpy(fat_sector->volume_label, sector + VOLUME_LABEL, 11);
+    memcpy(fat_sector->fs_type_label, sector + FS_TYPE_LABEL, 8);
+    fat_sector->fs_signature = le16(sector + FS_SIGNATURE);
+}
+
+/**
+ * @brief Decodes the extended fields of a FAT32 boot sector, which overlay the FAT12/16 ones
+ */
+static void decode_fat32_boot_sector(const uint8_t *sector, struct fat_boot_sector *fat_sector){
+    fat_sector->fat32_size_in_sectors = le32(sector + FAT32_SIZE_IN_SECTORS);
+    fat_sector->fat_mode = le16(sector + FAT_MODE);
+    fat_sector->fat32_version = le16(sector + FAT32_VERSION);
+    fat_sector->root_dir_cluster = le32(sector + ROOT_DIR_CLUSTER);
+    fat_sector->fsinfo_sector_addr = le16(sector + FSINFO_SECTOR);
+    fat_sector->backup_boot_sector_addr = le16(sector + BACKUP_BOOT_SECTOR_ADDR);
+    fat_sector->fat32_bios_drive_number = sector[FAT32_BIOS_DRIVE_NUMBER];
+    fat_sector->fat32_extended_boot_sig = sector[FAT32_EXTENDED_BOOT_SIG];
+    fat_sector->fat32_volume_serial = le32(sector + FAT32_VOLUME_SERIAL);
+    memcpy(fat_sector->fat32_volume_label, sector + FAT32_VOLUME_LABEL, 11);
+    memcpy(fat_sector->fat32_fs_type_label, sector + FAT32_FS_TYPE_LABEL, 8);
+}
+
+/**
+ * @brief Returns sector of the boot region read by read_fat_boot_sector, or NULL if it lies past
+ * what was read
+ */
+static const uint8_t* boot_region_sector(uint32_t sector){
+    if (fg->boot_region == NULL || fg->bps == 0 || ((uint64_t)sector + 1) * fg->bps > fg->boot_region_size)
+        return NULL;
+    return fg->boot_region + (uint64_t)sector * fg->bps;
+}
+
+/**
+ * @brief Reads the start of the reserved area in one go and decodes the boot sector from it.  The
+ * buffer is kept so the FSINFO sector and the backup boot records can be checked without reading
+ * the image again.
+ * 
+ * @param fp 
+ * @param mbr
+ * @param partition_offset If a raw/full disk image is used, this is
+ * the offset within the disk image to the FAT boot sector
+ * @return int 
+ */
+static int read_fat_boot_sector(int fp, struct fat_boot_sector *fat_sector, int partition_offset){
+    ssize_t length;
+
+    fg->boot_region = malloc(BOOT_REGION_SIZE);
+    if (fg->boot_region == NULL){
+        fprintf(stderr, "Aborting... Out of memory while reading the boot sector.\n");
+        fatal();
+    }
+    length = image_pread(fp, fg->boot_region, BOOT_REGION_SIZE, partition_offset);
+    if (length < 512) // a boot sector is at least 512 bytes
+        read_error();
+    fg->boot_region_size = length;
+    decode_fat_boot_sector(fg->boot_region, fat_sector);
+
+    //Write Global VAR 'bps' - shortcut for Bytes Per Sector
+    fg->bps = fat_sector->bytes_per_sector;
+
+    //Write Global VAR 'spc' - shortcut for Sectors Per Cluster
+    fg->spc = fat_sector->sectors_per_cluster;
+
+
+    // Determine FAT Type (i.e. FAT12, FAT16, or FAT32)
+    calc_fat_type(fat_sector);
+
+    // If FAT32 is detected, decode the extended FAT32 fields
+    if (fat_sector->is_fat32){
+        decode_fat32_boot_sector(fg->boot_region, fat_sector);
+
+        // The backup boot records are at sector 6 in practice, so they are almost always in the
+        // buffer already.  Otherwise the region is grown to cover them with a second read.
+        uint64_t backup_end = ((uint64_t)fat_sector->backup_boot_sector_addr + BOOT_RECORD_SECTORS) * fg->bps;
+        if (fat_sector->backup_boot_sector_addr < fat_sector->reserved_area_size && backup_end > fg->boot_region_size &&
+            fg->boot_region_size == BOOT_REGION_SIZE && fg->bps >= 512 && fg->bps <= 4096){
+            uint8_t *region = realloc(fg->boot_region, backup_end);
+            if (region == NULL){
+                fprintf(stderr, "Aborting... Out of memory while reading the backup boot sector.\n");
+                fatal();
+            }
+            fg->boot_region = region;
+            length = image_pread(fp, fg->boot_region + BOOT_REGION_SIZE, backup_end - BOOT_REGION_SIZE, partition_offset + BOOT_REGION_SIZE);
+            if (length < 0)
+                read_error();
+            fg->boot_region_size += length;
+        }
+    }
+
+    //Write Global VAR 'reserved_and_fats'
+    if (fat_sector->is_fat32)
+        fg->reserved_and_fats = (fat_sector->reserved_area_size * fg->bps) + (fat_sector->fat32_size_in_sectors * fg->bps * fat_sector->number_of_fats);
+    // FAT12/16 keep a fixed size root directory between the FATs and cluster 2, so it is included too
+    if (fat_sector->is_fat16 || fat_sector->is_fat12){
+        uint32_t root_dir_sectors = ((fat_sector->max_files_in_root * 32) + (fg->bps - 1)) / fg->bps;
+        fg->reserved_and_fats = (fat_sector->reserved_area_size * fg->bps) + (fat_sector->fat_size_in_sectors * fg->bps * fat_sector->number_of_fats) +
+            root_dir_sectors * fg->bps;
+    }
+    
+    return 0;
+}
+/**
+ * @brief Run a few checks to ensure partition data is valid
+ * 
+ */
+static void validate_fat_boot_sector(struct fat_boot_sector *fat_sector){
+    // Check that Bytes Per Sector is Valid
+    switch (fg->bps){
+        case 512:
+            break;
+        case 1024:
+            break;
+        case 2048:
+            break;
+        case 4096:
+            break;
+        default:
+            fprintf(stderr, "\nError!  Detected bytes per sector of: %d which is invalid."  \
+            "Must be 512, 1024, 2048, or 4096.  This indicates the disk image or file system might be corrupted", 
+            fg->bps);
+            fatal();
+            break;
+    }
+
+    // Check that Sectors Cluster is a Power of 2 and less than 32KB
+    uint8_t sec_per_clus = fat_sector->sectors_per_cluster;
+    if(!(sec_per_clus != 0) && ((sec_per_clus &(sec_per_clus - 1)) == 0)){
+        fprintf(stderr, "\nError!  Detected sectors per cluster of: %d which is invalid.  It must be a power of 2.  \
+                This indicates the disk image or file system might be corrupted", sec_per_clus);
+        fatal();
+    }
+    if (sec_per_clus * fg->bps > 32768){
+        fprintf(stderr, "\nError!  Detected sector size of: %d which is invalid.  It must be a power of 2.  \
+                This indicates the disk image or file system might be corrupted", sec_per_clus * fg->bps);
+        fatal();
+    }
+
+    // Check Number of FATS > 0
+    if (fat_sector->number_of_fats < 1){
+        fprintf(stderr, "\nError!  No FATs found. This indicates the disk image or file system might be corrupted");
+        fatal();
+    }
+    
+    // Check that Max Number of Files in Root Director is 0 when FAT32 detected
+    if (fat_sector->max_files_in_root && !fat_sector->fat_size_in_sectors){
+        fprintf(stderr, "\nWarning!  Conflicting indicators for FAT12/16 and FAT32.  The disk image or file system might be corrupted, proceed with caution.");
+    }
+
+    // Check media type
+    if (fat_sector->media_type != FIXED && fat_sector->media_type != REMOVABLE)
+        fprintf(stderr, "\nWarning!  Media type (removable/fixed) could not be detected.  The disk image or file system might be corrupted, proceed with caution.");
+
+    // Check that only one sector count is present (16 bits for FAT12/FAT16, or 32 bits for FAT32)
+    if (fat_sector->sector_count_16b && fat_sector->sector_count_32b){
+        fprintf(stderr, "\nWarning!  Conflicting sector counts (both 16 bit and 32 bit fields contained values).  This tool will continue using the 32 bit sector count, but the disk image or file system might be corrupted, proceed with caution.");
+    }
+}
+
+/**
+ * @brief Stops when the file system found is not the one given with -f
+ */
+static void fs_mismatch(const char *fs_type, struct fg_options *args){
+    fprintf(stderr, "Detected File System: %s\n", fs_type);
+    fprintf(stderr,
+        "Aborting... Detected file system type does not match your -f command line argument: %s\n",
+        args->file_system);
+    fatal();
+}
+
+/**
+ * @brief Checks supplied disk image to ensure 0x55AA signature found, and then attempts to
+ * determine if the disk is a full disk image (i.e. still has MBR), or is just an image of a 
+ * single file system/partition
+ * 
+ * @param fp 
+ * @param args 
+ * @return int : return 0 if disk image with MBR detected, return file system enum if detected
+ */
+static int verify_disk_image(int fp, struct fg_options *args){
+    uint8_t buf[3];
+    unsigned short mbr_sig = 0;
+    unsigned int fs_type_sig = 0;
+
+    // Begin checks for 0x55AA signature at offset 0x01FE
+    if (image_pread(fp, buf, 2, MBR_SIG_OFF) < 0)
+        read_error();
+
+    mbr_sig = (buf[0] << 8) | buf[1]; // OR both bytes into short
+    if (mbr_sig != MBR_SIG){
+        fprintf(stderr,
+            "Aborting... %s does not appear to be a valid partition or MBR disk image.\n",
+            args->image_path);
+        fatal();
+    }
+
+    // Read the File System Signature at Offset 0
+    if (image_pread(fp, buf, 3, 0) < 0)
+        read_error();
+
+    // File system signatures are 3 bytes
+    fs_type_sig = (buf[0] << 16) | (buf[1] << 8) | buf[2]; // Combine three bytes into int
+    
+    switch (fs_type_sig){
+        case NTFS_SIG:
+            if (args->fs_type != NTFS)
+                fs_mismatch("ntfs", args);
+            return NTFS;
+        case FAT32_SIG:
+            if (args->fs_type != FAT32)
+                fs_mismatch("fat32", args);
+            return FAT32;
+        case FAT16_SIG:
+            if (args->fs_type != FAT16 )
+                fs_mismatch("fat16", args);
+            return FAT16;
+        case FAT12_SIG:
+            if (args->fs_type != FAT12 )
+                fs_mismatch("fat12", args);
+            return FAT12;
+        default:
+            if (args->fs_type != RAW)
+                fs_mismatch("raw", args);
+            return RAW;
+            break;
+    }
+
+    return 0;
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/**
+ * @brief Writes out what the FAT dump has collected
+ */
+static void dump_flush(struct fat_dump *dump){
+    if (fg->out != NULL)
+        fwrite(dump->out, 1, dump->used, fg->out);
+    dump->used = 0;
+}
+
+static void dump_put(struct fat_dump *dump, const char *text, size_t length){
+    memcpy(dump->out + dump->used, text, length);
+    dump->used += length;
+}
+
+static void dump_spaces(struct fat_dump *dump, size_t count){
+    memset(dump->out + dump->used, ' ', count);
+    dump->used += count;
+}
+
+static void dump_hex(struct fat_dump *dump, uint32_t value, int digits){
+    dump->out[dump->used++] = '0';
+    dump->out[dump->used++] = 'x';
+    for (int d = digits - 1; d >= 0; d--)
+        dump->out[dump->used++] = hex_digits[(value >> (d * 4)) & 0xf];
+}
+
+static void dump_dash(struct fat_dump *dump){
+    dump_spaces(dump, 13);
+    memset(dump->out + dump->used, '-', dump->inner_width);
+    dump->used += dump->inner_width;
+    dump->out[dump->used++] = '\n';
+}
+
+/**
+ * @brief A line of the table with text centered between the bars, after the row address if there is one
+ */
+static void dump_centered(struct fat_dump *dump, const char *text, bool address, uint32_t row){
+    size_t length = strlen(text);
+    size_t left = (dump->inner_width - length) / 2;
+
+    if (address){
+        dump->out[dump->used++] = ' ';
+        dump_hex(dump, row, 8);
+        dump_put(dump, " |", 2);
+    }
+    else
+        dump_put(dump, "            |", 13);
+    dump_spaces(dump, left);
+    dump_put(dump, text, length);
+    dump_spaces(dump, dump->inner_width - length - left);
+    dump_put(dump, "|\n", 2);
+}
+
+/**
+ * @brief Makes sure the FAT bytes from offset on are in the chunk, reading the next chunk when streaming
+ */
+static void dump_load(struct fat_dump *dump, uint32_t offset){
+    if (dump->fat1 != NULL || offset < dump->chunk_start + dump->chunk_length)
+        return;
+    dump->chunk_start = offset;
+    dump->chunk_length = dump->fat_bytes - offset < FAT_DUMP_CHUNK_SIZE ? dump->fat_bytes - offset : FAT_DUMP_CHUNK_SIZE;
+    if (image_pread(fg->fp, dump->chunk, dump->chunk_length, dump->fat_offset + offset) < 0)
+        read_error();
+}
+
+/**
+ * @brief Returns FAT entry n, which must be in the chunk
+ */
+static uint32_t dump_entry(struct fat_dump *dump, uint32_t n){
+    const uint8_t *chunk = dump->fat1 != NULL ? dump->fat1 : dump->chunk;
+
+    if (dump->fat_sector->is_fat32)
+        return le32(chunk + (uint64_t)n * 4 - dump->chunk_start);
+    if (dump->fat_sector->is_fat16)
+        return le16(chunk + (uint64_t)n * 2 - dump->chunk_start);
+    chunk += (uint64_t)n * 3 / 2 - dump->chunk_start;
+    return n & 1 ? le16(chunk) >> 4 : le16(chunk) & 0xfff;
+}
+
+/**
+ * @brief Prints FAT1 as a table of hex entries, eight to a row, for FAT12, FAT16, and FAT32.  Runs of
+ * all zero rows are found with find_nonzero and collapsed into one line.  Rows are formatted by hand
+ * into a large buffer that is written out when full, so a full dump goes as fast as the output can
+ * take it.  In bounded memory mode FAT1 is streamed from the image a chunk at a time.
+ */
+static void print_full_fat_tables(uint8_t* fat1_ptr, uint8_t* fat2_ptr, struct fat_boot_sector *fat_sector){
+    uint32_t fat_bytes = fg->fat_size_in_bytes;
+    int width = fat_sector->is_fat32 ? 8 : fat_sector->is_fat16 ? 4 : 3;
+    uint32_t fat_entries = fat_sector->is_fat32 ? fat_bytes / 4 : fat_sector->is_fat16 ? fat_bytes / 2 : fat_bytes * 2 / 3;
+    uint32_t row_bytes = FAT_DUMP_ROW_ENTRIES * width / 2;
+    struct fat_dump dump = {
+        .fat_sector = fat_sector,
+        .width = width,
+        .inner_width = FAT_DUMP_ROW_ENTRIES * (width + 5) - 1,
+        .fat1 = fat1_ptr,
+        .chunk_length = fat1_ptr != NULL ? fat_bytes : 0,
+        .fat_bytes = fat_bytes,
+        .fat_offset = (uint64_t)fat_sector->reserved_area_size * fg->bps
+    };
+    char banner[32];
+    bool zero_block = false;
+    uint32_t i = 0;
+
+    if (fat_entries == 0)
+        return;
+    dump.out = malloc(FAT_DUMP_BUFFER_SIZE);
+    if (fat1_ptr == NULL)
+        dump.chunk = malloc(FAT_DUMP_CHUNK_SIZE);
+    if (dump.out == NULL || (fat1_ptr == NULL && dump.chunk == NULL)){
+        free(dump.out);
+        free(dump.chunk);
+        fprintf(stderr, "Aborting... Out of memory while printing the FAT.\n");
+        fatal();
+    }
+
+    snprintf(banner, sizeof(banner), "FAT 1 (FAT%d)", width * 4);
+    dump_dash(&dump);
+    dump_centered(&dump, banner, false, 0);
+    while (i < fat_entries){
+        uint32_t offset = (uint64_t)i * width / 2;
+        uint32_t count = fat_entries - i < FAT_DUMP_ROW_ENTRIES ? fat_entries - i : FAT_DUMP_ROW_ENTRIES;
+        dump_load(&dump, offset);
+
+        // Skip every whole row of zeros from here to the first non-zero byte
+        if (count == FAT_DUMP_ROW_ENTRIES){
+            const uint8_t *chunk = fat1_ptr != NULL ? fat1_ptr : dump.chunk;
+            uint32_t available = dump.chunk_start + dump.chunk_length - offset;
+            uint32_t zero_rows = find_nonzero(chunk + offset - dump.chunk_start, available) / row_bytes;
+            uint32_t whole_rows = (fat_entries - i) / FAT_DUMP_ROW_ENTRIES;
+            if (zero_rows > whole_rows)
+                zero_rows = whole_rows;
+            if (zero_rows){
+                zero_block = true;
+                i += zero_rows * FAT_DUMP_ROW_ENTRIES;
+                continue;
+            }
+        }
+
+        if (dump.used > FAT_DUMP_BUFFER_SIZE - 1024)
+            dump_flush(&dump);
+        dump_dash(&dump);
+        if (zero_block){
+            dump_centered(&dump, "Contiguous Block of Empty/Unallocated FAT Entries", false, 0);
+            dump_dash(&dump);
+            zero_block = false;
+        }
+        dump.out[dump.used++] = ' ';
+        dump_hex(&dump, i, 8);
+        dump_put(&dump, " |", 2);
+        for (uint32_t j = 0; j < count; j++){
+            dump.out[dump.used++] = ' ';
+            dump_hex(&dump, dump_entry(&dump, i + j), width);
+            dump_put(&dump, " |", 2);
+        }
+        dump.out[dump.used++] = '\n';
+        i += count;
+    }
+    dump_dash(&dump);
+    if (zero_block){
+        dump_centered(&dump, "Contiguous Block of Empty/Unallocated FAT Entries", false, 0);
+        dump_dash(&dump);
+    }
+    dump_centered(&dump, "End of FAT", true, i); // print last address of FAT
+    dump_dash(&dump);
+    dump_flush(&dump);
+
+    free(dump.chunk);
+    free(dump.out);
+}
+
+/**
+ * @brief Prints out information parsed from Fat Boot Sector
+ * 
+ * @param fat_sector 
+ */
+static void print_fat_boot_sector_info(struct fat_boot_sector *fat_sector){
+    report("\nFAT File System Information\n\n");
+    
+    if (fat_sector->is_fat32)
+        report("File System Type: FAT32\n");
+    if (fat_sector->is_fat16)
+        report("File System Type: FAT16\n");
+    if (fat_sector->is_fat12)
+        report("File System Type: FAT12\n");
+
+    switch (fat_sector->media_type){
+        case FIXED:
+            report("Media Type: Fixed\n");
+            break;
+        case REMOVABLE:
+            report("Media Type: Removable\n");
+            break;
+        default:
+            report("Media Type: Unknown\n");
+            break;
+    }
+    
+    report("OEM Name: %s\n", fat_sector->oem_name);
+    if(fat_sector->is_fat32){
+        report("Volume Serial: 0x%zx\n", (size_t)fat_sector->fat32_volume_serial);
+        report("Volume Label: %s\n", fat_sector->fat32_volume_label);
+        report("File System Label: %s\n", fat_sector->fat32_fs_type_label);
+    }
+    else{
+        report("Volume Serial: 0x%zx\n", (size_t)fat_sector->volume_serial);
+        report("Volume Label: %s\n", fat_sector->volume_label);
+        report("File System Label: %s\n", fat_sector->fs_type_label);
+    }
+    report("Bytes per sector: %d\n", fg->bps);
+    report("Sectors per cluster: %d\n", fat_sector->sectors_per_cluster);
+    report("Size of Reserved Area (in sectors): %d\n", fat_sector->reserved_area_size);
+    report("Number of FATs: %d\n", fat_sector->number_of_fats);
+    
+    if (fat_sector->sector_count_32b)
+        report("Number of sectors: %d\n", fat_sector->sector_count_32b);
+    else
+        report("Number of sectors: %d\n", fat_sector->sector_count_16b);
+
+    report("Sectors before start of partition: %d\n", fat_sector->sectors_before_partition);
+    
+    if(fat_sector->is_fat32){
+        report("FAT size in sectors: %d\n", fat_sector->fat32_size_in_sectors);
+        report("Root Dir Cluster: %d\n", fat_sector->root_dir_cluster);
+    }
+    else{
+        report("FAT size in sectors: %d\n", fat_sector->fat_size_in_sectors);
+        report("Maximum number of files in Root Dir: %d\n", fat_sector->max_files_in_root);
+    }
+}
+
+/**
+ * @brief Prints out information parsed from MBR
+ * 
+ * @param mbr 
+ */
+static void print_mbr_info(struct mbr_sector *mbr){
+    // print out the headers first
+    report("%-8s %-4s %12s %12s %12s   %4s   %-25s\n", header[0], header[1], header[2], header[3], header[4], header[5], header[6]);
+
+    for (int i = 0; i < 4; i++){
+        char bootable;
+
+        if (mbr->entry[i].boot_indicator == 0)
+            bootable = 'N';
+        else
+            bootable = 'Y';
+
+        report("%-8d %-4c %12ju %12ju %12ju   %#04x   %-25s\n", 
+        i, bootable, (uintmax_t)mbr->entry[i].starting_sector, 
+        (uintmax_t)(mbr->entry[i].starting_sector + mbr->entry[i].partition_size), 
+        (uintmax_t)mbr->entry[i].partition_size, mbr->entry[i].partition_type, 
+        partition_type_txt[mbr->entry[i].partition_type]);
+    }
+}
+
+/**
+ * @brief Copies the FATs from the disk image into memory, and then compares them to see
+ * if there are any differences between FAT1 and FAT2
+ * 
+ * @param fp file pointer to disk image
+ * @param fs_type type of file system (enum)
+ * @param fat_boot_sector 
+ * @param fat1 
+ * @param fat2 
+ */
+static void copy_fats_into_memory(int fp, int fs_type, struct fat_boot_sector* fat_sector, uint8_t **fat1_ptr, uint8_t **fat2_ptr){
+    uint64_t diff = 0;
+    uint32_t reserved_area_size_in_bytes = 0;
+    uint32_t chunk_size = 0;
+    uint8_t *buf1 = NULL;
+    uint8_t *buf2 = NULL;
+    fg->fat_size_in_bytes = 0;
+
+    reserved_area_size_in_bytes = fat_sector->reserved_area_size * fg->bps;
+
+    if (fs_type == FAT32)
+        fg->fat_size_in_bytes = fat_sector->fat32_size_in_sectors * fg->bps;
+    else
+        fg->fat_size_in_bytes = fat_sector->fat_size_in_sectors * fg->bps;
+
+    // In bounded memory mode the FATs are compared a page at a time and FAT1 is paged in on demand
+    // afterwards, otherwise both copies are kept in memory
+    if (fg->args.max_memory && !fat_sector->is_fat12){
+        chunk_size = FAT_PAGE_SIZE;
+        buf1 = malloc(chunk_size);
+        buf2 = malloc(chunk_size);
+    }
+    else{
+        chunk_size = fg->fat_size_in_bytes;
+        buf1 = calloc(1, fg->fat_size_in_bytes);
+        buf2 = calloc(1, fg->fat_size_in_bytes);
+        *fat1_ptr = buf1;
+        *fat2_ptr = buf2;
+    }
+    if (buf1 == NULL || buf2 == NULL){
+        fprintf(stderr, "Aborting... Out of memory while reading the FATs.\n");
+        fatal();
+    }
+
+    for (uint32_t done = 0; done < fg->fat_size_in_bytes; done += chunk_size){
+        uint32_t length = fg->fat_size_in_bytes - done < chunk_size ? fg->fat_size_in_bytes - done : chunk_size;
+        if (image_pread(fp, buf1, length, reserved_area_size_in_bytes + done) < 0)
+            read_error();
+        if (image_pread(fp, buf2, length, reserved_area_size_in_bytes + fg->fat_size_in_bytes + done) < 0)
+            read_error();
+
+        for (uint32_t i = 0; i < length; i++){
+            if (buf1[i] ^ buf2[i]){
+                diff++;
+                if (diff <= 10){
+                    report("Detected discrepency between FAT1 and FAT2 at the following offsets.  FAT1: %#2x, FAT2: %#02x\n", 
+                    reserved_area_size_in_bytes + done + i, reserved_area_size_in_bytes + fg->fat_size_in_bytes + done + i);
+                }
+                if (diff == 11)
+                    report("More than 10 discrepencies between FAT1 and FAT2 detected.  To reduce output clutter, individual discrepencies will no longer be printed.\n");
+            }
+        }
+    }
+    if (diff > 0)
+        report("Total # of discrepencies identified between FAT1 and FAT2: %ju\n", diff);
+    if (fg->args.max_memory && !fat_sector->is_fat12){
+        free(buf1);
+        free(buf2);
+    }
+}
+
+/**
+ * @brief Sets up the page cache used to read FAT1 on demand in bounded memory mode
+ *
+ * @param memory bytes of FAT pages to keep in memory
+ */
+static void init_fat_page_cache(struct fat_page_cache *fc, uint64_t memory){
+    fc->slots = memory / FAT_PAGE_SIZE < 4 ? 4 : memory / FAT_PAGE_SIZE;
+    fc->page = malloc(fc->slots * sizeof(uint64_t));
+    fc->data = malloc((size_t)fc->slots * FAT_PAGE_SIZE);
+    if (fc->page == NULL || fc->data == NULL){
+        fprintf(stderr, "Aborting... Out of memory while setting up the FAT page cache.\n");
+        fatal();
+    }
+    for (uint32_t i = 0; i < fc->slots; i++)
+        fc->page[i] = UINT64_MAX;
+    pthread_mutex_init(&fc->lock, NULL);
+}
+
+static void free_fat_page_cache(struct fat_page_cache *fc){
+    if (fc->slots == 0)
+        return;
+    free(fc->page);
+    free(fc->data);
+    pthread_mutex_destroy(&fc->lock);
+    fc->slots = 0;
+}
+
+/**
+ * @brief Reads a FAT1 entry through the page cache.  Pages are direct mapped to slots, FAT chains
+ * are mostly walked in order so neighbouring pages rarely evict each other.
+ *
+ * @param width size of a FAT entry in bytes (2 or 4)
+ */
+static uint32_t read_fat_paged(struct fat_page_cache *fc, uint32_t cluster, uint32_t width){
+    uint64_t offset = (uint64_t)cluster * width;
+    uint64_t page = offset / FAT_PAGE_SIZE;
+    uint32_t slot = page % fc->slots;
+    uint8_t *data = fc->data + (size_t)slot * FAT_PAGE_SIZE;
+    uint32_t value = 0;
+
+    if (offset + width > fg->fat_size_in_bytes)
+        return 0;
+    pthread_mutex_lock(&fc->lock);
+    if (fc->page[slot] != page){
+        uint64_t length = fg->fat_size_in_bytes - page * FAT_PAGE_SIZE;
+        if (length > FAT_PAGE_SIZE)
+            length = FAT_PAGE_SIZE;
+        if (image_pread(fg->image.fp, data, length, (uint64_t)fg->fat_bs->reserved_area_size * fg->bps + page * FAT_PAGE_SIZE) < 0){
+            fc->page[slot] = UINT64_MAX;
+            pthread_mutex_unlock(&fc->lock);
+            read_error();
+        }
+        fc->page[slot] = page;
+    }
+    value = width == 4 ? le32(data + offset % FAT_PAGE_SIZE) : le16(data + offset % FAT_PAGE_SIZE);
+    pthread_mutex_unlock(&fc->lock);
+    return value;
+}
+
+/**
+ * @brief Returns the value stored within a given FAT table entry
+ * 
+ * @param cluster entry to be read 
+ * @return uint32_t 
+ */
+
+static uint32_t read_alloctable(uint32_t cluster){
+    /*
+    if (cluster > (fat_size_in_bytes/4)){
+        fprintf(stderr, "Fatal Error.  Attempting to read a FAT entry that doesn't exist.  Program terminated.\n");
+        fatal();
+    }
+    */
+    if (fg->fat1 == NULL)
+        return read_fat_paged(&fg->fat_cache, cluster, fg->fat_bs->is_fat32 ? 4 : 2);
+    if (fg->fat_bs->is_fat32){
+        uint32_t *fat32 = (uint32_t *) fg->fat1;
+        return fat32[cluster];
+    }
+    if (fg->fat_bs->is_fat16){
+        uint16_t *fat16 = (uint16_t *) fg->fat1;
+        return fat16[cluster];
+    }
+    if (fg->fat_bs->is_fat12){
+        // FAT12 entries are 1.5 bytes, odd clusters use the high 12 bits of the pair
+        uint32_t offset = cluster + cluster / 2;
+        if (offset + 1 >= fg->fat_size_in_bytes)
+            return 0;
+        uint16_t pair = fg->fat1[offset] | (fg->fat1[offset + 1] << 8);
+        return cluster & 1 ? pair >> 4 : pair & 0xfff;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the number of clusters a file or directory takes up on the disk.  It does this by
+ * traversing the FAT until it hits an EOF marker.
+ * 
+ * @param cluster 
+ * @return uint32_t 
+ */
+static uint32_t get_entry_size(uint32_t cluster){
+    uint32_t next_cluster = cluster;
+    uint32_t size = 0;
+
+    if(fg->fat_bs->is_fat32){
+        // The size check stops the walk if a damaged or tampered FAT contains a loop
+        do{
+            next_cluster = read_alloctable(next_cluster);
+            size++;
+        } while (next_cluster < (uint32_t)FAT32_EOF && size <= fg->fat_size_in_bytes / 4);
+    }
+    return size;
+}
+
+/**
+ * @brief Stores a list of the clusters a file or directory occupies up on the disk into a read_parameter
+ * structure.  It does this by traversing the FAT until it hits an EOF marker.
+ * 
+ * @param cluster The starting cluster
+ * @param cluster_list A poiner to a block/array to store the list of clusters
+ * @param max_length Since we pre-allocated memory for the list, this is a safety check to avoid overrunning the buffer
+ * @return uint32_t 
+ */
+static void get_cluster_list(struct read_parameters *read){
+    uint32_t next_cluster = read->start_cluster;
+    uint32_t size = 0;
+    do{
+        read->cluster_list[size] = next_cluster;
+        next_cluster = read_alloctable(next_cluster);
+        size++;
+    } while (next_cluster < FAT32_EOF && size < read->list_length);
+}
+
+/**
+ * @brief Returns the last cluster used by a file by following its chain in the FAT
+ * 
+ * @param first_cluster The starting cluster
+ * @return uint32_t 
+ */
+static uint32_t get_last_cluster(uint32_t first_cluster){
+    uint32_t cluster = first_cluster;
+    uint32_t next_cluster = read_alloctable(cluster);
+
+    for (uint32_t steps = 0; next_cluster >= 2 && next_cluster < FAT32_EOF && steps < fg->fat_size_in_bytes / 4; steps++){
+        cluster = next_cluster;
+        next_cluster = read_alloctable(cluster);
+    }
+    return cluster;
+}
+/**
+ * @brief Wrapper function for pread when working in clustered area of the disk.  Has additional logic to 
+ * handle moving read position to the next cluster when files/directories span multiple clusters.
+ * 
+ * @param fp 
+ * @param buffer 
+ * @param length 
+ * @param offset 
+ * @param read 
+ */
+static void read_disk(int fp, void* buffer, int length, uint32_t field_offset, struct read_parameters* read){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t position = field_offset + read->entry_offset; // offset from the start of the first cluster
+    uint32_t cluster_list_index = position / cluster_size;
+    uint32_t cluster_offset = position % cluster_size;
+    uint32_t done = 0;
+
+    // Reads that run past the end of a cluster continue at the start of the next cluster in the chain
+    while (done < length && cluster_list_index < read->list_length){
+        uint32_t iteration_read_len = cluster_size - cluster_offset;
+        if (iteration_read_len > length - done)
+            iteration_read_len = length - done;
+        if (read_cluster_cached(fp, &fg->cache, read->cluster_list[cluster_list_index], (uint8_t *)buffer + done, cluster_offset, iteration_read_len))
+            read_error();
+        done += iteration_read_len;
+        cluster_offset = 0;
+        cluster_list_index++;
+    }
+}
+
+/**
+ * @brief Returns the checksum of an 8.3 name, which every long name entry of the file carries
+ */
+static uint8_t lfn_checksum(const uint8_t *short_name){
+    uint8_t sum = 0;
+
+    for (int i = 0; i < 11; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + short_name[i];
+    return sum;
+}
+
+/**
+ * @brief Writes one Unicode character as UTF-8
+ *
+ * @return size_t : bytes written, 0 if they do not fit in space
+ */
+static size_t put_utf8(uint32_t c, char *out, size_t space){
+    if (c < 0x80 && space >= 1){
+        out[0] = c;
+        return 1;
+    }
+    if (c < 0x800 && space >= 2){
+        out[0] = 0xc0 | c >> 6;
+        out[1] = 0x80 | (c & 0x3f);
+        return 2;
+    }
+    if (c < 0x10000 && space >= 3){
+        out[0] = 0xe0 | c >> 12;
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+    if (c >= 0x10000 && space >= 4){
+        out[0] = 0xf0 | c >> 18;
+        out[1] = 0x80 | ((c >> 12) & 0x3f);
+        out[2] = 0x80 | ((c >> 6) & 0x3f);
+        out[3] = 0x80 | (c & 0x3f);
+        return 4;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the first byte of the 8.3 name made from a long name.  Leading spaces and dots
+ * are dropped, letters are upper cased and characters not allowed in 8.3 names become _.
+ *
+ * @param units the long name as UTF-16
+ * @return int : the byte, or -1 if it depends on the code page
+ */
+static int short_name_first_byte(const uint16_t *units, uint32_t count){
+    uint32_t i = 0;
+
+    while (i < count && (units[i] == ' ' || units[i] == '.'))
+        i++;
+    if (i == count || units[i] >= 0x80)
+        return -1;
+    if (strchr("+,;=[]", units[i]) != NULL)
+        return '_';
+    return toupper(units[i]);
+}
+
+/**
+ * @brief Decodes the long name entries in front of an 8.3 entry to UTF-8.  They only belong to it
+ * if they are a complete run and carry the checksum of its 8.3 name, otherwise they were left by
+ * a file that was deleted or renamed.  A deleted file's entries have lost their sequence numbers
+ * and the first character of the 8.3 name.  That character is made again from the long name, as
+ * the checksum alone would match one of the 256 values whatever the entries are.  Names starting
+ * with a character outside ASCII depend on the code page and are not decoded.
+ *
+ * @param lfn the long name entries as they are in the directory, the end of the name first
+ * @param out LFN_NAME_SIZE bytes
+ * @return bool : false if the entries are not a valid long name for the 8.3 entry
+ */
+static bool decode_long_name(uint8_t (*lfn)[32], uint32_t count, const uint8_t *sfn, char *out){
+    uint16_t units[LFN_MAX_ENTRIES * LFN_CHARS_PER_ENTRY];
+    uint32_t unit_count = 0;
+    size_t length = 0;
+    bool deleted = sfn[0] == UNALLOCATED;
+    uint8_t checksum;
+
+    if (count == 0 || count > LFN_MAX_ENTRIES)
+        return false;
+    checksum = lfn[0][LFN_CHECKSUM];
+    for (uint32_t i = 0; i < count; i++){
+        if (lfn[i][LFN_CHECKSUM] != checksum)
+            return false;
+        if (deleted ? lfn[i][LFN_SEQUENCE] != UNALLOCATED : (lfn[i][LFN_SEQUENCE] & LFN_SEQUENCE_MASK) != count - i)
+            return false;
+    }
+    if (!deleted && (!(lfn[0][LFN_SEQUENCE] & LFN_LAST_ENTRY) || lfn_checksum(sfn) != checksum))
+        return false;
+
+    // Gather the UTF-16 characters in name order, up to the terminating NUL
+    for (uint32_t i = count; i-- > 0 && (unit_count == 0 || units[unit_count - 1]);){
+        for (uint32_t j = 0; j < LFN_CHARS_PER_ENTRY; j++){
+            uint32_t offset = j < 5 ? LFN_CHARS_1 + j * 2 : j < 11 ? LFN_CHARS_2 + (j - 5) * 2 : LFN_CHARS_3 + (j - 11) * 2;
+            units[unit_count++] = le16(lfn[i] + offset);
+            if (units[unit_count - 1] == 0)
+                break;
+        }
+    }
+    if (unit_count && units[unit_count - 1] == 0)
+        unit_count--;
+    if (unit_count == 0)
+        return false;
+    if (deleted){
+        uint8_t name[11];
+        int first = short_name_first_byte(units, unit_count);
+        memcpy(name, sfn, 11);
+        name[0] = first;
+        if (first < 0 || lfn_checksum(name) != checksum)
+            return false;
+    }
+
+    for (uint32_t i = 0; i < unit_count; i++){
+        uint32_t c = units[i];
+        size_t n;
+        // Characters past the basic plane are split in two, unpaired halves become U+FFFD
+        if (c >= 0xd800 && c < 0xdc00 && i + 1 < unit_count && units[i + 1] >= 0xdc00 && units[i + 1] < 0xe000)
+            c = 0x10000 + ((c - 0xd800) << 10) + (units[++i] - 0xdc00);
+        else if (c >= 0xd800 && c < 0xe000)
+            c = 0xfffd;
+        // A name with a slash or a control character would not make a usable path
+        if (c < 0x20 || c == '/')
+            return false;
+        n = put_utf8(c, out + length, LFN_NAME_SIZE - 1 - length);
+        if (n == 0)
+            return false;
+        length += n;
+    }
+    out[length] = 0;
+    return true;
+}
+
+/**
+ * @brief Writes an 8.3 name as NAME.EXT.  Names Windows NT marked as lower case are shown in lower
+ * case, and the lost first character of a deleted file's name is shown as ?.
+ */
+static void format_short_name(const uint8_t *sfn, char *out){
+    uint8_t flags = sfn[NAME_CASE_FLAGS];
+    size_t length = 0;
+
+    for (int i = 0; i < 8 && sfn[i] != ' '; i++)
+        out[length++] = flags & FLAG_LOWER_CASE_BASE ? tolower(sfn[i]) : sfn[i];
+    if (sfn[0] == UNALLOCATED)
+        out[0] = '?';
+    else if (sfn[0] == 0x05) // a first character of 0xE5 is stored as 0x05
+        out[0] = (char)0xe5;
+    if (sfn[8] != ' '){
+        out[length++] = '.';
+        for (int i = 8; i < 11 && sfn[i] != ' '; i++)
+            out[length++] = flags & FLAG_LOWER_CASE_EXTENSION ? tolower(sfn[i]) : sfn[i];
+    }
+    out[length] = 0;
+}
+
+/**
+ * @brief Stores the name of an entry in the tree arena, once, for every message and path that
+ * names it
+ */
+static void set_entry_name(struct fat_dir_entry *entry, const char *name){
+    size_t length = strlen(name) + 1;
+    char *copy = arena_alloc(&fg->tree_arena, length);
+
+    memcpy(copy, name, length);
+    entry->name = copy;
+}
+
+/**
+ * @brief Loads a fat_dir_entry struct with directory entry info.  The long name entries in front
+ * of the 8.3 entry are read on the way and decoded if they belong to it.
+ * 
+ * @param fp file pointer to disk image
+ * @param entry pointer to entry struct to store read information
+ * @param name LFN_NAME_SIZE bytes, set to the long name, or the 8.3 name if it has none
+ * @return uint32_t Return the offset to the next file record entry
+ */
+static uint32_t read_fat_dir_entry(int fp, struct fat_dir_entry *entry, struct read_parameters* read, char *name){
+    uint8_t lfn[LFN_MAX_ENTRIES][32];
+    uint8_t raw[32];
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    uint32_t dir_size = read->list_length * fg->bps * fg->spc;
+
+    for (;;){
+        // A run of long name entries that reaches the end of the directory is treated as its end
+        if (read->entry_offset + offset >= dir_size){
+            memset(raw, 0, sizeof(raw));
+            offset = dir_size - read->entry_offset;
+            break;
+        }
+        read_disk(fp, raw, 32, offset, read);
+        if (raw[FILE_ATTRIBUTES] != FLAG_FAT_LONG_FILE_NAME)
+            break;
+        if (count < LFN_MAX_ENTRIES)
+            memcpy(lfn[count], raw, 32);
+        count++;
+        offset += 32;
+    }
+
+    memcpy(entry->info.filename, raw + FILE_NAME, 11);
+    entry->file_attributes = raw[FILE_ATTRIBUTES];
+    entry->created_time_tenths = raw[CREATED_TIME_TENTHS];
+    entry->created_time_hms = le16(raw + CREATED_TIME_HMS);
+    entry->created_day = le16(raw + CREATED_DAY);
+    entry->accessed_day = le16(raw + ACCESSED_DAY);
+    entry->low_cluster_addr = le16(raw + LOW_CLUSTER_ADDR);
+    entry->high_cluster_addr = le16(raw + HIGH_CLUSTER_ADDR);
+    entry->cluster_addr = entry->low_cluster_addr | (entry->high_cluster_addr << 16);
+    entry->written_time_hms = le16(raw + WRITTEN_TIME_HMS);
+    entry->written_day = le16(raw + WRITTEN_DAY);
+    entry->file_size = le32(raw + FILE_SIZE);
+    if (raw[0] != 0 && !decode_long_name(lfn, count, raw, name))
+        format_short_name(raw, name);
+
+    return offset + 32;
+}
+
+/**
+ * @brief Returns the name of a directory entry for use in messages
+ */
+static const char* entry_name(struct fat_dir_entry *entry){
+    if (entry->parent_dir == NULL && entry->info.filename[0] == 0)
+        return "<root directory>";
+    return entry->name != NULL ? entry->name : entry->info.filename;
+}
+
+/**
+ * @brief Returns the number of slack bytes after the end of a file in its last cluster
+ */
+static uint32_t slack_length(struct fat_dir_entry *entry){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t used = entry->file_size % cluster_size;
+
+    // A file that exactly fills its last cluster has no slack, an empty one with a cluster is all slack
+    if (used == 0)
+        return entry->file_size ? 0 : cluster_size;
+    return cluster_size - used;
+}
+
+/**
+ * @brief Checks for data hidden at the end of a partially filled FAT32 cluster.  The slack is split
+ * in two: the RAM slack, from the end of the file to the end of its last sector, and the drive
+ * slack, the whole sectors after that.  RAM slack is filled by whatever was in memory when the
+ * sector was written, while drive slack keeps what was on the disk before, so data in each calls
+ * for different follow up.
+ * 
+ * @param fp 
+ * @param entry 
+ * @return bool : true if either part of the slack held data
+ */
+static bool check_for_hidden_data(int fp, struct fat_dir_entry *entry){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t length = slack_length(entry);
+    uint32_t slack_start = cluster_size - length;
+    uint32_t drive_start = (slack_start + fg->bps - 1) / fg->bps * fg->bps; // first sector after the end of the file
+    uint64_t cluster_offset = cts(entry->last_cluster);
+    struct region_scan ram = {.type = REGION_RAM_SLACK, .offset = cluster_offset + slack_start, .length = drive_start - slack_start, .label = entry_name(entry)};
+    struct region_scan drive = {.type = REGION_DRIVE_SLACK, .offset = cluster_offset + drive_start, .length = cluster_size - drive_start, .label = entry_name(entry)};
+    uint32_t sectors_with_data = 0;
+    uint8_t buf[32768]; // clusters are at most 32KB
+
+    if (length == 0)
+        return false;
+
+    // Read the whole slack region of the last cluster in one go, then split it
+    if (read_cluster_cached(fp, &fg->cache, entry->last_cluster, buf, slack_start, length))
+        read_error();
+    progress_add(&fg->progress.clusters, 1);
+    if (ram.length)
+        scan_buffer(&ram, buf, ram.length, ram.offset);
+
+    // Drive slack is checked a sector at a time so all zero sectors are skipped with one vector test
+    for (uint32_t sector = drive_start; sector < cluster_size; sector += fg->bps){
+        uint8_t *data = buf + (sector - slack_start);
+        if (find_nonzero(data, fg->bps) == fg->bps){
+            drive.scanned += fg->bps;
+            drive.match_state = 0; // patterns are not matched across the skipped sector
+            progress_add(&fg->progress.bytes, fg->bps);
+            continue;
+        }
+        scan_buffer(&drive, data, fg->bps, cluster_offset + sector);
+        sectors_with_data++;
+    }
+
+    if (ram.nonzero){
+        fg->hidden_data_found = true; // mark the global var as true
+        report("Possible hidden data found in the RAM slack of %s (%ju bytes after the end of the file) in sector 0x%jx / cluster: 0x%x\n",
+            entry_name(entry), (uintmax_t)ram.length, (uintmax_t)cluster_offset, entry->last_cluster);
+        print_byte_profile(&record_finding(&ram, entry_name(entry))->profile);
+    }
+    if (drive.nonzero){
+        fg->hidden_data_found = true;
+        report("Possible hidden data found in the drive slack of %s (%u of %ju sectors hold data) in sector 0x%jx / cluster: 0x%x\n",
+            entry_name(entry), sectors_with_data, (uintmax_t)drive.length / fg->bps, (uintmax_t)cluster_offset, entry->last_cluster);
+        print_byte_profile(&record_finding(&drive, entry_name(entry))->profile);
+    }
+    return ram.nonzero || drive.nonzero;
+}
+
+/**
+ * @brief Checks the unused space of a directory, from the end of directory marker to the end of its
+ * last cluster.  Nothing should ever be written there, so any non-zero byte is suspicious.  The
+ * directory clusters were just read by the walk, so this is served from the cluster cache.
+ *
+ * @param end_offset offset of the end of directory marker from the start of the directory
+ */
+static void check_directory_slack(int fp, struct fat_dir_entry *dir, struct read_parameters *read, uint32_t end_offset){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t dir_size = read->list_length * cluster_size;
+    uint32_t saved_entry_offset = read->entry_offset;
+    struct region_scan scan = {.type = REGION_DIRECTORY_SLACK, .length = dir_size - end_offset, .label = entry_name(dir)};
+    uint8_t buf[32768]; // clusters are at most 32KB
+
+    read->entry_offset = 0;
+    for (uint32_t pos = end_offset; pos < dir_size;){
+        uint32_t length = cluster_size - (pos % cluster_size);
+        read_disk(fp, buf, length, pos, read);
+        scan_buffer(&scan, buf, length, cts(read->cluster_list[pos / cluster_size]) + (pos % cluster_size));
+        pos += length;
+    }
+    read->entry_offset = saved_entry_offset;
+
+    if (scan.nonzero){
+        fg->hidden_data_found = true; // mark the global var as true
+        report("Possible hidden data found after the end of directory marker of %s: %ju non-zero bytes, first at offset 0x%jx\n",
+            entry_name(dir), (uintmax_t)scan.nonzero, (uintmax_t)scan.first_nonzero);
+        print_byte_profile(&record_finding(&scan, entry_name(dir))->profile);
+    }
+}
+
+/**
+ * @brief Reports the metadata left behind by a deleted (0xE5) directory entry.  FAT only clears the
+ * first byte of the name and the cluster chain, so the start cluster and size survive, and if the
+ * start cluster is still free the contents are likely recoverable.
+ */
+static void check_deleted_entry(struct fat_dir_entry *dir, struct fat_dir_entry *entry){
+    const char *status = "no clusters";
+
+    if (entry->cluster_addr >= 2 && entry->cluster_addr < fg->fat_size_in_bytes / 4)
+        status = read_alloctable(entry->cluster_addr) == 0 ? "start cluster free, contents likely recoverable" : "start cluster reallocated";
+    report("Deleted %s found in %s: %s  (first cluster: 0x%x, size: %u bytes, %s)\n",
+        (entry->file_attributes & FLAG_FAT_DIRECTORY) ? "directory" : "file", entry_name(dir), entry_name(entry), entry->cluster_addr, entry->file_size, status);
+}
+
+/**
+ * @brief Rotates a 32 bit word right
+ */
+static uint32_t rotr32(uint32_t w, uint32_t c){
+    return (w >> c) | (w << (32 - c));
+}
+
+/**
+ * @brief The BLAKE3 mixing function, applied to one column or diagonal of the state
+ */
+static void blake3_g(uint32_t *state, int a, int b, int c, int d, uint32_t mx, uint32_t my){
+    state[a] = state[a] + state[b] + mx;
+    state[d] = rotr32(state[d] ^ state[a], 16);
+    state[c] = state[c] + state[d];
+    state[b] = rotr32(state[b] ^ state[c], 12);
+    state[a] = state[a] + state[b] + my;
+    state[d] = rotr32(state[d] ^ state[a], 8);
+    state[c] = state[c] + state[d];
+    state[b] = rotr32(state[b] ^ state[c], 7);
+}
+
+/**
+ * @brief The BLAKE3 compression function.  Writes the full 16 word output, the first 8 words are
+ * the new chaining value.
+ */
+static void blake3_compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN], uint64_t counter, uint32_t block_len, uint32_t flags, uint32_t out[16]){
+    uint32_t state[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        blake3_iv[0], blake3_iv[1], blake3_iv[2], blake3_iv[3],
+        (uint32_t)counter, (uint32_t)(counter >> 32), block_len, flags
+    };
+    uint32_t m[16];
+    uint32_t permuted[16];
+
+    for (int i = 0; i < 16; i++)
+        m[i] = le32(block + i * 4);
+    for (int round = 0; round < 7; round++){
+        blake3_g(state, 0, 4, 8, 12, m[0], m[1]);
+        blake3_g(state, 1, 5, 9, 13, m[2], m[3]);
+        blake3_g(state, 2, 6, 10, 14, m[4], m[5]);
+        blake3_g(state, 3, 7, 11, 15, m[6], m[7]);
+        blake3_g(state, 0, 5, 10, 15, m[8], m[9]);
+        blake3_g(state, 1, 6, 11, 12, m[10], m[11]);
+        blake3_g(state, 2, 7, 8, 13, m[12], m[13]);
+        blake3_g(state, 3, 4, 9, 14, m[14], m[15]);
+        for (int i = 0; i < 16; i++)
+            permuted[i] = m[blake3_msg_permutation[i]];
+        memcpy(m, permuted, sizeof(m));
+    }
+    for (int i = 0; i < 8; i++){
+        out[i] = state[i] ^ state[i + 8];
+        out[i + 8] = state[i + 8] ^ cv[i];
+    }
+}
+
+static void blake3_chunk_init(struct blake3_chunk_state *chunk, uint64_t chunk_counter){
+    memset(chunk, 0, sizeof(struct blake3_chunk_state));
+    memcpy(chunk->cv, blake3_iv, sizeof(chunk->cv));
+    chunk->chunk_counter = chunk_counter;
+}
+
+static uint32_t blake3_chunk_len(struct blake3_chunk_state *chunk){
+    return BLAKE3_BLOCK_LEN * chunk->blocks_compressed + chunk->block_len;
+}
+
+static uint32_t blake3_chunk_start_flag(struct blake3_chunk_state *chunk){
+    return chunk->blocks_compressed == 0 ? BLAKE3_CHUNK_START : 0;
+}
+
+/**
+ * @brief Adds input to the current chunk.  The last block is always held back because it has to
+ * be compressed with the CHUNK_END flag, and possibly ROOT.
+ */
+static void blake3_chunk_update(struct blake3_chunk_state *chunk, const uint8_t *input, size_t length){
+    uint32_t out[16];
+
+    while (length){
+        if (chunk->block_len == BLAKE3_BLOCK_LEN){
+            blake3_compress(chunk->cv, chunk->block, chunk->chunk_counter, BLAKE3_BLOCK_LEN, blake3_chunk_start_flag(chunk), out);
+            memcpy(chunk->cv, out, sizeof(chunk->cv));
+            chunk->blocks_compressed++;
+            chunk->block_len = 0;
+            memset(chunk->block, 0, BLAKE3_BLOCK_LEN);
+        }
+        size_t take = BLAKE3_BLOCK_LEN - chunk->block_len;
+        if (take > length)
+            take = length;
+        memcpy(chunk->block + chunk->block_len, input, take);
+        chunk->block_len += take;
+        input += take;
+        length -= take;
+    }
+}
+
+/**
+ * @brief Returns the chaining value of a parent node
+ */
+static void blake3_parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t cv[8]){
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint32_t out[16];
+
+    for (int i = 0; i < 8; i++){
+        for (int b = 0; b < 4; b++){
+            block[i * 4 + b] = left[i] >> (8 * b);
+            block[32 + i * 4 + b] = right[i] >> (8 * b);
+        }
+    }
+    blake3_compress(blake3_iv, block, 0, BLAKE3_BLOCK_LEN, BLAKE3_PARENT | flags, out);
+    memcpy(cv, out, 8 * sizeof(uint32_t));
+}
+
+static void blake3_init(struct blake3_hasher *hasher){
+    blake3_chunk_init(&hasher->chunk, 0);
+    hasher->cv_stack_len = 0;
+}
+
+/**
+ * @brief Adds the chaining value of a completed chunk to the tree.  The number of completed chunks
+ * tells us how many subtrees can be merged: one for each trailing zero bit.
+ */
+static void blake3_add_chunk_cv(struct blake3_hasher *hasher, uint32_t cv[8], uint64_t total_chunks){
+    while ((total_chunks & 1) == 0){
+        blake3_parent_cv(hasher->cv_stack[--hasher->cv_stack_len], cv, 0, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(hasher->cv_stack[hasher->cv_stack_len++], cv, 8 * sizeof(uint32_t));
+}
+
+static void blake3_update(struct blake3_hasher *hasher, const uint8_t *input, size_t length){
+    uint32_t out[16];
+
+    while (length){
+        if (blake3_chunk_len(&hasher->chunk) == BLAKE3_CHUNK_LEN){
+            uint64_t total_chunks = hasher->chunk.chunk_counter + 1;
+            blake3_compress(hasher->chunk.cv, hasher->chunk.block, hasher->chunk.chunk_counter, hasher->chunk.block_len,
+                blake3_chunk_start_flag(&hasher->chunk) | BLAKE3_CHUNK_END, out);
+            blake3_add_chunk_cv(hasher, out, total_chunks);
+            blake3_chunk_init(&hasher->chunk, total_chunks);
+        }
+        size_t take = BLAKE3_CHUNK_LEN - blake3_chunk_len(&hasher->chunk);
+        if (take > length)
+            take = length;
+        blake3_chunk_update(&hasher->chunk, input, take);
+        input += take;
+        length -= take;
+    }
+}
+
+/**
+ * @brief Finishes the hash and writes the 32 byte digest.  The final chunk is merged with every
+ * subtree left on the stack, and the last compression gets the ROOT flag.
+ */
+static void blake3_final(struct blake3_hasher *hasher, uint8_t digest[BLAKE3_OUT_LEN]){
+    uint32_t cv[8];
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint32_t block_len = hasher->chunk.block_len;
+    uint32_t flags = blake3_chunk_start_flag(&hasher->chunk) | BLAKE3_CHUNK_END;
+    uint64_t counter = hasher->chunk.chunk_counter;
+    uint32_t out[16];
+
+    memcpy(cv, hasher->chunk.cv, sizeof(cv));
+    memcpy(block, hasher->chunk.block, BLAKE3_BLOCK_LEN);
+    for (int i = hasher->cv_stack_len; i > 0; i--){
+        blake3_compress(cv, block, counter, block_len, flags, out);
+        for (int w = 0; w < 8; w++){
+            for (int b = 0; b < 4; b++){
+                block[w * 4 + b] = hasher->cv_stack[i - 1][w] >> (8 * b);
+                block[32 + w * 4 + b] = out[w] >> (8 * b);
+            }
+        }
+        memcpy(cv, blake3_iv, sizeof(cv));
+        counter = 0;
+        block_len = BLAKE3_BLOCK_LEN;
+        flags = BLAKE3_PARENT;
+    }
+    blake3_compress(cv, block, counter, block_len, flags | BLAKE3_ROOT, out);
+    for (int i = 0; i < BLAKE3_OUT_LEN; i++)
+        digest[i] = out[i / 4] >> (8 * (i % 4));
+}
+
+/**
+ * @brief Writes a digest as a lower case hex string
+ */
+static void hex_digest(const uint8_t *digest, uint32_t length, char *out){
+    for (uint32_t i = 0; i < length; i++)
+        sprintf(out + i * 2, "%02x", digest[i]);
+}
+
+/**
+ * @brief Builds the full path of a directory entry from the names of its parents, e.g.
+ * /Sub Directory/FRAG.BIN
+ */
+static void entry_path(struct fat_dir_entry *entry, char *path, size_t size){
+    size_t length;
+
+    if (entry->parent_dir == NULL){
+        path[0] = 0;
+        return;
+    }
+    entry_path(entry->parent_dir, path, size);
+    length = strlen(path);
+    snprintf(path + length, size - length, "/%s", entry_name(entry));
+}
+
+/**
+ * @brief Hashes the contents of one file.  The cluster chain is followed through the FAT and
+ * contiguous clusters are read together, up to run_size bytes per read.
+ */
+static void hash_file(struct hash_pool *pool, struct hash_job *job, uint8_t *buf, EVP_MD_CTX *md5, EVP_MD_CTX *sha256){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t fat_entries = fg->fat_size_in_bytes / 4;
+    uint32_t cluster = job->first_cluster;
+    uint64_t remaining = job->file_size;
+    uint64_t steps = 0;
+    struct blake3_hasher blake3;
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    char md5_hex[33], sha256_hex[65], blake3_hex[65];
+
+    blake3_init(&blake3);
+    EVP_DigestInit_ex(md5, EVP_md5(), NULL);
+    EVP_DigestInit_ex(sha256, EVP_sha256(), NULL);
+
+    while (remaining && cluster >= 2 && cluster < fat_entries && steps < fat_entries){
+        uint32_t start = cluster;
+        uint64_t run = 1;
+        uint32_t next = read_alloctable(cluster);
+        while (next == cluster + 1 && (run + 1) * cluster_size <= pool->run_size && run * cluster_size < remaining){
+            cluster = next;
+            run++;
+            next = read_alloctable(cluster);
+        }
+        uint64_t length = run * cluster_size < remaining ? run * cluster_size : remaining;
+        if (image_pread(fg->image.fp, buf, length, cts(start)) != (ssize_t)length)
+            break;
+        EVP_DigestUpdate(md5, buf, length);
+        EVP_DigestUpdate(sha256, buf, length);
+        blake3_update(&blake3, buf, length);
+        progress_add(&fg->progress.bytes, length);
+        progress_add(&fg->progress.clusters, run);
+        remaining -= length;
+        steps += run;
+        cluster = next;
+    }
+
+    EVP_DigestFinal_ex(md5, digest, NULL);
+    hex_digest(digest, 16, md5_hex);
+    EVP_DigestFinal_ex(sha256, digest, NULL);
+    hex_digest(digest, 32, sha256_hex);
+    blake3_final(&blake3, digest);
+    hex_digest(digest, BLAKE3_OUT_LEN, blake3_hex);
+
+    // One printf per file so output from different workers is not interleaved
+    if (remaining)
+        report("Hashes of %s (%u bytes, cluster chain ends after %ju bytes, only those were hashed):\n MD5: %s\n SHA-256: %s\n BLAKE3: %s\n",
+            job->path, job->file_size, (uintmax_t)(job->file_size - remaining), md5_hex, sha256_hex, blake3_hex);
+    else
+        report("Hashes of %s (%u bytes):\n MD5: %s\n SHA-256: %s\n BLAKE3: %s\n", job->path, job->file_size, md5_hex, sha256_hex, blake3_hex);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->files++;
+    pool->bytes += job->file_size - remaining;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Hashing worker thread.  Takes files off the queue until the walk is done and the queue
+ * is empty.
+ */
+static void* hash_worker(void *arg){
+    fg = arg;
+    struct hash_pool *pool = &fg->hashes;
+    struct hash_job job;
+    jmp_buf fail;
+    uint8_t *buf = malloc(pool->run_size);
+    EVP_MD_CTX *md5 = EVP_MD_CTX_new();
+    EVP_MD_CTX *sha256 = EVP_MD_CTX_new();
+    bool ready = buf != NULL && md5 != NULL && sha256 != NULL;
+
+    // Without its buffers the worker still takes jobs off the queue, so the walk is not blocked
+    if (!ready){
+        fprintf(stderr, "Aborting... Out of memory while starting the hashing threads.\n");
+        fail_worker();
+    }
+    worker_fail = &fail;
+    for (;;){
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->done)
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        if (pool->count == 0){
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job = pool->jobs[pool->head];
+        pool->head = (pool->head + 1) % HASH_QUEUE_DEPTH;
+        pool->count--;
+        pool->active++;
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (ready && !setjmp(fail))
+            hash_file(pool, &job, buf, md5, sha256);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0 && pool->count == 0)
+            pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    worker_fail = NULL;
+    EVP_MD_CTX_free(md5);
+    EVP_MD_CTX_free(sha256);
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief Starts the hashing workers
+ *
+ * @param threads number of workers, 0 for one per CPU
+ * @param max_memory memory ceiling of the scan in bytes, 0 if unbounded
+ */
+static void init_hash_pool(struct hash_pool *pool, uint32_t threads, uint64_t max_memory){
+    uint32_t cluster_size = fg->bps * fg->spc;
+
+    if (threads == 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    if (threads > HASH_MAX_THREADS)
+        threads = HASH_MAX_THREADS;
+
+    // Each worker has a read buffer, in bounded mode they share an eighth of the budget
+    pool->run_size = HASH_RUN_SIZE;
+    if (max_memory && pool->run_size > max_memory / 8 / threads)
+        pool->run_size = max_memory / 8 / threads;
+    pool->run_size -= pool->run_size % cluster_size;
+    if (pool->run_size < cluster_size)
+        pool->run_size = cluster_size;
+
+    pool->jobs = calloc(HASH_QUEUE_DEPTH, sizeof(struct hash_job));
+    if (pool->jobs == NULL){
+        fprintf(stderr, "Aborting... Out of memory while starting the hashing threads.\n");
+        fatal();
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+    pthread_cond_init(&pool->not_full, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for (pool->thread_count = 0; pool->thread_count < threads; pool->thread_count++){
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, hash_worker, fg))
+            break;
+    }
+    if (pool->thread_count == 0){
+        fprintf(stderr, "Aborting... Could not start the hashing threads.\n");
+        fatal();
+    }
+    pool->enabled = true;
+}
+
+/**
+ * @brief Queues a file to be hashed.  Blocks while the queue is full.
+ */
+static void submit_hash_job(struct hash_pool *pool, struct fat_dir_entry *entry){
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count == HASH_QUEUE_DEPTH)
+        pthread_cond_wait(&pool->not_full, &pool->lock);
+    struct hash_job *job = &pool->jobs[(pool->head + pool->count) % HASH_QUEUE_DEPTH];
+    entry_path(entry, job->path, HASH_PATH_SIZE);
+    job->first_cluster = entry->cluster_addr;
+    job->file_size = entry->file_size;
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Waits until every queued file has been hashed, the workers keep running
+ */
+static void drain_hash_pool(struct hash_pool *pool){
+    if (!pool->enabled)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count || pool->active)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Waits for the workers to hash every queued file, then stops them
+ */
+static void finish_hash_pool(struct hash_pool *pool){
+    if (!pool->enabled)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->done = true;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_cond_destroy(&pool->not_full);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->jobs);
+    pool->enabled = false;
+}
+
+/**
+ * @brief Decodes a DOS date and time to ISO-8601, e.g. 2021-06-30T14:05:22.  DOS times are local
+ * time with no time zone, so none is given.
+ *
+ * @param time time of day, or -1 for a date only
+ * @param tenths hundredths of a second to add (0-199, created times only), or -1 for none
+ * @return bool : false if the date or time is not a valid DOS date or time
+ */
+static bool dos_time_iso(uint16_t date, int time, int tenths, char *out, size_t size){
+    uint32_t year = 1980 + (date >> 9);
+    uint32_t month = (date >> 5) & 0xF;
+    uint32_t day = date & 0x1F;
+
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+        return false;
+    if (time < 0){
+        snprintf(out, size, "%04u-%02u-%02u", year, month, day);
+        return true;
+    }
+    uint32_t hours = time >> 11;
+    uint32_t minutes = (time >> 5) & 0x3F;
+    uint32_t seconds = (time & 0x1F) * 2;
+    if (hours > 23 || minutes > 59 || seconds > 59 || tenths > 199)
+        return false;
+    if (tenths < 0)
+        snprintf(out, size, "%04u-%02u-%02uT%02u:%02u:%02u", year, month, day, hours, minutes, seconds);
+    else
+        snprintf(out, size, "%04u-%02u-%02uT%02u:%02u:%02u.%02u", year, month, day, hours, minutes, seconds + tenths / 100, tenths % 100);
+    return true;
+}
+
+/**
+ * @brief Converts a DOS date and time to seconds since the Unix epoch, taking it as UTC
+ *
+ * @return int64_t : 0 if the date is not set or not valid, as the body file format expects
+ */
+static int64_t dos_time_epoch(uint16_t date, uint16_t time){
+    char iso[32];
+    int64_t year = 1980 + (date >> 9);
+    int64_t month = (date >> 5) & 0xF;
+    int64_t day = date & 0x1F;
+
+    if (date == 0 || !dos_time_iso(date, time, -1, iso, sizeof(iso)))
+        return 0;
+    // Days from 1970-01-01 to the date, counting years from March so the leap day comes last
+    year -= month <= 2;
+    int64_t era = year / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t days = era * 146097 + year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year - 719468;
+    return days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2;
+}
+
+/**
+ * @brief Adds an entry found by the walk to the timeline.  Only the pointer is kept, the entry
+ * stays in the tree arena.
+ */
+static void add_timeline_entry(struct timeline *t, struct fat_dir_entry *entry){
+    if (t->entry_count == TIMELINE_MAX_ENTRIES)
+        return;
+    if (t->entry_count == t->entry_capacity){
+        uint64_t capacity = t->entry_capacity ? t->entry_capacity * 2 : 1024;
+        struct fat_dir_entry **entries = realloc(t->entries, capacity * sizeof(struct fat_dir_entry *));
+        if (entries == NULL){
+            fprintf(stderr, "Aborting... Out of memory while building the timeline.\n");
+            fatal();
+        }
+        t->entries = entries;
+        t->entry_capacity = capacity;
+    }
+    t->entries[t->entry_count++] = entry;
+}
+
+/**
+ * @brief Counts the keys of one worker's share in each bucket of the current digit
+ */
+static void* radix_count_thread(void *arg){
+    struct radix_sort_worker *w = arg;
+    const uint64_t *src = w->sort->src;
+    uint32_t shift = w->sort->shift;
+
+    memset(w->counts, 0, sizeof(w->counts));
+    for (uint64_t i = w->begin; i < w->end; i++)
+        w->counts[(src[i] >> shift) & (TIMELINE_RADIX_BUCKETS - 1)]++;
+    return NULL;
+}
+
+/**
+ * @brief Moves the keys of one worker's share to their buckets.  Each worker has its own place in
+ * every bucket, so the workers never write to the same key.
+ */
+static void* radix_scatter_thread(void *arg){
+    struct radix_sort_worker *w = arg;
+    const uint64_t *src = w->sort->src;
+    uint64_t *dst = w->sort->dst;
+    uint32_t shift = w->sort->shift;
+
+    for (uint64_t i = w->begin; i < w->end; i++)
+        dst[w->counts[(src[i] >> shift) & (TIMELINE_RADIX_BUCKETS - 1)]++] = src[i];
+    return NULL;
+}
+
+/**
+ * @brief Runs one step of the sort on every worker.  The calling thread does the first share, and
+ * any share whose thread could not be started.
+ */
+static void run_radix_step(struct radix_sort *s, void *(*step)(void *)){
+    bool started[HASH_MAX_THREADS] = {false};
+
+    for (uint32_t i = 1; i < s->thread_count; i++)
+        started[i] = pthread_create(&s->workers[i].thread, NULL, step, &s->workers[i]) == 0;
+    for (uint32_t i = 0; i < s->thread_count; i++){
+        if (!started[i])
+            step(&s->workers[i]);
+    }
+    for (uint32_t i = 1; i < s->thread_count; i++){
+        if (started[i])
+            pthread_join(s->workers[i].thread, NULL);
+    }
+}
+
+/**
+ * @brief Sorts the timeline keys by time, one byte of the high 32 bits per pass.  Bytes that are
+ * the same in every key, e.g. the year of a card used for a few months, are skipped.
+ *
+ * @return uint64_t* : the sorted keys, either keys or scratch
+ */
+static uint64_t* sort_timeline_keys(uint64_t *keys, uint64_t *scratch, uint64_t count, uint32_t threads){
+    struct radix_sort s = {.src = keys, .dst = scratch, .count = count};
+
+    if (threads == 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    if (threads > HASH_MAX_THREADS)
+        threads = HASH_MAX_THREADS;
+    if (threads > count / TIMELINE_SORT_MIN_PER_THREAD)
+        threads = count / TIMELINE_SORT_MIN_PER_THREAD ? count / TIMELINE_SORT_MIN_PER_THREAD : 1;
+    s.thread_count = threads;
+    s.workers = calloc(threads, sizeof(struct radix_sort_worker));
+    if (s.workers == NULL){
+        fprintf(stderr, "Aborting... Out of memory while sorting the timeline.\n");
+        fatal();
+    }
+    for (uint32_t i = 0; i < threads; i++){
+        s.workers[i].sort = &s;
+        s.workers[i].begin = count * i / threads;
+        s.workers[i].end = count * (i + 1) / threads;
+    }
+
+    for (s.shift = 32; s.shift < 64; s.shift += TIMELINE_RADIX_BITS){
+        uint64_t position = 0;
+        bool one_bucket = false;
+
+        run_radix_step(&s, radix_count_thread);
+        // Turn the counts into where each worker's first key of each bucket goes
+        for (uint32_t bucket = 0; bucket < TIMELINE_RADIX_BUCKETS; bucket++){
+            uint64_t start = position;
+            for (uint32_t i = 0; i < threads; i++){
+                uint64_t n = s.workers[i].counts[bucket];
+                s.workers[i].counts[bucket] = position;
+                position += n;
+            }
+            one_bucket |= position - start == count;
+        }
+        if (one_bucket)
+            continue;
+        run_radix_step(&s, radix_scatter_thread);
+        uint64_t *swap = s.src;
+        s.src = s.dst;
+        s.dst = swap;
+    }
+    free(s.workers);
+    return s.src;
+}
+
+/**
+ * @brief Makes the key of one event of the timeline
+ */
+static uint64_t timeline_key(uint16_t date, uint16_t time, uint64_t entry, int type){
+    return (uint64_t)date << 48 | (uint64_t)time << 32 | entry << TIMELINE_INDEX_SHIFT | type;
+}
+
+/**
+ * @brief Describes what kind of entry a directory entry is, from its attributes
+ */
+static const char* entry_type_txt(uint8_t attributes, bool deleted){
+    if (attributes & FLAG_FAT_VOLUME_LABEL && !(attributes & FLAG_FAT_DIRECTORY))
+        return "volume label";
+    if (attributes & FLAG_FAT_DIRECTORY)
+        return deleted ? "deleted directory" : "directory";
+    return deleted ? "deleted file" : "file";
+}
+
+/**
+ * @brief Writes every created, accessed, and written time found by the walk to a CSV file, sorted
+ * by time.  Times that are not set are left out, times that are not valid dates are counted.
+ */
+static void write_timeline(struct timeline *t, const char *file_path){
+    uint64_t *scratch;
+    uint64_t *sorted;
+    FILE *file;
+    char path[TIMELINE_PATH_SIZE];
+    char iso[32];
+    double start = now_seconds();
+    double sort_seconds;
+
+    t->keys = malloc((t->entry_count * EVENT_TYPE_COUNT + 1) * sizeof(uint64_t));
+    scratch = malloc((t->entry_count * EVENT_TYPE_COUNT + 1) * sizeof(uint64_t));
+    if (t->keys == NULL || scratch == NULL){
+        fprintf(stderr, "Aborting... Out of memory while building the timeline.\n");
+        free(scratch);
+        fatal();
+    }
+    t->event_count = 0;
+    for (uint64_t i = 0; i < t->entry_count; i++){
+        struct fat_dir_entry *e = t->entries[i];
+        uint16_t dates[EVENT_TYPE_COUNT] = {e->created_day, e->accessed_day, e->written_day};
+        int times[EVENT_TYPE_COUNT] = {e->created_time_hms, -1, e->written_time_hms};
+        for (int type = 0; type < EVENT_TYPE_COUNT; type++){
+            if (dates[type] == 0)
+                continue;
+            if (!dos_time_iso(dates[type], times[type], type == EVENT_CREATED ? e->created_time_tenths : -1, iso, sizeof(iso))){
+                t->invalid++;
+                continue;
+            }
+            t->keys[t->event_count++] = timeline_key(dates[type], times[type] < 0 ? 0 : times[type], i, type);
+        }
+    }
+    sorted = sort_timeline_keys(t->keys, scratch, t->event_count, fg->args.threads);
+    sort_seconds = now_seconds() - start;
+
+    file = fopen(file_path, "w");
+    if (file == NULL){
+        fprintf(stderr, "Warning!  Unable to write the timeline to: %s\n", file_path);
+        free(scratch);
+        return;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    fprintf(file, "timestamp,event,type,size,first_cluster,path\n");
+    for (uint64_t i = 0; i < t->event_count; i++){
+        struct fat_dir_entry *e = t->entries[(uint32_t)sorted[i] >> TIMELINE_INDEX_SHIFT];
+        int type = sorted[i] & ((1 << TIMELINE_INDEX_SHIFT) - 1);
+        if (type == EVENT_CREATED)
+            dos_time_iso(e->created_day, e->created_time_hms, e->created_time_tenths, iso, sizeof(iso));
+        else if (type == EVENT_ACCESSED)
+            dos_time_iso(e->accessed_day, -1, -1, iso, sizeof(iso));
+        else
+            dos_time_iso(e->written_day, e->written_time_hms, -1, iso, sizeof(iso));
+        entry_path(e, path, sizeof(path));
+        fprintf(file, "%s,%s,%s,%u,%u,\"%s\"\n", iso, timeline_event_txt[type], entry_type_txt(e->file_attributes, e->is_deleted), e->file_size, e->cluster_addr, path);
+    }
+    if (fclose(file))
+        fprintf(stderr, "Warning!  Unable to write the timeline to: %s\n", file_path);
+    free(scratch);
+
+    report("Timeline: %ju events from %ju entries written to %s", (uintmax_t)t->event_count, (uintmax_t)t->entry_count, file_path);
+    if (t->invalid)
+        report(", %ju times that are not valid DOS dates left out", (uintmax_t)t->invalid);
+    report(".\n");
+    if (fg->args.v_flag)
+        report("Timeline sorted in %.3f seconds.\n", sort_seconds);
+}
+
+/**
+ * @brief Writes the entries found by the walk in the Sleuth Kit body file format, one line per
+ * entry, for mactime.  FAT has no inode numbers so the first cluster is given instead, and no
+ * change time so it is 0.
+ */
+static void write_bodyfile(struct timeline *t, const char *file_path){
+    char path[TIMELINE_PATH_SIZE];
+    FILE *file = fopen(file_path, "w");
+
+    if (file == NULL){
+        fprintf(stderr, "Warning!  Unable to write the body file to: %s\n", file_path);
+        return;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    for (uint64_t i = 0; i < t->entry_count; i++){
+        struct fat_dir_entry *e = t->entries[i];
+        const char *mode = "r/rrwxrwxrwx";
+        if (e->file_attributes & FLAG_FAT_DIRECTORY)
+            mode = e->file_attributes & FLAG_FAT_READ_ONLY ? "d/dr-xr-xr-x" : "d/drwxrwxrwx";
+        else if (e->file_attributes & FLAG_FAT_VOLUME_LABEL)
+            mode = "V/V---------";
+        else if (e->file_attributes & FLAG_FAT_READ_ONLY)
+            mode = "r/rr-xr-xr-x";
+        entry_path(e, path, sizeof(path));
+        fprintf(file, "0|%s%s|%u|%s|0|0|%u|%jd|%jd|0|%jd\n", path, e->is_deleted ? " (deleted)" : "", e->cluster_addr, mode, e->file_size,
+            (intmax_t)dos_time_epoch(e->accessed_day, 0), (intmax_t)dos_time_epoch(e->written_day, e->written_time_hms),
+            (intmax_t)dos_time_epoch(e->created_day, e->created_time_hms) + e->created_time_tenths / 100);
+    }
+    if (fclose(file))
+        fprintf(stderr, "Warning!  Unable to write the body file to: %s\n", file_path);
+    else
+        report("Body file: %ju entries written to %s.\n", (uintmax_t)t->entry_count, file_path);
+}
+
+/**
+ * @brief Writes the timeline and body file asked for, once the walk has found every entry
+ */
+static void finish_timeline(struct timeline *t){
+    if (!t->enabled)
+        return;
+    if (fg->args.timeline_path[0])
+        write_timeline(t, fg->args.timeline_path);
+    if (fg->args.bodyfile_path[0])
+        write_bodyfile(t, fg->args.bodyfile_path);
+    free(t->entries);
+    free(t->keys);
+    t->entries = NULL;
+    t->keys = NULL;
+    t->enabled = false;
+}
+
+/**
+ * @brief Returns the CRC32 of the boot sector, used to tell whether a checkpoint belongs to the
+ * volume being scanned
+ */
+static uint32_t boot_sector_crc(void){
+    uint8_t sector[512];
+
+    if (image_pread(fg->image.fp, sector, sizeof(sector), 0) != sizeof(sector))
+        read_error();
+    return crc32(0, sector, sizeof(sector));
+}
+
+/**
+ * @brief Writes the directory path of a queued directory as the raw and long names of its
+ * ancestors, starting below the root
+ */
+static bool write_checkpoint_dir(FILE *file, struct fat_dir_entry *dir){
+    struct fat_dir_entry *chain[256];
+    uint32_t depth = 0;
+
+    for (struct fat_dir_entry *e = dir; e->parent_dir != NULL && depth < 256; e = e->parent_dir)
+        chain[depth++] = e;
+    if (fwrite(&dir->cluster_addr, 4, 1, file) != 1 || fwrite(&depth, 4, 1, file) != 1)
+        return false;
+    while (depth--){
+        const char *name = entry_name(chain[depth]);
+        uint16_t length = strlen(name);
+        if (fwrite(chain[depth]->info.filename, 11, 1, file) != 1 || fwrite(&length, 2, 1, file) != 1 || fwrite(name, 1, length, file) != length)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a checkpoint of the -h scan.  It is written to a temporary file that replaces the
+ * old checkpoint once it is complete, so a crash while writing leaves the previous one intact.
+ * Queued files are hashed first so the checkpoint never covers files that were not hashed.
+ */
+static void write_checkpoint(struct checkpoint *c){
+    char tmp_path[520];
+    struct checkpoint_header header = {.magic = "FGCKPT", .version = CHECKPOINT_VERSION};
+    struct region_scan scans[2] = {c->free_space.total, c->free_space.extent};
+    bool ok = true;
+    FILE *file;
+
+    drain_hash_pool(&fg->hashes);
+    check_workers();
+    header.phase = c->phase;
+    header.image_size = fg->image.size;
+    header.boot_sector_crc = c->boot_sector_crc;
+    header.hidden_data_found = fg->hidden_data_found;
+    header.pattern_hits = fg->matcher.hits;
+    header.hashed_files = fg->hashes.files;
+    header.hashed_bytes = fg->hashes.bytes;
+    header.finding_count = fg->findings.count;
+    header.dir_count = c->phase == PHASE_WALK ? fg->dirs.count : 0;
+    scans[0].label = NULL;
+    scans[1].label = NULL;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", fg->args.checkpoint_path);
+    file = fopen(tmp_path, "wb");
+    if (file == NULL){
+        fprintf(stderr, "Warning!  Unable to write the checkpoint file at: %s\n", tmp_path);
+        return;
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(&c->free_space.cursor, 4, 1, file) == 1 &&
+        fwrite(&c->free_space.extents_with_data, 8, 1, file) == 1 &&
+        fwrite(scans, sizeof(scans), 1, file) == 1 &&
+        fwrite(fg->findings.items, sizeof(struct finding), fg->findings.count, file) == fg->findings.count;
+    for (uint64_t i = 0; ok && i < header.dir_count; i++)
+        ok = write_checkpoint_dir(file, fg->dirs.items[i]);
+    ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    fclose(file);
+    if (!ok || rename(tmp_path, fg->args.checkpoint_path)){
+        fprintf(stderr, "Warning!  Unable to write the checkpoint file at: %s\n", fg->args.checkpoint_path);
+        unlink(tmp_path);
+        return;
+    }
+    c->writes++;
+    c->last_write = now_seconds();
+}
+
+/**
+ * @brief Writes a checkpoint if the checkpoint interval has passed.  Only called between units
+ * of work, when nothing is half done.
+ */
+static void maybe_checkpoint(void){
+    if (fg->ckpt.enabled && now_seconds() - fg->ckpt.last_write >= fg->args.checkpoint_interval)
+        write_checkpoint(&fg->ckpt);
+}
+
+/**
+ * @brief Moves the scan on to its next pass and checkpoints the pass change
+ */
+static void begin_phase(int phase){
+    fg->ckpt.phase = phase;
+    if (fg->ckpt.enabled)
+        write_checkpoint(&fg->ckpt);
+}
+
+/**
+ * @brief Restores the state of a scan from its checkpoint file.  The findings so far, the free
+ * space progress, and the queued directories are loaded, the passes that already finished are
+ * skipped by the caller.
+ */
+static void load_checkpoint(struct checkpoint *c){
+    struct checkpoint_header header;
+    struct region_scan scans[2];
+    FILE *file = fopen(fg->args.checkpoint_path, "rb");
+    bool ok;
+
+    if (file == NULL){
+        fprintf(stderr, "Aborting... Unable to open the checkpoint file at: %s\n", fg->args.checkpoint_path);
+        fatal();
+    }
+    ok = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, "FGCKPT", 7) && header.version == CHECKPOINT_VERSION;
+    if (ok && (header.image_size != fg->image.size || header.boot_sector_crc != c->boot_sector_crc)){
+        fprintf(stderr, "Aborting... The checkpoint at %s was written for a different disk image.\n", fg->args.checkpoint_path);
+        fatal();
+    }
+    ok = ok && fread(&c->free_space.cursor, 4, 1, file) == 1 &&
+        fread(&c->free_space.extents_with_data, 8, 1, file) == 1 &&
+        fread(scans, sizeof(scans), 1, file) == 1;
+    if (ok){
+        fg->findings.items = malloc((header.finding_count ? header.finding_count : 1) * sizeof(struct finding));
+        fg->findings.count = fg->findings.capacity = header.finding_count;
+        ok = fg->findings.items != NULL && fread(fg->findings.items, sizeof(struct finding), fg->findings.count, file) == fg->findings.count;
+    }
+    if (ok && header.dir_count){
+        uint64_t names = 0;
+        uint64_t long_names_size = 0;
+        c->resume_clusters = malloc(header.dir_count * sizeof(uint32_t));
+        c->resume_depths = malloc(header.dir_count * sizeof(uint32_t));
+        if (c->resume_clusters == NULL || c->resume_depths == NULL){
+            fprintf(stderr, "Aborting... Out of memory while loading the checkpoint file at: %s\n", fg->args.checkpoint_path);
+            fclose(file);
+            fatal();
+        }
+        for (uint64_t i = 0; ok && i < header.dir_count; i++){
+            uint32_t depth;
+            ok = fread(&c->resume_clusters[i], 4, 1, file) == 1 && fread(&depth, 4, 1, file) == 1 && depth <= 256;
+            if (!ok)
+                break;
+            c->resume_depths[i] = depth;
+            char (*resume_names)[11] = realloc(c->resume_names, (names + depth + 1) * 11);
+            if (resume_names == NULL){
+                fprintf(stderr, "Aborting... Out of memory while loading the checkpoint file at: %s\n", fg->args.checkpoint_path);
+                fclose(file);
+                fatal();
+            }
+            c->resume_names = resume_names;
+            for (uint32_t d = 0; ok && d < depth; d++){
+                uint16_t length;
+                ok = fread(c->resume_names[names++], 11, 1, file) == 1 && fread(&length, 2, 1, file) == 1;
+                if (!ok)
+                    break;
+                char *resume_long_names = realloc(c->resume_long_names, long_names_size + length + 1);
+                if (resume_long_names == NULL){
+                    fprintf(stderr, "Aborting... Out of memory while loading the checkpoint file at: %s\n", fg->args.checkpoint_path);
+                    fclose(file);
+                    fatal();
+                }
+                c->resume_long_names = resume_long_names;
+                ok = fread(c->resume_long_names + long_names_size, 1, length, file) == length;
+                if (ok){
+                    long_names_size += length;
+                    c->resume_long_names[long_names_size++] = 0;
+                }
+            }
+        }
+        c->resume_dir_count = header.dir_count;
+    }
+    fclose(file);
+    if (!ok){
+        fprintf(stderr, "Aborting... The checkpoint file at %s is damaged.\n", fg->args.checkpoint_path);
+        fatal();
+    }
+    c->phase = header.phase;
+    c->free_space.total = scans[0];
+    c->free_space.extent = scans[1];
+    fg->hidden_data_found = header.hidden_data_found;
+    fg->matcher.hits = header.pattern_hits;
+    fg->hashes.files = header.hashed_files;
+    fg->hashes.bytes = header.hashed_bytes;
+    report("Resuming from the checkpoint at %s: %ju findings so far, %ju directories queued.\n\n",
+        fg->args.checkpoint_path, (uintmax_t)fg->findings.count, (uintmax_t)c->resume_dir_count);
+}
+
+/**
+ * @brief Sets up checkpoints for a -h scan of a FAT volume, restoring the last one on --resume
+ */
+static void init_checkpoint(struct checkpoint *c){
+    c->boot_sector_crc = boot_sector_crc();
+    c->last_write = now_seconds();
+    if (fg->args.resume)
+        load_checkpoint(c);
+    c->enabled = true;
+}
+
+/**
+ * @brief Removes the checkpoint of a scan that ran to completion
+ */
+static void finish_checkpoint(struct checkpoint *c){
+    if (!c->enabled)
+        return;
+    unlink(fg->args.checkpoint_path);
+    free(c->resume_clusters);
+    free(c->resume_names);
+    free(c->resume_long_names);
+    free(c->resume_depths);
+    c->enabled = false;
+}
+
+/**
+ * @brief Adds an entry found by the walk to the path index
+ */
+static void add_path_record(struct path_index *index, struct fat_dir_entry *entry){
+    char path[PATH_INDEX_PATH_SIZE];
+    size_t length;
+
+    entry_path(entry, path, sizeof(path));
+    length = strlen(path) + 1;
+    if (index->count == index->capacity){
+        uint64_t capacity = index->capacity ? index->capacity * 2 : 1024;
+        struct path_record *records = realloc(index->records, capacity * sizeof(struct path_record));
+        if (records == NULL){
+            fprintf(stderr, "Aborting... Out of memory while building the path index.\n");
+            fatal();
+        }
+        index->records = records;
+        index->capacity = capacity;
+    }
+    if (index->names_size + length > index->names_capacity){
+        uint64_t capacity = index->names_capacity ? index->names_capacity * 2 : 65536;
+        while (capacity < index->names_size + length)
+            capacity *= 2;
+        char *names = realloc(index->names, capacity);
+        if (names == NULL){
+            fprintf(stderr, "Aborting... Out of memory while building the path index.\n");
+            fatal();
+        }
+        index->names = names;
+        index->names_capacity = capacity;
+    }
+    memcpy(index->names + index->names_size, path, length);
+    index->records[index->count++] = (struct path_record){
+        .path = index->names_size,
+        .first_cluster = entry->cluster_addr,
+        .file_size = entry->file_size,
+        .written_day = entry->written_day,
+        .written_time_hms = entry->written_time_hms,
+        .attributes = entry->file_attributes,
+        .deleted = entry->is_deleted
+    };
+    index->names_size += length;
+}
+
+/**
+ * @brief Orders path records by path, ignoring case as FAT does.  Deleted entries come after the
+ * entry they share a path with.
+ */
+static int compare_path_records(const void *a, const void *b){
+    const struct path_record *x = a;
+    const struct path_record *y = b;
+    int order = strcasecmp(fg->paths.names + x->path, fg->paths.names + y->path);
+
+    return order ? order : x->deleted - y->deleted;
+}
+
+/**
+ * @brief Returns the CRC32 of FAT1.  Together with the boot sector and the directories it tells
+ * whether a saved path index still matches the volume, as creating, deleting, or growing a file
+ * changes the FAT.
+ */
+static uint32_t fat_crc(void){
+    uint64_t fat_offset = (uint64_t)fg->fat_bs->reserved_area_size * fg->bps;
+    uint8_t *chunk = malloc(FAT_DUMP_CHUNK_SIZE);
+    uint32_t crc = 0;
+
+    if (chunk == NULL){
+        fprintf(stderr, "Aborting... Out of memory while checking the path index.\n");
+        fatal();
+    }
+    for (uint32_t offset = 0; offset < fg->fat_size_in_bytes; offset += FAT_DUMP_CHUNK_SIZE){
+        uint32_t length = fg->fat_size_in_bytes - offset < FAT_DUMP_CHUNK_SIZE ? fg->fat_size_in_bytes - offset : FAT_DUMP_CHUNK_SIZE;
+        if (image_pread(fg->fp, chunk, length, fat_offset + offset) < 0){
+            free(chunk);
+            read_error();
+        }
+        crc = crc32(crc, chunk, length);
+    }
+    free(chunk);
+    return crc;
+}
+
+/**
+ * @brief Adds the clusters of one directory chain to a CRC32
+ */
+static uint32_t directory_chain_crc(uint32_t crc, uint32_t cluster, uint8_t *buffer){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t eof = fg->fat_bs->is_fat32 ? FAT32_EOF : fg->fat_bs->is_fat16 ? FAT16_EOF : FAT12_EOF;
+    uint64_t end = fg->image.size > fg->reserved_and_fats ? (fg->image.size - fg->reserved_and_fats) / cluster_size + 2 : 2;
+
+    // The step limit stops at a chain that loops back on itself
+    for (uint64_t steps = 0; cluster >= 2 && cluster < end && cluster < eof && steps < end; steps++){
+        if (image_pread(fg->fp, buffer, cluster_size, cts(cluster)) < 0){
+            free(buffer);
+            read_error();
+        }
+        crc = crc32(crc, buffer, cluster_size);
+        cluster = read_alloctable(cluster);
+        if (fg->fat_bs->is_fat32)
+            cluster &= FAT32_ENTRY_MASK;
+    }
+    return crc;
+}
+
+/**
+ * @brief Returns the CRC32 of the clusters of the root directory and of every live directory in
+ * the index.  Renaming a file, or rewriting a directory entry in place, changes only these, not
+ * the FAT.  The directories are read but not decoded, which is still much less than a walk.
+ */
+static uint32_t directory_crc(struct path_index *index){
+    uint8_t *buffer = malloc(fg->bps * fg->spc);
+    uint32_t crc;
+
+    if (buffer == NULL){
+        fprintf(stderr, "Aborting... Out of memory while checking the path index.\n");
+        fatal();
+    }
+    // Path indexes are only built for FAT32, whose root directory is a chain like the others
+    crc = directory_chain_crc(0, fg->fat_bs->root_dir_cluster, buffer);
+    for (uint64_t i = 0; i < index->count; i++){
+        struct path_record *r = &index->records[i];
+        if (!r->deleted && r->attributes & FLAG_FAT_DIRECTORY)
+            crc = directory_chain_crc(crc, r->first_cluster, buffer);
+    }
+    free(buffer);
+    return crc;
+}
+
+/**
+ * @brief Writes the path index to a file so later runs on the same image can skip the walk
+ */
+static void save_path_index(struct path_index *index, const char *file_path){
+    char tmp_path[520];
+    struct path_index_header header = {.magic = "FGINDEX", .version = PATH_INDEX_VERSION};
+    FILE *file;
+    bool ok;
+
+    header.boot_sector_crc = boot_sector_crc();
+    header.fat_crc = fat_crc();
+    header.directory_crc = directory_crc(index);
+    header.image_size = fg->image.size;
+    header.count = index->count;
+    header.names_size = index->names_size;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file_path);
+    file = fopen(tmp_path, "wb");
+    if (file == NULL){
+        fprintf(stderr, "Warning!  Unable to write the path index to: %s\n", file_path);
+        return;
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(index->records, sizeof(struct path_record), index->count, file) == index->count &&
+        fwrite(index->names, 1, index->names_size, file) == index->names_size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path, file_path)){
+        fprintf(stderr, "Warning!  Unable to write the path index to: %s\n", file_path);
+        unlink(tmp_path);
+        return;
+    }
+    report("Path index of %ju entries written to %s.\n", (uintmax_t)index->count, file_path);
+}
+
+/**
+ * @brief Loads a path index written by an earlier run on the same image
+ *
+ * @return bool : false if there is no index file, or it is for another image or damaged
+ */
+static bool load_path_index(struct path_index *index, const char *file_path){
+    struct path_index_header header;
+    FILE *file = fopen(file_path, "rb");
+    bool ok;
+
+    if (file == NULL)
+        return false;
+    ok = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, "FGINDEX", 8) && header.version == PATH_INDEX_VERSION;
+    if (ok && (header.image_size != fg->image.size || header.boot_sector_crc != boot_sector_crc() || header.fat_crc != fat_crc())){
+        fprintf(stderr, "Warning!  The path index at %s does not match this disk image, it will be rebuilt.\n", file_path);
+        fclose(file);
+        return false;
+    }
+    if (ok){
+        index->records = malloc((header.count ? header.count : 1) * sizeof(struct path_record));
+        index->names = malloc(header.names_size ? header.names_size : 1);
+        ok = index->records != NULL && index->names != NULL &&
+            fread(index->records, sizeof(struct path_record), header.count, file) == header.count &&
+            fread(index->names, 1, header.names_size, file) == header.names_size &&
+            (header.names_size == 0 || index->names[header.names_size - 1] == 0);
+        for (uint64_t i = 0; ok && i < header.count; i++)
+            ok = index->records[i].path < header.names_size;
+    }
+    fclose(file);
+    // The directories to check are the ones in the index, so it has to be read first
+    if (ok){
+        index->count = header.count;
+        if (header.directory_crc != directory_crc(index)){
+            fprintf(stderr, "Warning!  The path index at %s does not match this disk image, it will be rebuilt.\n", file_path);
+            free(index->records);
+            free(index->names);
+            index->records = NULL;
+            index->names = NULL;
+            index->count = 0;
+            return false;
+        }
+    }
+    if (!ok){
+        fprintf(stderr, "Warning!  The path index at %s is damaged, it will be rebuilt.\n", file_path);
+        free(index->records);
+        free(index->names);
+        index->records = NULL;
+        index->names = NULL;
+        return false;
+    }
+    index->count = index->capacity = header.count;
+    index->names_size = index->names_capacity = header.names_size;
+    index->ready = true;
+    report("Loaded the path index of %ju entries from %s.\n", (uintmax_t)index->count, file_path);
+    return true;
+}
+
+/**
+ * @brief Prints one path of the index with what is known about it
+ */
+static void print_path_record(struct path_index *index, struct path_record *r){
+    char written[32] = "never";
+
+    if (r->written_day)
+        dos_time_iso(r->written_day, r->written_time_hms, -1, written, sizeof(written));
+    report("  %s  (%s, %u bytes, first cluster %u, written %s)\n", index->names + r->path,
+        entry_type_txt(r->attributes, r->deleted), r->file_size, r->first_cluster, written);
+}
+
+/**
+ * @brief Lists every path whose file name matches a pattern, e.g. IMG_0042.JPG or *.JPG
+ */
+static void find_paths(struct path_index *index, const char *pattern){
+    char folded_pattern[PATH_INDEX_PATH_SIZE];
+    char folded_name[PATH_INDEX_PATH_SIZE];
+    uint64_t found = 0;
+
+    // Names are matched ignoring case, as FAT does
+    for (size_t i = 0; i == 0 || folded_pattern[i - 1]; i++)
+        folded_pattern[i] = toupper((unsigned char)pattern[i]);
+    report("\nPaths with file names matching %s:\n", pattern);
+    for (uint64_t i = 0; i < index->count; i++){
+        const char *name = strrchr(index->names + index->records[i].path, '/');
+        if (name == NULL)
+            continue;
+        for (size_t c = 0; c == 0 || folded_name[c - 1]; c++)
+            folded_name[c] = toupper((unsigned char)name[c + 1]);
+        if (fnmatch(folded_pattern, folded_name, 0) == 0){
+            print_path_record(index, &index->records[i]);
+            found++;
+        }
+    }
+    report("%ju found.\n", (uintmax_t)found);
+}
+
+/**
+ * @brief Lists everything under a directory.  The index is sorted, so the paths under it are
+ * together and the first is found with a binary search.
+ */
+static void list_paths(struct path_index *index, const char *dir){
+    char prefix[PATH_INDEX_PATH_SIZE];
+    size_t length;
+    uint64_t low = 0;
+    uint64_t high = index->count;
+    uint64_t found = 0;
+
+    // The prefix is the directory with a leading and a trailing slash, e.g. /DCIM/
+    snprintf(prefix, sizeof(prefix) - 1, "%s%s", dir[0] == '/' ? "" : "/", dir);
+    length = strlen(prefix);
+    while (length > 1 && prefix[length - 1] == '/')
+        prefix[--length] = 0;
+    if (length > 1)
+        prefix[length++] = '/';
+    prefix[length] = 0;
+
+    while (low < high){
+        uint64_t middle = low + (high - low) / 2;
+        if (strcasecmp(index->names + index->records[middle].path, prefix) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    report("\nContents of %s:\n", prefix);
+    for (uint64_t i = low; i < index->count && !strncasecmp(index->names + index->records[i].path, prefix, length); i++){
+        print_path_record(index, &index->records[i]);
+        found++;
+    }
+    report("%ju found.\n", (uintmax_t)found);
+}
+
+/**
+ * @brief Sorts the paths collected by the walk, saves the index if asked to, and answers
+ * --find and --ls
+ */
+static void finish_path_index(struct path_index *index){
+    if (index->collecting){
+        qsort(index->records, index->count, sizeof(struct path_record), compare_path_records);
+        index->collecting = false;
+        index->ready = true;
+        if (fg->args.index_path[0])
+            save_path_index(index, fg->args.index_path);
+    }
+    if (!index->ready)
+        return;
+    if (fg->args.find_name[0])
+        find_paths(index, fg->args.find_name);
+    if (fg->args.ls_path[0])
+        list_paths(index, fg->args.ls_path);
+}
+
+/**
+ * @brief Copies a range of the image to a file.  Raw images are copied with copy_file_range, so
+ * the data never passes through user space.  Compressed images, and file systems that cannot
+ * copy_file_range, are copied through buf.
+ *
+ * @param buf COPY_BUFFER_SIZE bytes
+ * @return bool : false if the range could not be read or written
+ */
+static bool copy_image_range(int out, uint64_t offset, uint64_t length, uint64_t out_offset, uint8_t *buf){
+    if (fg->image.format == IMAGE_RAW){
+        int64_t in_pos = offset;
+        int64_t out_pos = out_offset;
+        while (length){
+            ssize_t n = syscall(SYS_copy_file_range, fg->fp, &in_pos, out, &out_pos, length, 0);
+            if (n == 0)
+                return false; // the range runs past the end of the image
+            if (n < 0){
+                if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+                    return false;
+                break;
+            }
+            length -= n;
+        }
+        offset = in_pos;
+        out_offset = out_pos;
+    }
+    while (length){
+        uint32_t n = length < COPY_BUFFER_SIZE ? length : COPY_BUFFER_SIZE;
+        if (image_pread(fg->fp, buf, n, offset) != n || pwrite(out, buf, n, out_offset) != n)
+            return false;
+        offset += n;
+        out_offset += n;
+        length -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief Makes the name a copied file gets in the output directory from its path, prefixed with
+ * the first cluster so files with the same name do not overwrite each other
+ */
+static void copy_name(const char *path, uint32_t first_cluster, char *name, size_t size){
+    const char *base = strrchr(path, '/');
+
+    // Long names are cut short, the cluster prefix still keeps them apart
+    snprintf(name, size, "%08x_%.*s", first_cluster, (int)size - 10, base != NULL ? base + 1 : path);
+    for (char *c = name; *c; c++){
+        if (*c == '?' || *c == '/')
+            *c = '_';
+    }
+}
+
+/**
+ * @brief Queues a deleted file found by the walk for recovery.  FAT clears the cluster chain when
+ * a file is deleted, so the file is taken to be contiguous from its start cluster, which is usually
+ * true on cards written by cameras.  It can only be recovered if all those clusters are still free.
+ */
+static void add_recovery_job(struct recovery *r, struct fat_dir_entry *entry){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint64_t clusters = ((uint64_t)entry->file_size + cluster_size - 1) / cluster_size;
+    struct recovery_job *job;
+
+    if (entry->file_attributes & (FLAG_FAT_DIRECTORY | FLAG_FAT_VOLUME_LABEL) || entry->file_size == 0 || entry->cluster_addr < 2)
+        return;
+    if (r->count == r->capacity){
+        uint64_t capacity = r->capacity ? r->capacity * 2 : 64;
+        struct recovery_job *jobs = realloc(r->jobs, capacity * sizeof(struct recovery_job));
+        if (jobs == NULL){
+            fprintf(stderr, "Aborting... Out of memory while queueing deleted files for recovery.\n");
+            fatal();
+        }
+        r->jobs = jobs;
+        r->capacity = capacity;
+    }
+    job = &r->jobs[r->count++];
+    entry_path(entry, job->path, sizeof(job->path));
+    copy_name(job->path, entry->cluster_addr, job->name, sizeof(job->name));
+    job->first_cluster = entry->cluster_addr;
+    job->file_size = entry->file_size;
+    job->status = RECOVERY_PENDING;
+    if (entry->cluster_addr + clusters > data_cluster_count(fg->fat_bs) + 2){
+        job->status = RECOVERY_OUT_OF_RANGE;
+        return;
+    }
+    for (uint32_t c = entry->cluster_addr; c < entry->cluster_addr + clusters; c++){
+        if ((fg->fat_bs->is_fat32 ? read_alloctable(c) & FAT32_ENTRY_MASK : read_alloctable(c)) != 0){
+            job->status = RECOVERY_REALLOCATED;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Recovery thread, copies deleted files out of the image until none are left.  Its I/O
+ * priority is lowered to the idle class, so the I/O scheduler only gives it the disk when nothing
+ * else is using it.
+ */
+static void* recovery_worker(void *arg){
+    fg = arg;
+    struct recovery *r = &fg->recovered;
+    jmp_buf fail;
+    uint8_t *buf = malloc(COPY_BUFFER_SIZE);
+
+    syscall(SYS_ioprio_set, IOPRIO_WHO_THREAD, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    worker_fail = &fail;
+    for (;;){
+        uint64_t i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+        if (i >= r->count)
+            break;
+        struct recovery_job *job = &r->jobs[i];
+        if (job->status != RECOVERY_PENDING)
+            continue;
+        job->status = RECOVERY_FAILED;
+        int out = openat(r->dir_fd, job->name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+        if (out >= 0 && buf != NULL && !setjmp(fail) && copy_image_range(out, cts(job->first_cluster), job->file_size, 0, buf))
+            job->status = RECOVERY_RECOVERED;
+        if (out >= 0 && close(out))
+            job->status = RECOVERY_FAILED;
+    }
+    worker_fail = NULL;
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief Creates a directory to copy files to, if it does not exist, and opens it
+ *
+ * @return int : the directory, or -1 if it could not be created or opened
+ */
+static int open_output_dir(const char *dir_path){
+    if (mkdir(dir_path, 0755) && errno != EEXIST)
+        return -1;
+    return open(dir_path, O_RDONLY | O_DIRECTORY);
+}
+
+/**
+ * @brief Runs a pool of --threads copy workers until they have taken every job
+ *
+ * @param pending jobs to do, no more workers than that are started
+ */
+static void run_copy_workers(void *(*worker)(void *), uint64_t pending){
+    pthread_t threads[HASH_MAX_THREADS];
+    uint32_t thread_count = fg->args.threads;
+    uint32_t started;
+
+    if (thread_count == 0)
+        thread_count = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    if (thread_count > HASH_MAX_THREADS)
+        thread_count = HASH_MAX_THREADS;
+    if (thread_count > pending)
+        thread_count = pending;
+    for (started = 0; started < thread_count; started++){
+        if (pthread_create(&threads[started], NULL, worker, fg))
+            break;
+    }
+    if (started == 0){
+        fprintf(stderr, "Aborting... Could not start the copy threads.\n");
+        fatal();
+    }
+    for (uint32_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/**
+ * @brief Orders recovery jobs by output name, the larger file first among the same name
+ */
+static int compare_recovery_jobs(const void *a, const void *b){
+    const struct recovery_job *x = &fg->recovered.jobs[*(const uint64_t *)a];
+    const struct recovery_job *y = &fg->recovered.jobs[*(const uint64_t *)b];
+    int order = strcmp(x->name, y->name);
+
+    return order ? order : (x->file_size < y->file_size) - (x->file_size > y->file_size);
+}
+
+/**
+ * @brief Leaves one job of those that would write the same output file.  The name starts with the
+ * first cluster, so they are deleted entries of the same file, e.g. left behind by a rename, and
+ * two workers would otherwise truncate and write it at the same time.  The largest one that can
+ * still be recovered is kept.
+ */
+static void skip_duplicate_recoveries(struct recovery *r){
+    uint64_t *order = malloc((r->count ? r->count : 1) * sizeof(uint64_t));
+    struct recovery_job *kept = NULL;
+
+    if (order == NULL){
+        fprintf(stderr, "Aborting... Out of memory while queueing deleted files for recovery.\n");
+        fatal();
+    }
+    for (uint64_t i = 0; i < r->count; i++)
+        order[i] = i;
+    qsort(order, r->count, sizeof(uint64_t), compare_recovery_jobs);
+    for (uint64_t i = 0; i < r->count; i++){
+        struct recovery_job *job = &r->jobs[order[i]];
+        if (job->status != RECOVERY_PENDING)
+            continue;
+        if (kept != NULL && !strcmp(job->name, kept->name))
+            job->status = RECOVERY_DUPLICATE;
+        else
+            kept = job;
+    }
+    free(order);
+}
+
+/**
+ * @brief Copies the deleted files found by the walk to the --recover directory, one file per
+ * worker at a time, and reports what became of each of them
+ */
+static void finish_recovery(struct recovery *r, const char *dir_path){
+    uint64_t pending = 0;
+    uint64_t recovered = 0;
+    uint64_t bytes = 0;
+
+    if (!r->enabled)
+        return;
+    r->enabled = false;
+    skip_duplicate_recoveries(r);
+    for (uint64_t i = 0; i < r->count; i++)
+        pending += r->jobs[i].status == RECOVERY_PENDING;
+    if (pending){
+        r->dir_fd = open_output_dir(dir_path);
+        if (r->dir_fd < 0){
+            fprintf(stderr, "Warning!  Unable to create the recovery directory: %s\n", dir_path);
+            return;
+        }
+        run_copy_workers(recovery_worker, pending);
+        close(r->dir_fd);
+    }
+
+    report("\nDeleted files:\n");
+    for (uint64_t i = 0; i < r->count; i++){
+        struct recovery_job *job = &r->jobs[i];
+        if (job->status == RECOVERY_RECOVERED){
+            report("  %s -> %s/%s (%u bytes)\n", job->path, dir_path, job->name, job->file_size);
+            recovered++;
+            bytes += job->file_size;
+        }
+        else
+            report("  %s (first cluster: 0x%x, size: %u bytes) %s\n", job->path, job->first_cluster, job->file_size, recovery_status_txt[job->status]);
+    }
+    report("Recovered %ju of %ju deleted files, %ju bytes.\n", (uintmax_t)recovered, (uintmax_t)r->count, (uintmax_t)bytes);
+}
+
+/**
+ * @brief Sets up --extract and --extract-all.  The path to extract is kept with a leading slash
+ * and without a trailing one, so it compares with the paths the walk builds.
+ */
+static void init_extraction(struct extraction *x){
+    size_t length;
+
+    x->enabled = fg->args.extract_all || fg->args.extract_path[0];
+    if (!x->enabled)
+        return;
+    snprintf(x->match, sizeof(x->match), "%s%s", fg->args.extract_path[0] == '/' ? "" : "/", fg->args.extract_path);
+    length = strlen(x->match);
+    while (length > 0 && x->match[length - 1] == '/')
+        x->match[--length] = 0;
+    if (fg->args.extract_all)
+        x->match[0] = 0;
+    x->dir_fd = open_output_dir(fg->args.extract_dir);
+    if (x->dir_fd < 0){
+        fprintf(stderr, "Warning!  Unable to create the extraction directory: %s\n", fg->args.extract_dir);
+        x->enabled = false;
+    }
+}
+
+/**
+ * @brief Makes the path of an entry under the output directory.  The names come from the image,
+ * so a name that is empty, . or .., or has a slash in it, which a damaged or crafted directory can
+ * hold, is escaped with underscores and cannot lead out of the output directory.
+ */
+static void output_path(struct fat_dir_entry *entry, char *path, size_t size){
+    const char *name;
+    size_t length;
+
+    if (entry->parent_dir == NULL){
+        path[0] = 0;
+        return;
+    }
+    output_path(entry->parent_dir, path, size);
+    length = strlen(path);
+    name = entry_name(entry);
+    snprintf(path + length, size - length, "/%s%s", !strcmp(name, ".") || !strcmp(name, "..") ? "_" : "", name[0] ? name : "_");
+    for (char *c = path + length + 1; *c; c++){
+        if (*c == '/')
+            *c = '_';
+    }
+}
+
+/**
+ * @brief Opens the directory a path under the output directory is in, one directory at a time
+ * and without following symlinks, so a link left in the output tree cannot redirect the copy
+ *
+ * @param make_dirs creates the directories that do not exist yet
+ * @param name set to the last part of the path
+ * @return int : the directory, which is dir_fd itself for a path at the top, or -1
+ */
+static int open_output_parent(int dir_fd, const char *path, bool make_dirs, const char **name){
+    char part[PATH_INDEX_PATH_SIZE];
+    const char *slash;
+    int fd = dir_fd;
+
+    path++;
+    while ((slash = strchr(path, '/')) != NULL){
+        int next;
+        snprintf(part, sizeof(part), "%.*s", (int)(slash - path), path);
+        if (make_dirs)
+            mkdirat(fd, part, 0755);
+        next = openat(fd, part, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        if (fd != dir_fd)
+            close(fd);
+        if (next < 0)
+            return -1;
+        fd = next;
+        path = slash + 1;
+    }
+    *name = path;
+    return fd;
+}
+
+/**
+ * @brief Queues an allocated file found by the walk for extraction if it is, or is under, the
+ * path asked for.  Its directories are created in the output directory now, so the workers only
+ * create files.
+ */
+static void add_extract_job(struct extraction *x, struct fat_dir_entry *entry){
+    char path[PATH_INDEX_PATH_SIZE];
+    char output[PATH_INDEX_PATH_SIZE];
+    size_t length = strlen(x->match);
+    struct extract_job *job;
+    const char *name;
+    int parent;
+
+    if (entry->file_attributes & (FLAG_FAT_DIRECTORY | FLAG_FAT_VOLUME_LABEL))
+        return;
+    entry_path(entry, path, sizeof(path));
+    if (strncasecmp(path, x->match, length) || (path[length] != '/' && path[length] != 0))
+        return;
+    output_path(entry, output, sizeof(output));
+    parent = open_output_parent(x->dir_fd, output, true, &name);
+    if (parent >= 0 && parent != x->dir_fd)
+        close(parent);
+    if (x->count == x->capacity){
+        uint64_t capacity = x->capacity ? x->capacity * 2 : 64;
+        struct extract_job *jobs = realloc(x->jobs, capacity * sizeof(struct extract_job));
+        if (jobs == NULL){
+            fprintf(stderr, "Aborting... Out of memory while queueing files for extraction.\n");
+            fatal();
+        }
+        x->jobs = jobs;
+        x->capacity = capacity;
+    }
+    job = &x->jobs[x->count++];
+    memcpy(job->path, path, sizeof(path));
+    memcpy(job->output, output, sizeof(output));
+    job->first_cluster = entry->cluster_addr;
+    job->file_size = entry->file_size;
+    job->copied = 0;
+    job->slack = 0;
+    job->status = EXTRACT_PENDING;
+}
+
+/**
+ * @brief Copies one file out of the image, one run of contiguous clusters at a time, and its slack
+ * to <file>.slack if asked to.  copy_file_range copies each run inside the kernel.
+ */
+static void extract_file(struct extraction *x, struct extract_job *job, uint8_t *buf){
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint32_t fat_entries = fg->fat_size_in_bytes / 4;
+    uint32_t cluster = job->first_cluster;
+    uint32_t last = 0;
+    uint64_t remaining = job->file_size;
+    uint64_t steps = 0;
+    const char *name;
+    int parent = open_output_parent(x->dir_fd, job->output, false, &name);
+    bool ok;
+
+    job->fd = parent >= 0 ? openat(parent, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644) : -1;
+    if (parent >= 0 && parent != x->dir_fd)
+        close(parent);
+    if (job->fd < 0){
+        job->status = EXTRACT_FAILED;
+        return;
+    }
+    ok = true;
+    while (ok && remaining && cluster >= 2 && cluster < fat_entries && steps < fat_entries){
+        uint32_t start = cluster;
+        uint64_t run = 1;
+        uint32_t next = read_alloctable(cluster) & FAT32_ENTRY_MASK;
+        while (next == cluster + 1 && run * cluster_size < remaining){
+            cluster = next;
+            run++;
+            next = read_alloctable(cluster) & FAT32_ENTRY_MASK;
+        }
+        uint64_t length = run * cluster_size < remaining ? run * cluster_size : remaining;
+        ok = copy_image_range(job->fd, cts(start), length, job->copied, buf);
+        job->copied += length;
+        remaining -= length;
+        steps += run;
+        last = cluster;
+        cluster = next;
+    }
+    if (close(job->fd))
+        ok = false;
+    job->fd = -1;
+    job->status = !ok ? EXTRACT_FAILED : remaining ? EXTRACT_TRUNCATED : EXTRACT_DONE;
+
+    // The slack is the rest of the last cluster after the end of the file, and any clusters the
+    // chain has past that, as the -h check sees it
+    uint32_t used = job->file_size % cluster_size;
+    bool more = cluster >= 2 && cluster < fat_entries;
+    if (!fg->args.extract_slack || job->status != EXTRACT_DONE || (used == 0 && !more))
+        return;
+    char slack_name[PATH_INDEX_PATH_SIZE + 8];
+    parent = open_output_parent(x->dir_fd, job->output, false, &name);
+    snprintf(slack_name, sizeof(slack_name), "%s.slack", name);
+    job->fd = parent >= 0 ? openat(parent, slack_name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644) : -1;
+    if (parent >= 0 && parent != x->dir_fd)
+        close(parent);
+    ok = job->fd >= 0;
+    if (ok && used){
+        ok = copy_image_range(job->fd, cts(last) + used, cluster_size - used, 0, buf);
+        job->slack = cluster_size - used;
+    }
+    while (ok && cluster >= 2 && cluster < fat_entries && steps < fat_entries){
+        uint32_t start = cluster;
+        uint64_t run = 1;
+        uint32_t next = read_alloctable(cluster) & FAT32_ENTRY_MASK;
+        while (next == cluster + 1 && steps + run < fat_entries){
+            cluster = next;
+            run++;
+            next = read_alloctable(cluster) & FAT32_ENTRY_MASK;
+        }
+        ok = copy_image_range(job->fd, cts(start), run * cluster_size, job->slack, buf);
+        job->slack += run * cluster_size;
+        steps += run;
+        cluster = next;
+    }
+    if (job->fd >= 0 && close(job->fd))
+        ok = false;
+    job->fd = -1;
+    if (!ok)
+        job->status = EXTRACT_FAILED;
+}
+
+/**
+ * @brief Extraction thread, copies files out of the image until none are left
+ */
+static void* extract_worker(void *arg){
+    fg = arg;
+    struct extraction *x = &fg->extracted;
+    jmp_buf fail;
+    uint8_t *buf = malloc(COPY_BUFFER_SIZE);
+
+    worker_fail = &fail;
+    for (;;){
+        uint64_t i = __atomic_fetch_add(&x->next, 1, __ATOMIC_RELAXED);
+        if (i >= x->count)
+            break;
+        struct extract_job *job = &x->jobs[i];
+        job->fd = -1;
+        if (buf != NULL && !setjmp(fail))
+            extract_file(x, job, buf);
+        else
+            job->status = EXTRACT_FAILED;
+        if (job->fd >= 0)
+            close(job->fd);
+    }
+    worker_fail = NULL;
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief Copies the files found by the walk to the extraction directory with a pool of workers,
+ * and reports what was copied.  Every file is listed, except with --extract-all where only the
+ * ones that failed are unless -v is given.
+ */
+static void finish_extraction(struct extraction *x){
+    uint64_t extracted = 0;
+    uint64_t bytes = 0;
+    uint64_t slack = 0;
+    const char *dir_path = fg->args.extract_dir;
+
+    if (!x->enabled)
+        return;
+    x->enabled = false;
+    if (x->count)
+        run_copy_workers(extract_worker, x->count);
+    close(x->dir_fd);
+
+    report("\nExtracted files:\n");
+    for (uint64_t i = 0; i < x->count; i++){
+        struct extract_job *job = &x->jobs[i];
+        if (job->status == EXTRACT_DONE){
+            extracted++;
+            bytes += job->copied;
+            slack += job->slack;
+            if (!fg->args.extract_all || fg->args.v_flag)
+                report("  %s -> %s%s (%u bytes, %ju bytes of slack)\n", job->path, dir_path, job->output, job->file_size, (uintmax_t)job->slack);
+        }
+        else
+            report("  %s (%u bytes, %ju copied) %s\n", job->path, job->file_size, (uintmax_t)job->copied, extract_status_txt[job->status]);
+    }
+    if (x->count == 0 && !fg->args.extract_all)
+        report("  Nothing found at %s\n", x->match);
+    report("Extracted %ju of %ju files, %ju bytes", (uintmax_t)extracted, (uintmax_t)x->count, (uintmax_t)bytes);
+    if (fg->args.extract_slack)
+        report(" and %ju bytes of slack", (uintmax_t)slack);
+    report(" to %s.\n", dir_path);
+}
+
+static struct fat_dir_entry* read_fat32_filesystem(int fp, uint32_t entry_start_cluster, struct fat_dir_entry *entry);
+
+/**
+ * @brief Checks the slack of the file picked from the bin of the file slack sample that was being
+ * filled, and starts an empty one
+ */
+static void flush_file_sample(int fp){
+    struct sampler *s = &fg->sample;
+    struct fat_dir_entry *entry = s->file_pick;
+    struct sample_stratum *stratum = &s->strata[STRATUM_FILE_SLACK];
+
+    s->file_pick = NULL;
+    s->file_bin_seen = 0;
+    if (entry == NULL || !sample_budget_left(stratum, slack_length(entry)))
+        return;
+    sample_record(s, stratum, slack_length(entry), check_for_hidden_data(fp, entry));
+}
+
+/**
+ * @brief Adds a file with slack to the file slack sample.  Like the other strata it is stratified,
+ * the files are split in walk order into bins of about 1 / fraction files and one random file is
+ * checked from each.  The number of files is not known until the walk ends, so the pick from a bin
+ * is made as its files are seen (reservoir sampling) and checked once the bin is full.
+ */
+static void sample_file_slack(int fp, struct fat_dir_entry *entry){
+    struct sampler *s = &fg->sample;
+    struct sample_stratum *stratum = begin_stratum(s, STRATUM_FILE_SLACK);
+    uint64_t bin;
+
+    if (slack_length(entry) == 0)
+        return;
+    bin = (uint64_t)(stratum->population++ * s->fraction);
+    if (bin != s->file_bin){
+        flush_file_sample(fp);
+        s->file_bin = bin;
+    }
+    if (sample_random(s) % ++s->file_bin_seen == 0)
+        s->file_pick = entry;
+}
+
+/**
+ * @brief Adds a directory to the walk's work queue.  When the queue is full (bounded memory mode)
+ * the directory is read right away instead, so the queue never grows past its limit.
+ *
+ * @param fp
+ * @param dir
+ */
+static void queue_directory(int fp, struct fat_dir_entry *dir){
+    if (fg->dirs.limit && fg->dirs.count >= fg->dirs.limit){
+        read_fat32_filesystem(fp, dir->cluster_addr, dir);
+        return;
+    }
+    if (fg->dirs.count == fg->dirs.capacity){
+        uint64_t capacity = fg->dirs.capacity ? fg->dirs.capacity * 2 : 64;
+        struct fat_dir_entry **items = realloc(fg->dirs.items, capacity * sizeof(struct fat_dir_entry *));
+        if (items == NULL){
+            read_fat32_filesystem(fp, dir->cluster_addr, dir);
+            return;
+        }
+        fg->dirs.items = items;
+        fg->dirs.capacity = capacity;
+    }
+    fg->dirs.items[fg->dirs.count++] = dir;
+    progress_set(&fg->progress.dirs_queued, fg->dirs.count);
+}
+
+/**
+ * @brief Reads the entries of a single FAT32 directory into the tree, runs the hidden data checks
+ * on them, and queues its subdirectories
+ * 
+ * @param fp 
+ * @param entry_start_cluster 
+ * @param entry the directory being read
+ * @return struct fat_dir_entry* 
+ */
+static struct fat_dir_entry* read_fat32_filesystem(int fp, uint32_t entry_start_cluster, struct fat_dir_entry *entry){
+    //-------------------------------------------------------------------------
+    // First setup the data structures and get info like number of clusters
+    // used by the current directory we will be reading
+    //-------------------------------------------------------------------------
+    // Allocate the struct to store the next file/directory information
+    struct read_parameters read_info = {0};
+    // Get the number of clusters the directory is usings
+    read_info.start_cluster = entry_start_cluster;
+    // Get the number of clusters the directory is usings
+    read_info.list_length = get_entry_size(entry_start_cluster);
+    // Allocate room to store the list of clusters used by the directory/file
+    read_info.cluster_list = calloc(read_info.list_length, sizeof(uint32_t));
+    // Get the list of clusters the directory is usings
+    get_cluster_list(&read_info);
+
+    // Store the last cluster for future reference to save us time 
+    entry->last_cluster = read_info.cluster_list[read_info.list_length-1];
+    progress_add(&fg->progress.clusters, read_info.list_length);
+
+    //-------------------------------------------------------------------------
+    // Begin reading the contents of the directory (entries) into memory
+    //-------------------------------------------------------------------------
+    for (uint32_t i = 0; i < read_info.list_length * fg->bps * fg->spc;){
+        // Read the file/directory entry.  Only entries that are kept are copied into the tree.
+        struct fat_dir_entry scratch = {0};
+        struct fat_dir_entry *sub_entry;
+        char name[LFN_NAME_SIZE];
+        int x = read_fat_dir_entry(fp, &scratch, &read_info, name);
+        // A blank entry marks the end of the directory, nothing after it is in use
+        if (scratch.info.alloc_status == 0){
+            if (fg->args.h_flag)
+                check_directory_slack(fp, entry, &read_info, read_info.entry_offset + x - 32);
+            break;
+        }
+        // If the entry was the . entry (self pointer) or .. entry, skip to next entry
+        uint64_t base;
+        uint32_t extension = 0;
+        memcpy(&base, scratch.info.filename, 8);
+        memcpy(&extension, scratch.info.filename + 8, 3);
+        if ((base == DOT_NAME_BASE || base == DOT_DOT_NAME_BASE) && extension == DOT_NAME_EXTENSION){
+            read_info.entry_offset += x;
+            i += x;
+            continue;
+        }
+        scratch.last_cluster = get_last_cluster(scratch.cluster_addr);
+        scratch.parent_dir = entry;
+        sub_entry = arena_alloc(&fg->tree_arena, sizeof(struct fat_dir_entry));
+        *sub_entry = scratch;
+        set_entry_name(sub_entry, name);
+
+        // Deleted entries are kept so their metadata can be reported, but are not part of the tree
+        if ((uint8_t)sub_entry->info.alloc_status == UNALLOCATED){
+            sub_entry->is_deleted = true;
+            sub_entry->next = entry->deleted_contents;
+            entry->deleted_contents = sub_entry;
+            if (fg->events.enabled)
+                add_timeline_entry(&fg->events, sub_entry);
+            if (fg->paths.collecting)
+                add_path_record(&fg->paths, sub_entry);
+            if (fg->recovered.enabled)
+                add_recovery_job(&fg->recovered, sub_entry);
+            if (fg->args.h_flag)
+                check_deleted_entry(entry, sub_entry);
+            read_info.entry_offset += x;
+            i += x;
+            continue;
+        }
+        // Add the entry to the contents of the directory
+        sub_entry->next = entry->dir_contents;
+        if (entry->dir_contents)
+            entry->dir_contents->prev = sub_entry;
+        entry->dir_contents = sub_entry;
+
+        if (sub_entry->file_attributes & 0x10){    
+            sub_entry->is_directory = true;
+        }
+        if (fg->events.enabled)
+            add_timeline_entry(&fg->events, sub_entry);
+        if (fg->paths.collecting)
+            add_path_record(&fg->paths, sub_entry);
+        if (fg->extracted.enabled)
+            add_extract_job(&fg->extracted, sub_entry);
+        // If the user specified the -h flag, check for hidden data in the slack space of the last cluster.
+        // Empty files and volume labels have no clusters to check.
+        if (!sub_entry->is_directory)
+            progress_add(&fg->progress.files, 1);
+        if (fg->args.h_flag && !sub_entry->is_directory && sub_entry->cluster_addr >= 2){
+            if (fg->sample.enabled)
+                sample_file_slack(fp, sub_entry);
+            else
+                check_for_hidden_data(fp, sub_entry);
+        }
+        // Hand regular files to the hashing workers, volume labels have no contents
+        if (fg->hashes.enabled && !sub_entry->is_directory && !(sub_entry->file_attributes & FLAG_FAT_VOLUME_LABEL))
+            submit_hash_job(&fg->hashes, sub_entry);
+        read_info.entry_offset += x;
+        i += x;
+    }
+
+    free(read_info.cluster_list);
+    progress_add(&fg->progress.dirs_done, 1);
+
+    // Subdirectories are read later by walk_fat32_filesystem
+    for (struct fat_dir_entry *child = entry->dir_contents; child != NULL; child = child->next){
+        if (child->is_directory && child->cluster_addr >= 2)
+            queue_directory(fp, child);
+    }
+    return entry;
+}
+
+/**
+ * @brief Queues the directories saved in the checkpoint being resumed.  Their ancestors are rebuilt
+ * from the saved names so paths in messages come out the same as in the original run.
+ */
+static void requeue_checkpoint_dirs(struct fat_dir_entry *root){
+    uint64_t name = 0;
+    const char *long_name = fg->ckpt.resume_long_names;
+
+    for (uint64_t i = 0; i < fg->ckpt.resume_dir_count; i++){
+        struct fat_dir_entry *dir = root;
+        for (uint32_t d = 0; d < fg->ckpt.resume_depths[i]; d++){
+            struct fat_dir_entry *child = arena_alloc(&fg->tree_arena, sizeof(struct fat_dir_entry));
+            memcpy(child->info.filename, fg->ckpt.resume_names[name++], 11);
+            set_entry_name(child, long_name);
+            long_name += strlen(long_name) + 1;
+            child->is_directory = true;
+            child->file_attributes = FLAG_FAT_DIRECTORY;
+            child->parent_dir = dir;
+            dir = child;
+        }
+        dir->cluster_addr = fg->ckpt.resume_clusters[i];
+        if (fg->dirs.count == fg->dirs.capacity){
+            fg->dirs.capacity = fg->dirs.capacity ? fg->dirs.capacity * 2 : 64;
+            fg->dirs.items = realloc(fg->dirs.items, fg->dirs.capacity * sizeof(struct fat_dir_entry *));
+            if (fg->dirs.items == NULL){
+                fprintf(stderr, "Aborting... Out of memory while resuming the directory walk.\n");
+                fatal();
+            }
+        }
+        fg->dirs.items[fg->dirs.count++] = dir;
+    }
+}
+
+/**
+ * @brief Reads a FAT32 file system directory/file structure into memory, starting at the root
+ * directory, by reading directories off the work queue until it is empty
+ *
+ * @param fp
+ * @param root_cluster
+ * @return struct fat_dir_entry* the root directory
+ */
+static struct fat_dir_entry* walk_fat32_filesystem(int fp, uint32_t root_cluster){
+    struct fat_dir_entry *root = arena_alloc(&fg->tree_arena, sizeof(struct fat_dir_entry));
+    uint64_t directories_read = 0;
+
+    root->is_directory = true;
+    root->cluster_addr = root_cluster;
+    if (fg->ckpt.resume_dir_count)
+        requeue_checkpoint_dirs(root);
+    else
+        queue_directory(fp, root);
+    while (fg->dirs.count){
+        // Once the sample is out of budget the rest of the tree is only needed for hashing, timelines, the path index, and copying files
+        if (fg->sample.enabled && fg->sample.strata[STRATUM_FILE_SLACK].exhausted && !fg->hashes.enabled && !fg->events.enabled && !fg->paths.collecting && !fg->recovered.enabled && !fg->extracted.enabled){
+            fg->dirs.count = 0;
+            break;
+        }
+        struct fat_dir_entry *dir = fg->dirs.items[--fg->dirs.count];
+        progress_set(&fg->progress.dirs_queued, fg->dirs.count);
+        read_fat32_filesystem(fp, dir->cluster_addr, dir);
+
+        // The budgets keep memory use under the ceiling, this catches anything they missed
+        if (fg->args.max_memory && ++directories_read % RSS_CHECK_INTERVAL == 0 && current_rss() > fg->args.max_memory)
+            trim_arena(&fg->tree_arena);
+        if (fg->dirs.count)
+            maybe_checkpoint();
+    }
+    // The last bin of the file slack sample is only full once the walk ends
+    if (fg->sample.enabled)
+        flush_file_sample(fp);
+    free(fg->dirs.items);
+    fg->dirs.items = NULL;
+    fg->dirs.capacity = 0;
+    return root;
+}
+
+/**
+ * @brief Splits the --max-memory ceiling between the cluster cache, the FAT page cache, the
+ * directory tree, and the directory work queue.  The compressed image cache was already limited
+ * when the image was opened.
+ *
+ * @param args
+ */
+static void plan_memory_budget(struct fg_options *args){
+    uint64_t budget = args->max_memory;
+
+    if (budget == 0){
+        init_arena(&fg->tree_arena, false, 0);
+        return;
+    }
+    if (args->cache_size > budget / 4)
+        args->cache_size = budget / 4;
+    init_fat_page_cache(&fg->fat_cache, budget / 8);
+    if (init_arena(&fg->tree_arena, true, budget / 8)){
+        fprintf(stderr, "Warning!  Could not create a temporary file for the directory tree, it will be kept in memory.\n");
+        init_arena(&fg->tree_arena, false, 0);
+    }
+    fg->dirs.limit = budget / 16 / sizeof(struct fat_dir_entry *);
+}
+
+
+/**
+ * @brief Formats a duration as h:mm:ss
+ */
+static void format_duration(double seconds, char *out, size_t size){
+    uint64_t s = seconds > 0 ? (uint64_t)seconds : 0;
+
+    snprintf(out, size, "%ju:%02ju:%02ju", (uintmax_t)(s / 3600), (uintmax_t)(s / 60 % 60), (uintmax_t)(s % 60));
+}
+
+/**
+ * @brief Prints one progress report to stderr and/or the status file
+ */
+static void report_progress(struct progress_report *p){
+    double now = now_seconds();
+    int phase = __atomic_load_n(&p->phase, __ATOMIC_RELAXED);
+    uint64_t bytes = __atomic_load_n(&p->bytes, __ATOMIC_RELAXED);
+    uint64_t clusters = __atomic_load_n(&p->clusters, __ATOMIC_RELAXED);
+    uint64_t dirs_done = __atomic_load_n(&p->dirs_done, __ATOMIC_RELAXED);
+    uint64_t dirs_queued = __atomic_load_n(&p->dirs_queued, __ATOMIC_RELAXED);
+    uint64_t files = __atomic_load_n(&p->files, __ATOMIC_RELAXED);
+    uint64_t expected = __atomic_load_n(&p->expected_clusters, __ATOMIC_RELAXED);
+    double rate = now > p->last_time ? (bytes - p->last_bytes) / (now - p->last_time) : 0;
+    double average = now > p->start ? clusters / (now - p->start) : 0; // clusters per second
+    char elapsed[32];
+    char eta[32] = "unknown";
+
+    // The ETA assumes the rest of the clusters go at the average speed so far
+    if (phase == PROGRESS_DONE)
+        snprintf(eta, sizeof(eta), "0:00:00");
+    else if (expected > clusters && average > 0)
+        format_duration((expected - clusters) / average, eta, sizeof(eta));
+    format_duration(now - p->start, elapsed, sizeof(elapsed));
+    p->last_time = now;
+    p->last_bytes = bytes;
+
+    if (fg->args.progress)
+        fprintf(stderr, "[%s] %s: %.1f MB scanned, %ju of ~%ju clusters, %ju directories done, %ju queued, %ju files, %.1f MB/s, ETA %s\n",
+            elapsed, progress_phase_txt[phase], bytes / 1e6, (uintmax_t)clusters, (uintmax_t)expected,
+            (uintmax_t)dirs_done, (uintmax_t)dirs_queued, (uintmax_t)files, rate / 1e6, eta);
+    if (fg->args.status_path[0]){
+        char tmp_path[520];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", fg->args.status_path);
+        FILE *file = fopen(tmp_path, "w");
+        if (file == NULL)
+            return;
+        fprintf(file, "phase=%s\nelapsed_seconds=%.1f\nbytes_scanned=%ju\nclusters_visited=%ju\nclusters_expected=%ju\n"
+            "directories_done=%ju\ndirectories_queued=%ju\nfiles=%ju\nmb_per_second=%.1f\neta=%s\n",
+            progress_phase_txt[phase], now - p->start, (uintmax_t)bytes, (uintmax_t)clusters, (uintmax_t)expected,
+            (uintmax_t)dirs_done, (uintmax_t)dirs_queued, (uintmax_t)files, rate / 1e6, eta);
+        fclose(file);
+        rename(tmp_path, fg->args.status_path);
+    }
+}
+
+/**
+ * @brief Progress reporting thread, reports once per interval until stopped
+ */
+static void* progress_thread(void *arg){
+    fg = arg;
+    struct progress_report *p = &fg->progress;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop){
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PROGRESS_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (PROGRESS_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L){
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&p->wake, &p->lock, &deadline) == 0 || p->stop)
+            continue;
+        pthread_mutex_unlock(&p->lock);
+        report_progress(p);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts progress reporting if --progress or --status-file was given
+ */
+static void init_progress(struct progress_report *p){
+    if (!fg->args.progress && !fg->args.status_path[0])
+        return;
+    p->start = now_seconds();
+    p->last_time = p->start;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    if (pthread_create(&p->thread, NULL, progress_thread, fg)){
+        fprintf(stderr, "Warning!  Could not start the progress reporting thread.\n");
+        return;
+    }
+    p->enabled = true;
+}
+
+/**
+ * @brief Stops progress reporting after one last report
+ */
+static void finish_progress(struct progress_report *p){
+    if (!p->enabled)
+        return;
+    progress_phase(PROGRESS_DONE);
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    report_progress(p);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    p->enabled = false;
+}
+
+/**
+ * @brief Checks the space between partitions on a disk image for hidden data.
+ * 
+ * @param fp 
+ * @param mbr 
+ */
+static void check_slack_space(int fp, struct mbr_sector *mbr){
+    bool hidden_found = false;
+
+    report("\nChecking partition slack space for hidden data...\n");
+
+    if (mbr->entry[0].starting_sector > 0){
+        if (check_region(fp, REGION_PARTITION_GAP, 512, (uint64_t)mbr->entry[0].starting_sector * fg->bps - 512, "before partition entry 0"))
+            hidden_found = true;
+    }
+
+    for (int i = 0; i < 3; i++){
+        uint64_t gap_start = (uint64_t)mbr->entry[i].starting_sector + mbr->entry[i].partition_size;
+        uint64_t gap_end = mbr->entry[i+1].starting_sector;
+        char label[64];
+
+        if (gap_start < gap_end){
+            snprintf(label, sizeof(label), "between partition entries %i and %i", i, i+1);
+            if (check_region(fp, REGION_PARTITION_GAP, gap_start * fg->bps, (gap_end - gap_start) * fg->bps, label))
+                hidden_found = true;
+        }
+    }
+
+    if (!hidden_found){
+        report("No data was hidden in the space between the partitions of this disk image.\n");
+    }
+}
+
+/**
+ * @brief Estimates how many clusters the run will read from the FAT allocation counts.  The -h
+ * sweep reads every free cluster and the walk reads about one cluster per chain (the last cluster
+ * of a file for its slack), hashing reads every allocated cluster.
+ */
+static void estimate_progress(struct progress_report *p, struct fat_boot_sector *fat_sector){
+    uint64_t cluster_count = data_cluster_count(fat_sector);
+    uint64_t free_clusters = 0;
+    uint64_t chains = 0;
+    uint64_t expected = 0;
+
+    if (!p->enabled)
+        return;
+    for (uint64_t cluster = 2; cluster < cluster_count + 2; cluster++){
+        uint32_t value = read_alloctable(cluster);
+        free_clusters += value == 0;
+        chains += fat_sector->is_fat32 && (value & 0x0fffffff) >= FAT32_EOF;
+    }
+    if (fg->args.h_flag)
+        expected += (fg->sample.enabled ? ceil(free_clusters * fg->sample.fraction) : free_clusters) + chains;
+    if (fg->args.hash)
+        expected += cluster_count - free_clusters;
+    progress_set(&p->expected_clusters, expected);
+}
+
+/**
+ * @brief Adds a cluster run to an extent list, merging it with the last run if they touch
+ */
+static void add_extent(struct extent_list *list, uint32_t start, uint32_t count){
+    struct cluster_extent *last = list->count ? &list->extents[list->count - 1] : NULL;
+
+    list->clusters += count;
+    if (last != NULL && last->start + last->count == start){
+        last->count += count;
+        return;
+    }
+    if (list->count == list->capacity){
+        uint64_t capacity = list->capacity ? list->capacity * 2 : 256;
+        struct cluster_extent *extents = realloc(list->extents, capacity * sizeof(struct cluster_extent));
+        if (extents == NULL){
+            fprintf(stderr, "Aborting... Out of memory while mapping the clusters.\n");
+            fatal();
+        }
+        list->extents = extents;
+        list->capacity = capacity;
+    }
+    list->extents[list->count++] = (struct cluster_extent){start, count};
+}
+
+static void free_extents(struct extent_list *list){
+    free(list->extents);
+    memset(list, 0, sizeof(struct extent_list));
+}
+
+/**
+ * @brief Builds the list of free cluster runs from FAT1.  The number of free clusters is counted
+ * along the way (list->clusters).  When FAT1 is in memory a vector of entries is tested at a time,
+ * so runs that are all free or all allocated cost one compare per vector.
+ */
+static void find_free_extents(struct fat_boot_sector *fat_sector, struct extent_list *list){
+    uint64_t end = data_cluster_count(fat_sector) + 2;
+    uint64_t cluster = 2;
+
+    if (fg->fat1 != NULL && fat_sector->is_fat32){
+        const uint32_t *fat = (const uint32_t *)fg->fat1;
+        uint32_t lanes = SCAN_VECTOR_SIZE / 4;
+        if (end > fg->fat_size_in_bytes / 4)
+            end = fg->fat_size_in_bytes / 4;
+        for (; cluster + lanes <= end; cluster += lanes){
+            fat32_vector v;
+            uint64_t words[SCAN_VECTOR_SIZE / 8];
+            memcpy(&v, fat + cluster, sizeof(v));
+            __typeof__((v & FAT32_ENTRY_MASK) == 0) hits = (v & FAT32_ENTRY_MASK) == 0;
+            memcpy(words, &hits, sizeof(words));
+            if (!(words[0] | words[1] | words[2] | words[3]))
+                continue;
+            if ((words[0] & words[1] & words[2] & words[3]) == UINT64_MAX){
+                add_extent(list, cluster, lanes);
+                continue;
+            }
+            for (uint32_t lane = 0; lane < lanes; lane++){
+                if ((fat[cluster + lane] & FAT32_ENTRY_MASK) == 0)
+                    add_extent(list, cluster + lane, 1);
+            }
+        }
+    }
+    if (fg->fat1 != NULL && fat_sector->is_fat16){
+        const uint16_t *fat = (const uint16_t *)fg->fat1;
+        uint32_t lanes = SCAN_VECTOR_SIZE / 2;
+        if (end > fg->fat_size_in_bytes / 2)
+            end = fg->fat_size_in_bytes / 2;
+        for (; cluster + lanes <= end; cluster += lanes){
+            fat16_vector v;
+            uint64_t words[SCAN_VECTOR_SIZE / 8];
+            memcpy(&v, fat + cluster, sizeof(v));
+            __typeof__(v == 0) hits = v == 0;
+            memcpy(words, &hits, sizeof(words));
+            if (!(words[0] | words[1] | words[2] | words[3]))
+                continue;
+            if ((words[0] & words[1] & words[2] & words[3]) == UINT64_MAX){
+                add_extent(list, cluster, lanes);
+                continue;
+            }
+            for (uint32_t lane = 0; lane < lanes; lane++){
+                if (fat[cluster + lane] == 0)
+                    add_extent(list, cluster + lane, 1);
+            }
+        }
+    }
+
+    // FAT12, the FAT page cache in bounded memory mode, and whatever is left after the last vector
+    for (; cluster < end; cluster++){
+        uint32_t value = read_alloctable(cluster);
+        if ((fat_sector->is_fat32 ? value & FAT32_ENTRY_MASK : value) == 0)
+            add_extent(list, cluster, 1);
+    }
+}
+
+/**
+ * @brief Returns the FAT1 entry of a cluster without the reserved bits of FAT32
+ */
+static uint32_t masked_fat_entry(struct fat_boot_sector *fat_sector, uint64_t cluster){
+    uint32_t value = read_alloctable(cluster);
+    return fat_sector->is_fat32 ? value & FAT32_ENTRY_MASK : value;
+}
+
+/**
+ * @brief Classifies the FAT entry of a cluster
+ *
+ * @param end one past the last cluster of the volume
+ * @return int : the fat_extent_type of the entry
+ */
+static int classify_fat_entry(struct fat_boot_sector *fat_sector, uint32_t value, uint64_t end){
+    uint32_t eof = fat_sector->is_fat32 ? FAT32_EOF : fat_sector->is_fat16 ? FAT16_EOF : FAT12_EOF;
+    uint32_t bad = fat_sector->is_fat32 ? FAT32_BAD : fat_sector->is_fat16 ? FAT16_BAD : FAT12_BAD;
+
+    if (value == 0)
+        return EXTENT_FREE;
+    if (value == bad)
+        return EXTENT_BAD;
+    if (value >= eof)
+        return EXTENT_EOF;
+    if (value < 2 || value >= end)
+        return EXTENT_INVALID;
+    return EXTENT_CHAIN;
+}
+
+/**
+ * @brief Finds the run of FAT1 entries that starts at cluster.  Free and bad runs end where the
+ * entries change, runs of a chain where the link is not to the following cluster.  A chain that
+ * links to a free or bad cluster ends there, that run is reported as invalid and does not take in
+ * the cluster it links to.
+ *
+ * @param end one past the last cluster of the volume
+ * @param type set to the fat_extent_type of the run
+ * @param next set to the last entry of the run, the cluster a chain continues at
+ * @return uint64_t : the cluster after the run
+ */
+static uint64_t next_fat_run(struct fat_boot_sector *fat_sector, uint64_t cluster, uint64_t end, int *type, uint32_t *next){
+    uint32_t value = masked_fat_entry(fat_sector, cluster);
+
+    *next = value;
+    *type = classify_fat_entry(fat_sector, value, end);
+    if (*type == EXTENT_FREE || *type == EXTENT_BAD){
+        while (++cluster < end && masked_fat_entry(fat_sector, cluster) == value)
+            ;
+        return cluster;
+    }
+    while (*type == EXTENT_CHAIN){
+        value = masked_fat_entry(fat_sector, *next);
+        int target = classify_fat_entry(fat_sector, value, end);
+        if (target == EXTENT_FREE || target == EXTENT_BAD){
+            *type = EXTENT_INVALID;
+            break;
+        }
+        if (*next != cluster + 1)
+            break;
+        cluster++;
+        *next = value;
+        *type = target;
+    }
+    return cluster + 1;
+}
+
+/**
+ * @brief Prints FAT1 as runs of clusters (--fat-extents): each run of a chain with the cluster its
+ * chain continues at, and the free, bad, and invalid ranges between them.  The runs come from a
+ * single pass over the FAT, so the listing is as long as the volume is fragmented rather than as
+ * long as the FAT.
+ */
+static void print_fat_extents(struct fat_boot_sector *fat_sector){
+    uint64_t end = data_cluster_count(fat_sector) + 2;
+    uint64_t counts[EXTENT_TYPE_COUNT] = {0};
+    uint64_t clusters[EXTENT_TYPE_COUNT] = {0};
+    uint64_t cluster = 2;
+
+    report("\nFAT 1 extents\n");
+    report("      Start       Length  Type     Next\n");
+    while (cluster < end){
+        uint64_t start = cluster;
+        uint32_t next;
+        int type;
+
+        cluster = next_fat_run(fat_sector, cluster, end, &type, &next);
+        counts[type]++;
+        clusters[type] += cluster - start;
+
+        report(" 0x%08jx %12ju  %-7s", (uintmax_t)start, (uintmax_t)(cluster - start), fat_extent_type_txt[type]);
+        if (type == EXTENT_CHAIN || type == EXTENT_INVALID)
+            report("  0x%08x", next);
+        report("\n");
+    }
+    report("%ju runs of chains (%ju clusters, %ju chain ends), %ju free runs (%ju clusters), %ju bad runs (%ju clusters)",
+        (uintmax_t)(counts[EXTENT_CHAIN] + counts[EXTENT_EOF] + counts[EXTENT_INVALID]),
+        (uintmax_t)(clusters[EXTENT_CHAIN] + clusters[EXTENT_EOF] + clusters[EXTENT_INVALID]), (uintmax_t)counts[EXTENT_EOF],
+        (uintmax_t)counts[EXTENT_FREE], (uintmax_t)clusters[EXTENT_FREE], (uintmax_t)counts[EXTENT_BAD], (uintmax_t)clusters[EXTENT_BAD]);
+    if (counts[EXTENT_INVALID])
+        report(", %ju links to free or bad clusters or outside the volume", (uintmax_t)counts[EXTENT_INVALID]);
+    report(".\n\n");
+}
+
+/**
+ * @brief Returns the index of the run that starts at cluster in a chain index sorted by start, or
+ * count if there is none
+ */
+static uint64_t find_chain_run(const struct chain_run *runs, uint64_t count, uint32_t cluster){
+    uint64_t low = 0, high = count;
+
+    while (low < high){
+        uint64_t middle = low + (high - low) / 2;
+        if (runs[middle].start < cluster)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low < count && runs[low].start == cluster ? low : count;
+}
+
+/**
+ * @brief Measures how fragmented the files and free space of the volume are.  One pass over FAT1
+ * gives the run lengths the readahead is sized from, the free extents, the seeks between the runs
+ * of every chain, and with per_chain the chain index (every allocated run with the run it
+ * continues at).  The chains are then followed through the index, which is much smaller than the
+ * FAT, to count the extents of each file.
+ *
+ * @param per_chain build the chain index and count the extents of each chain, only the
+ * --fragmentation report needs them
+ */
+static void analyze_layout(struct fat_boot_sector *fat_sector, struct layout_stats *stats, bool per_chain){
+    uint64_t end = data_cluster_count(fat_sector) + 2;
+    struct chain_run *runs = NULL;
+    uint64_t count = 0, capacity = 0;
+    uint64_t limit = fg->args.max_memory ? fg->args.max_memory / 16 / sizeof(struct chain_run) : UINT64_MAX;
+    uint64_t cluster = 2;
+    uint8_t *referenced;
+
+    memset(stats, 0, sizeof(struct layout_stats));
+    stats->per_chain = per_chain;
+    while (cluster < end){
+        uint64_t start = cluster;
+        uint32_t next;
+        int type;
+
+        cluster = next_fat_run(fat_sector, cluster, end, &type, &next);
+        if (type == EXTENT_FREE){
+            stats->free_runs++;
+            stats->free_clusters += cluster - start;
+            if (cluster - start > stats->largest_free_count){
+                stats->largest_free_start = start;
+                stats->largest_free_count = cluster - start;
+            }
+        }
+        if (type != EXTENT_CHAIN && type != EXTENT_EOF && type != EXTENT_INVALID)
+            continue;
+
+        stats->allocated_runs++;
+        stats->allocated_clusters += cluster - start;
+        stats->weighted_run_sum += (cluster - start) * (cluster - start);
+        if (type == EXTENT_CHAIN){
+            stats->seeks++;
+            stats->seek_distance += next > cluster ? next - cluster : cluster - next;
+        }
+        if (!stats->per_chain)
+            continue;
+        if (count == capacity){
+            uint64_t grown = capacity ? capacity * 2 : 1024;
+            struct chain_run *bigger = count < limit ? realloc(runs, grown * sizeof(struct chain_run)) : NULL;
+            if (bigger == NULL){
+                // Out of budget, the totals are still counted but not the extents of each chain
+                stats->per_chain = false;
+                free(runs);
+                runs = NULL;
+                count = capacity = 0;
+                continue;
+            }
+            runs = bigger;
+            capacity = grown;
+        }
+        runs[count++] = (struct chain_run){start, cluster - start, type == EXTENT_CHAIN ? next : 0};
+    }
+
+    stats->valid = true;
+    if (!stats->per_chain)
+        return;
+
+    // A chain starts at every run no other run links to
+    referenced = calloc(count ? count : 1, 1);
+    if (referenced == NULL){
+        stats->per_chain = false;
+        free(runs);
+        return;
+    }
+    for (uint64_t i = 0; i < count; i++){
+        uint64_t target = runs[i].next ? find_chain_run(runs, count, runs[i].next) : count;
+        if (target < count)
+            referenced[target] = 1;
+    }
+    for (uint64_t i = 0; i < count; i++){
+        uint64_t extents = 0;
+        int bucket = 0;
+        if (referenced[i])
+            continue;
+        // The step limit stops at a chain that loops back on itself
+        for (uint64_t run = i; run < count && extents < count; extents++)
+            run = runs[run].next ? find_chain_run(runs, count, runs[run].next) : count;
+        while (bucket < FRAGMENT_BUCKETS - 1 && (1ull << bucket) < extents)
+            bucket++;
+        stats->histogram[bucket]++;
+        stats->chains++;
+        if (extents > 1)
+            stats->fragmented_chains++;
+        if (extents > stats->max_extents)
+            stats->max_extents = extents;
+    }
+    free(referenced);
+    free(runs);
+}
+
+/**
+ * @brief Limits the readahead of the block cache to the length of run the average allocated
+ * cluster is in.  Reading ahead past the end of a run fetches clusters of some other file, so on
+ * a fragmented volume it only costs bandwidth and evicts clusters that are still needed.
+ */
+static void tune_readahead(struct block_cache *bc, struct layout_stats *stats){
+    uint32_t window = 1;
+
+    if (!bc->enabled || !stats->valid || stats->allocated_clusters == 0)
+        return;
+    while (window < bc->readahead_max && window < stats->weighted_run_sum / stats->allocated_clusters)
+        window <<= 1;
+    if (window < bc->readahead_max)
+        bc->readahead_max = window;
+}
+
+/**
+ * @brief Prints the fragmentation report (--fragmentation)
+ */
+static void print_layout_report(struct layout_stats *stats){
+    uint32_t cluster_size = fg->bps * fg->spc;
+
+    report("\nFragmentation\n");
+    if (stats->per_chain){
+        report("Files and directories (cluster chains): %ju, %ju fragmented (%.1f%%), at most %ju extents in one chain\n",
+            (uintmax_t)stats->chains, (uintmax_t)stats->fragmented_chains,
+            stats->chains ? 100.0 * stats->fragmented_chains / stats->chains : 0.0, (uintmax_t)stats->max_extents);
+        report("Extents per chain:\n");
+        for (int i = 0; i < FRAGMENT_BUCKETS; i++)
+            report(" %6s: %ju\n", fragment_bucket_txt[i], (uintmax_t)stats->histogram[i]);
+    }
+    else
+        report("The chain index did not fit in the memory budget, extents per chain are not counted.\n");
+    report("Allocated runs: %ju holding %ju clusters, %.1f clusters per run on average (%.1f for the average cluster)\n",
+        (uintmax_t)stats->allocated_runs, (uintmax_t)stats->allocated_clusters,
+        stats->allocated_runs ? (double)stats->allocated_clusters / stats->allocated_runs : 0.0,
+        stats->allocated_clusters ? (double)stats->weighted_run_sum / stats->allocated_clusters : 0.0);
+    report("Seeks reading every chain in order: %ju, %.1f KiB apart on average\n", (uintmax_t)stats->seeks,
+        stats->seeks ? (double)stats->seek_distance * cluster_size / stats->seeks / 1024 : 0.0);
+    report("Free runs: %ju holding %ju clusters", (uintmax_t)stats->free_runs, (uintmax_t)stats->free_clusters);
+    if (stats->largest_free_count)
+        report(", the largest is %ju clusters (%ju KiB) at cluster 0x%x", (uintmax_t)stats->largest_free_count,
+            (uintmax_t)(stats->largest_free_count * cluster_size / 1024), stats->largest_free_start);
+    report("\n");
+    if (fg->cache.enabled)
+        report("Readahead: up to %u cluster%s\n", fg->cache.readahead_max, fg->cache.readahead_max == 1 ? "" : "s");
+    report("\n");
+}
+
+/**
+ * @brief Compares the FSINFO sector of a FAT32 volume with the FAT.  The free cluster count and next
+ * free hint are only updated by the driver, so a FAT edited by hand (e.g. to mark clusters bad or to
+ * unlink a file) usually leaves them behind.
+ *
+ * @param free_clusters true number of free clusters, counted from FAT1
+ */
+static void check_fsinfo(int fp, struct fat_boot_sector *fat_sector, uint64_t free_clusters){
+    uint64_t cluster_count = data_cluster_count(fat_sector);
+    uint8_t buffer[512];
+    const uint8_t *sector = buffer;
+    uint32_t free_count, next_free;
+
+    if (!fat_sector->is_fat32 || fat_sector->fsinfo_sector_addr == 0 || fat_sector->fsinfo_sector_addr >= fat_sector->reserved_area_size)
+        return;
+    if (boot_region_sector(fat_sector->fsinfo_sector_addr) != NULL)
+        sector = boot_region_sector(fat_sector->fsinfo_sector_addr);
+    else if (image_pread(fp, buffer, sizeof(buffer), (uint64_t)fat_sector->fsinfo_sector_addr * fg->bps) != sizeof(buffer))
+        read_error();
+    if (le32(sector + FSINFO_LEAD_SIG_OFF) != FSINFO_LEAD_SIG || le32(sector + FSINFO_STRUCT_SIG_OFF) != FSINFO_STRUCT_SIG ||
+        le32(sector + FSINFO_TRAIL_SIG_OFF) != FSINFO_TRAIL_SIG){
+        report("Warning!  The FSINFO sector (sector %u) does not have valid signatures.\n\n", fat_sector->fsinfo_sector_addr);
+        return;
+    }
+    free_count = le32(sector + FSINFO_FREE_COUNT);
+    next_free = le32(sector + FSINFO_NEXT_FREE);
+
+    if (fg->args.v_flag)
+        report("FSINFO: %u free clusters, next free cluster hint 0x%x.  The FAT has %ju free clusters.\n",
+            free_count, next_free, (uintmax_t)free_clusters);
+    if (free_count != FSINFO_UNKNOWN && free_count != free_clusters)
+        report("Warning!  FSINFO records %u free clusters but the FAT has %ju (%+jd).  The FAT may have been modified outside of the file system driver.\n",
+            free_count, (uintmax_t)free_clusters, (intmax_t)free_clusters - (intmax_t)free_count);
+    if (free_count != FSINFO_UNKNOWN && free_count > cluster_count)
+        report("Warning!  FSINFO records more free clusters than the volume has (%ju).\n", (uintmax_t)cluster_count);
+    if (next_free != FSINFO_UNKNOWN && (next_free < 2 || next_free > cluster_count + 1))
+        report("Warning!  The FSINFO next free cluster hint 0x%x is not a valid cluster.\n", next_free);
+}
+
+/**
+ * @brief Compares one field of a boot record sector with the same field of another copy (the
+ * backup, or the same sector of another image) and reports it if they disagree
+ *
+ * @param names what to call the two copies, e.g. primary and backup
+ * @param header printed before the first disagreement, then cleared
+ * @return true if the field differs, not counting hint fields
+ */
+static bool compare_boot_field(const uint8_t *primary, const uint8_t *backup, const char *names[2], const char *sector_name, const struct boot_field *field, const char **header){
+    const uint8_t *a = primary + field->offset;
+    const uint8_t *b = backup + field->offset;
+
+    if (memcmp(a, b, field->size) == 0)
+        return false;
+    if (field->hint){
+        // Drivers usually only update the primary FSINFO, so a stale backup is not suspicious
+        if (fg->args.v_flag)
+            report("The backup %s %s is 0x%x, the primary is 0x%x.  The backup is not always kept up to date.\n",
+                sector_name, field->name, le32(b), le32(a));
+        return false;
+    }
+    if (*header != NULL){
+        report("%s", *header);
+        *header = NULL;
+    }
+    if (field->text)
+        report("  %s, %s: %s '%.*s' %s '%.*s'\n", sector_name, field->name, names[0], field->size, (const char *)a, names[1], field->size, (const char *)b);
+    else if (field->size <= 4){
+        uint32_t value_a = 0, value_b = 0;
+        for (int i = field->size - 1; i >= 0; i--){
+            value_a = (value_a << 8) | a[i];
+            value_b = (value_b << 8) | b[i];
+        }
+        report("  %s, %s: %s 0x%x %s 0x%x\n", sector_name, field->name, names[0], value_a, names[1], value_b);
+    }
+    else{
+        uint32_t differ = 0, first = field->size;
+        for (uint32_t i = 0; i < field->size; i++){
+            if (a[i] != b[i]){
+                differ++;
+                if (first == field->size)
+                    first = i;
+            }
+        }
+        report("  %s, %s: %u of %u bytes differ, the first at offset 0x%x\n", sector_name, field->name, differ, field->size, field->offset + first);
+    }
+    return true;
+}
+
+/**
+ * @brief Diffs the FAT32 boot record (boot sector, FSINFO, and the second boot code sector) with the
+ * backup copy at backup_boot_sector_addr, field by field.  Formatting writes both copies and nothing
+ * but the free cluster hints changes afterwards, so any other disagreement means one of them was
+ * edited by hand, a common sign of tampering.  Both copies come from the boot region read with the
+ * boot sector, so this costs no extra reads.
+ */
+static void check_backup_boot_sector(struct fat_boot_sector *fat_sector){
+    uint32_t backup = fat_sector->backup_boot_sector_addr;
+    const char *names[2] = {"primary", "backup"};
+    char text[160];
+    const char *header = text;
+    uint32_t differ = 0;
+
+    if (!fat_sector->is_fat32)
+        return;
+    if (backup == 0 || backup == 0xFFFF){
+        if (fg->args.v_flag)
+            report("The boot sector does not record a backup boot sector.\n");
+        return;
+    }
+    if (backup < BOOT_RECORD_SECTORS || backup + BOOT_RECORD_SECTORS > fat_sector->reserved_area_size){
+        report("Warning!  The backup boot sector address (sector %u) is not in the reserved area after the boot record.\n\n", backup);
+        return;
+    }
+    snprintf(text, sizeof(text), "Warning!  The backup boot record at sector %u does not match the primary, a common sign of tampering.\n", backup);
+
+    for (uint32_t i = 0; i < BOOT_RECORD_SECTORS; i++){
+        const uint8_t *primary = boot_region_sector(i);
+        const uint8_t *copy = boot_region_sector(backup + i);
+        const char *sector_name = i == 0 ? "Boot Sector" : i == fat_sector->fsinfo_sector_addr ? "FSINFO" : "Boot Sector 2";
+
+        if (primary == NULL || copy == NULL){
+            report("Warning!  The image ends before the backup boot record at sector %u.\n\n", backup);
+            return;
+        }
+        if (i == 0){
+            for (uint32_t f = 0; f < sizeof(fat32_boot_fields) / sizeof(fat32_boot_fields[0]); f++)
+                differ += compare_boot_field(primary, copy, names, sector_name, &fat32_boot_fields[f], &header);
+        }
+        else if (i == fat_sector->fsinfo_sector_addr){
+            for (uint32_t f = 0; f < sizeof(fsinfo_fields) / sizeof(fsinfo_fields[0]); f++)
+                differ += compare_boot_field(primary, copy, names, sector_name, &fsinfo_fields[f], &header);
+        }
+        else{
+            struct boot_field whole = {"Boot Code", 0, fg->bps, false, false};
+            differ += compare_boot_field(primary, copy, names, sector_name, &whole, &header);
+            continue;
+        }
+        // The structures only cover the first 512 bytes of larger sectors
+        if (fg->bps > 512){
+            struct boot_field rest = {"Rest of the sector", 512, fg->bps - 512, false, false};
+            differ += compare_boot_field(primary, copy, names, sector_name, &rest, &header);
+        }
+    }
+    if (differ)
+        report("%u field%s of the backup boot record differ%s from the primary.\n\n", differ, differ == 1 ? "" : "s", differ == 1 ? "s" : "");
+    else if (fg->args.v_flag)
+        report("The backup boot record at sector %u matches the primary.\n", backup);
+}
+
+/**
+ * @brief Builds the list of cluster runs marked bad in FAT1.  When FAT1 is in memory a vector of
+ * entries is compared at a time, so the long stretches without a bad mark go quickly.
+ */
+static void find_bad_extents(struct fat_boot_sector *fat_sector, struct extent_list *list){
+    uint64_t end = data_cluster_count(fat_sector) + 2;
+    uint64_t cluster = 2;
+
+    if (fg->fat1 != NULL && fat_sector->is_fat32){
+        const uint32_t *fat = (const uint32_t *)fg->fat1;
+        uint32_t lanes = SCAN_VECTOR_SIZE / 4;
+        if (end > fg->fat_size_in_bytes / 4)
+            end = fg->fat_size_in_bytes / 4;
+        for (; cluster + lanes <= end; cluster += lanes){
+            fat32_vector v;
+            uint64_t words[SCAN_VECTOR_SIZE / 8];
+            memcpy(&v, fat + cluster, sizeof(v));
+            __typeof__((v & FAT32_ENTRY_MASK) == FAT32_BAD) hits = (v & FAT32_ENTRY_MASK) == FAT32_BAD;
+            memcpy(words, &hits, sizeof(words));
+            if (!(words[0] | words[1] | words[2] | words[3]))
+                continue;
+            for (uint32_t lane = 0; lane < lanes; lane++){
+                if ((fat[cluster + lane] & FAT32_ENTRY_MASK) == FAT32_BAD)
+                    add_extent(list, cluster + lane, 1);
+            }
+        }
+    }
+    if (fg->fat1 != NULL && fat_sector->is_fat16){
+        const uint16_t *fat = (const uint16_t *)fg->fat1;
+        uint32_t lanes = SCAN_VECTOR_SIZE / 2;
+        if (end > fg->fat_size_in_bytes / 2)
+            end = fg->fat_size_in_bytes / 2;
+        for (; cluster + lanes <= end; cluster += lanes){
+            fat16_vector v;
+            uint64_t words[SCAN_VECTOR_SIZE / 8];
+            memcpy(&v, fat + cluster, sizeof(v));
+            __typeof__(v == FAT16_BAD) hits = v == FAT16_BAD;
+            memcpy(words, &hits, sizeof(words));
+            if (!(words[0] | words[1] | words[2] | words[3]))
+                continue;
+            for (uint32_t lane = 0; lane < lanes; lane++){
+                if (fat[cluster + lane] == FAT16_BAD)
+                    add_extent(list, cluster + lane, 1);
+            }
+        }
+    }
+
+    // FAT12, the FAT page cache in bounded memory mode, and whatever is left after the last vector
+    uint32_t bad = fat_sector->is_fat32 ? FAT32_BAD : fat_sector->is_fat16 ? FAT16_BAD : FAT12_BAD;
+    for (; cluster < end; cluster++){
+        uint32_t value = read_alloctable(cluster);
+        if ((fat_sector->is_fat32 ? value & FAT32_ENTRY_MASK : value) == bad)
+            add_extent(list, cluster, 1);
+    }
+}
+
+/**
+ * @brief Reads every run of clusters marked bad in FAT1.  Marking good clusters bad keeps the OS
+ * away from them, which makes them a classic hiding place, so any data in them is reported.  The
+ * number of bad clusters is also checked against what the media type makes plausible.
+ */
+static void check_bad_clusters(int fp, struct fat_boot_sector *fat_sector){
+    struct extent_list *list = &fg->bad_clusters;
+    uint64_t cluster_count = data_cluster_count(fat_sector);
+    uint64_t runs_with_data = 0;
+    char label[64];
+
+    find_bad_extents(fat_sector, list);
+    if (list->count == 0)
+        return;
+    report("%ju clusters are marked bad in the FAT, in %ju runs.\n", (uintmax_t)list->clusters, (uintmax_t)list->count);
+
+    // Drives remap failing sectors on their own, so a fixed disk should have no bad clusters at all
+    if (fat_sector->media_type == FIXED)
+        report("Warning!  Clusters are marked bad on a fixed disk.  Disks remap failing sectors themselves, so these are unlikely to be genuine.\n");
+    else if (list->clusters * 1000 > cluster_count * BAD_CLUSTERS_REMOVABLE_PERMILLE)
+        report("Warning!  %.1f%% of the clusters are marked bad, more than is plausible for removable media.\n",
+            100.0 * list->clusters / cluster_count);
+
+    for (uint64_t i = 0; i < list->count; i++){
+        struct cluster_extent *extent = &list->extents[i];
+        snprintf(label, sizeof(label), "clusters 0x%x to 0x%x", extent->start, extent->start + extent->count - 1);
+        runs_with_data += check_region(fp, REGION_BAD_CLUSTERS, cts(extent->start), (uint64_t)extent->count * fg->bps * fg->spc, label);
+    }
+    report("%ju of %ju runs of bad clusters hold data.\n\n", (uintmax_t)runs_with_data, (uintmax_t)list->count);
+}
+
+/**
+ * @brief Checks a stratified sample of the free clusters.  Sampled clusters with data are recorded
+ * as findings and added to total.
+ *
+ * @param clusters_with_data incremented for each sampled cluster that held data
+ */
+static void sample_free_clusters(int fp, struct region_scan *total, uint64_t *clusters_with_data){
+    struct sample_stratum *stratum = begin_stratum(&fg->sample, STRATUM_FREE_SPACE);
+    uint64_t target = sample_target(&fg->sample, fg->free_space.clusters);
+    uint32_t cluster_size = fg->bps * fg->spc;
+    uint8_t *buffer = malloc(cluster_size);
+    uint64_t extent = 0;
+    uint64_t extent_first = 0; // index of the first cluster of the current extent among all free clusters
+    char label[64];
+
+    if (buffer == NULL)
+        return;
+    stratum->population = fg->free_space.clusters;
+    for (uint64_t bin = 0; bin < target; bin++){
+        uint64_t index = sample_pick(&fg->sample, fg->free_space.clusters, target, bin);
+        while (index >= extent_first + fg->free_space.extents[extent].count){
+            extent_first += fg->free_space.extents[extent].count;
+            extent++;
+        }
+        uint32_t cluster = fg->free_space.extents[extent].start + (index - extent_first);
+        struct region_scan scan = {.type = REGION_FREE_SPACE, .offset = cts(cluster), .length = cluster_size, .label = label};
+
+        if (!sample_budget_left(stratum, cluster_size))
+            break;
+        if (image_pread(fp, buffer, cluster_size, scan.offset) != cluster_size)
+            read_error();
+        snprintf(label, sizeof(label), "cluster 0x%x", cluster);
+        scan_buffer(&scan, buffer, cluster_size, scan.offset);
+        progress_add(&fg->progress.clusters, 1);
+        sample_record(&fg->sample, stratum, cluster_size, scan.nonzero != 0);
+        total->scanned += scan.scanned;
+        if (scan.nonzero == 0)
+            continue;
+        if ((*clusters_with_data)++ == 0)
+            total->first_nonzero = scan.first_nonzero;
+        total->nonzero += scan.nonzero;
+        for (int b = 1; b < 256; b++)
+            total->histogram[b] += scan.histogram[b];
+        if (fg->args.v_flag)
+            report_region(&scan, label);
+        else
+            record_finding(&scan, label);
+    }
+    free(buffer);
+}
+
+/**
+ * @brief Sweeps the free clusters of the volume.  Free clusters should hold nothing but old
+ * deleted data or zeros, data written there without updating the FAT is invisible to the OS.
+ * Extents are reported individually in verbose mode, otherwise as a summary.
+ *
+ * @param fp
+ */
+static void check_free_clusters(int fp, struct fat_boot_sector *fat_sector){
+    struct free_space_progress *sweep = &fg->ckpt.free_space;
+    uint64_t cluster_size = fg->bps * fg->spc;
+    uint64_t span = CHECKPOINT_SPAN / cluster_size ? CHECKPOINT_SPAN / cluster_size : 1;
+    struct byte_profile profile;
+    char label[96];
+
+    sweep->total.type = REGION_FREE_SPACE;
+    find_free_extents(fat_sector, &fg->free_space);
+    check_fsinfo(fp, fat_sector, fg->free_space.clusters);
+    if (fg->sample.enabled){
+        sample_free_clusters(fp, &sweep->total, &sweep->extents_with_data);
+    }
+    for (uint64_t i = 0; i < fg->free_space.count && !fg->sample.enabled; i++){
+        struct cluster_extent *extent = &fg->free_space.extents[i];
+        uint32_t end = extent->start + extent->count;
+        struct region_scan *scan = &sweep->extent;
+
+        // Extents below the cursor were swept before the checkpoint this run resumed from
+        if (end <= sweep->cursor)
+            continue;
+        snprintf(label, sizeof(label), "clusters 0x%x to 0x%x", extent->start, end - 1);
+        if (sweep->cursor <= extent->start){
+            memset(scan, 0, sizeof(struct region_scan));
+            scan->type = REGION_FREE_SPACE;
+            scan->offset = cts(extent->start);
+            scan->length = (uint64_t)extent->count * cluster_size;
+            sweep->cursor = extent->start;
+        }
+        scan->label = label;
+
+        // Large extents are swept in spans so a checkpoint can be taken part way through
+        while (sweep->cursor < end){
+            uint32_t count = end - sweep->cursor < span ? end - sweep->cursor : span;
+            if (scan_range(fp, scan, cts(sweep->cursor), (uint64_t)count * cluster_size))
+                read_error();
+            sweep->cursor += count;
+            progress_add(&fg->progress.clusters, count);
+            if (sweep->cursor < end)
+                maybe_checkpoint();
+        }
+
+        sweep->total.scanned += scan->scanned;
+        if (scan->nonzero){
+            if (sweep->extents_with_data++ == 0)
+                sweep->total.first_nonzero = scan->first_nonzero;
+            sweep->total.nonzero += scan->nonzero;
+            for (int b = 1; b < 256; b++)
+                sweep->total.histogram[b] += scan->histogram[b];
+            if (fg->args.v_flag)
+                report_region(scan, label);
+            else
+                record_finding(scan, label);
+        }
+        memset(scan, 0, sizeof(struct region_scan));
+        maybe_checkpoint();
+    }
+    if (sweep->extents_with_data && !fg->args.v_flag){
+        fg->hidden_data_found = true; // mark the global var as true
+        report("Possible hidden data found in the free clusters: %ju non-zero bytes in %ju of %ju free %s, first at offset 0x%jx\n",
+            (uintmax_t)sweep->total.nonzero, (uintmax_t)sweep->extents_with_data, (uintmax_t)(fg->sample.enabled ? fg->free_space.clusters : fg->free_space.count),
+            fg->sample.enabled ? "clusters" : "extents", (uintmax_t)sweep->total.first_nonzero);
+        profile_region(&sweep->total, &profile);
+        print_byte_profile(&profile);
+    }
+}
+
+/**
+ * @brief Checks the areas of a FAT volume that are outside of any cluster for hidden data:
+ * unused sectors of the reserved area, FAT entries past the last valid cluster, and sectors
+ * between the end of the data area and the end of the file system / disk image.  Each region
+ * is swept with large sequential reads.
+ *
+ * @param fp
+ * @param fat_sector
+ */
+static void check_volume_regions(int fp, struct fat_boot_sector *fat_sector){
+    uint64_t total_sectors = fat_sector->sector_count_16b ? fat_sector->sector_count_16b : fat_sector->sector_count_32b;
+    uint32_t fat_sectors = fat_sector->is_fat32 ? fat_sector->fat32_size_in_sectors : fat_sector->fat_size_in_sectors;
+    uint64_t data_start = first_data_sector(fat_sector);
+    uint64_t cluster_count = total_sectors > data_start ? (total_sectors - data_start) / fg->spc : 0;
+    uint64_t fat_used_bytes = 0;
+    char label[96];
+
+    // Reserved area.  FAT32 boot records are 3 sectors (boot sector, FSINFO, boot code) with a backup
+    // copy, FAT12/16 only use the boot sector.
+    for (uint32_t sector = 1; sector < fat_sector->reserved_area_size;){
+        uint32_t backup = fat_sector->backup_boot_sector_addr;
+        bool boot_record = fat_sector->is_fat32 && (sector <= 2 || sector == fat_sector->fsinfo_sector_addr ||
+            (backup && sector >= backup && sector <= backup + 2));
+        if (boot_record){
+            sector++;
+            continue;
+        }
+        uint32_t end = sector;
+        while (end < fat_sector->reserved_area_size && !(fat_sector->is_fat32 && (end == fat_sector->fsinfo_sector_addr ||
+            (backup && end >= backup && end <= backup + 2))))
+            end++;
+        snprintf(label, sizeof(label), "sectors %u to %u", sector, end - 1);
+        check_region(fp, REGION_RESERVED_AREA, (uint64_t)sector * fg->bps, (uint64_t)(end - sector) * fg->bps, label);
+        sector = end;
+    }
+
+    // Entries past the last cluster in each FAT.  FAT12 entries are 1.5 bytes.
+    if (fat_sector->is_fat12)
+        fat_used_bytes = ((cluster_count + 2) * 3 + 1) / 2;
+    if (fat_sector->is_fat16)
+        fat_used_bytes = (cluster_count + 2) * 2;
+    if (fat_sector->is_fat32)
+        fat_used_bytes = (cluster_count + 2) * 4;
+    for (int i = 0; i < fat_sector->number_of_fats; i++){
+        uint64_t fat_start = ((uint64_t)fat_sector->reserved_area_size + (uint64_t)i * fat_sectors) * fg->bps;
+        if (fat_used_bytes < (uint64_t)fat_sectors * fg->bps){
+            snprintf(label, sizeof(label), "FAT %d, entries past cluster %ju", i + 1, (uintmax_t)cluster_count + 1);
+            check_region(fp, REGION_FAT_TAIL, fat_start + fat_used_bytes, (uint64_t)fat_sectors * fg->bps - fat_used_bytes, label);
+        }
+    }
+
+    // Sectors that do not make up a whole cluster at the end of the data area
+    uint64_t data_end = data_start + cluster_count * fg->spc;
+    uint64_t image_sectors = fg->image.size / fg->bps;
+    uint64_t volume_end = total_sectors < image_sectors ? total_sectors : image_sectors;
+    if (data_end < volume_end){
+        snprintf(label, sizeof(label), "sectors %ju to %ju", (uintmax_t)data_end, (uintmax_t)volume_end - 1);
+        check_region(fp, REGION_VOLUME_SLACK, data_end * fg->bps, (volume_end - data_end) * fg->bps, label);
+    }
+
+    // Anything stored in the image after the last sector of the file system
+    if ((uint64_t)total_sectors * fg->bps < fg->image.size){
+        snprintf(label, sizeof(label), "after sector %ju", (uintmax_t)total_sectors - 1);
+        check_region(fp, REGION_PAST_FILE_SYSTEM, total_sectors * fg->bps, fg->image.size - total_sectors * fg->bps, label);
+    }
+}
+
+/**
+ * @brief Hashes one image a block at a time for the differential scan.  Each image gets its own
+ * thread, so both are read at once.  SHA-256 is used rather than the BLAKE3 of --hash because
+ * OpenSSL has hardware support for it, the portable BLAKE3 is several times slower.
+ */
+static void* diff_digest_worker(void *arg){
+    struct block_digests *digests = arg;
+    jmp_buf fail;
+    uint8_t *buf = malloc(DIFF_BLOCK_SIZE);
+
+    fg = digests->volume;
+    worker_fail = &fail;
+    if (setjmp(fail)){
+        worker_fail = NULL;
+        free(buf);
+        return NULL;
+    }
+    if (buf == NULL){
+        fprintf(stderr, "Aborting... Out of memory while hashing the images.\n");
+        fatal();
+    }
+    for (uint64_t block = 0; block < digests->blocks; block++){
+        uint8_t digest[EVP_MAX_MD_SIZE];
+        ssize_t n = image_pread(fg->fp, buf, DIFF_BLOCK_SIZE, block * DIFF_BLOCK_SIZE);
+        if (n < 0)
+            read_error();
+        EVP_Digest(buf, n, digest, NULL, EVP_sha256(), NULL);
+        memcpy(digests->digests[block], digest, DIFF_DIGEST_SIZE);
+        progress_add(&fg->progress.bytes, n);
+    }
+    worker_fail = NULL;
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief Returns true if any block holding part of the range differs between the two images
+ */
+static bool range_changed(struct image_diff *d, uint64_t offset, uint64_t length){
+    if (length == 0)
+        return false;
+    for (uint64_t block = offset / DIFF_BLOCK_SIZE; block <= (offset + length - 1) / DIFF_BLOCK_SIZE && block < d->blocks; block++){
+        if (d->changed[block])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Reads from one of the two images, anything past its end reads as zeros
+ */
+static void diff_read(struct fg_volume *volume, void *buffer, uint32_t length, uint64_t offset){
+    fg = volume;
+    memset(buffer, 0, length);
+    if (image_pread(volume->fp, buffer, length, offset) < 0)
+        read_error();
+}
+
+/**
+ * @brief Returns the FAT entry of a cluster in one of the two images
+ */
+static uint32_t diff_fat_entry(struct fg_volume *volume, uint64_t cluster){
+    fg = volume;
+    uint32_t value = read_alloctable(cluster);
+    return volume->fat_bs->is_fat32 ? value & FAT32_ENTRY_MASK : value;
+}
+
+/**
+ * @brief Returns the offset of the FAT entry of a cluster from the start of a FAT
+ */
+static uint64_t fat_entry_offset(struct fat_boot_sector *fat_sector, uint64_t cluster){
+    if (fat_sector->is_fat32)
+        return cluster * 4;
+    if (fat_sector->is_fat16)
+        return cluster * 2;
+    return cluster * 3 / 2;
+}
+
+/**
+ * @brief Counts the bytes that differ between two buffers
+ *
+ * @param first set to the offset of the first one, if any
+ */
+static uint32_t count_differing_bytes(const uint8_t *a, const uint8_t *b, uint32_t length, uint32_t *first){
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < length; i++){
+        if (a[i] != b[i]){
+            if (count++ == 0)
+                *first = i;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Reports one geometry field if it differs between the two volumes, after the warning if it
+ * is the first one
+ */
+static void compare_geometry(struct image_diff *d, const char **header, const char *name, uint64_t value_a, uint64_t value_b){
+    if (value_a == value_b)
+        return;
+    if (*header != NULL){
+        report("%s", *header);
+        *header = NULL;
+    }
+    report("  %s: %ju before, %ju after\n", name, (uintmax_t)value_a, (uintmax_t)value_b);
+    d->changes++;
+}
+
+/**
+ * @brief Reports the geometry fields that differ between the two volumes
+ *
+ * @return bool : true if the volumes are laid out the same, so they can be compared cluster by cluster
+ */
+static bool same_fat_geometry(struct image_diff *d){
+    struct fat_boot_sector *a = d->before->fat_bs;
+    struct fat_boot_sector *b = d->after->fat_bs;
+    uint64_t clusters_a, clusters_b;
+    const char *header = "Warning!  The images do not have the same FAT geometry, so only the changed blocks are counted:\n";
+
+    fg = d->before;
+    clusters_a = data_cluster_count(a);
+    fg = d->after;
+    clusters_b = data_cluster_count(b);
+    fg = d->before;
+
+    compare_geometry(d, &header, "FAT type", a->is_fat32 ? 32 : a->is_fat16 ? 16 : 12, b->is_fat32 ? 32 : b->is_fat16 ? 16 : 12);
+    compare_geometry(d, &header, "Bytes per sector", d->before->bps, d->after->bps);
+    compare_geometry(d, &header, "Sectors per cluster", d->before->spc, d->after->spc);
+    compare_geometry(d, &header, "Size of Reserved Area", a->reserved_area_size, b->reserved_area_size);
+    compare_geometry(d, &header, "Number of FATs", a->number_of_fats, b->number_of_fats);
+    compare_geometry(d, &header, "FAT size in bytes", d->before->fat_size_in_bytes, d->after->fat_size_in_bytes);
+    compare_geometry(d, &header, "Maximum number of files in Root Dir", a->max_files_in_root, b->max_files_in_root);
+    compare_geometry(d, &header, "Data clusters", clusters_a, clusters_b);
+    return header != NULL;
+}
+
+/**
+ * @brief Reports the fields of a boot sector or FSINFO sector that differ between the two images,
+ * and the rest of the sector past the first 512 bytes
+ */
+static void diff_boot_fields(struct image_diff *d, const uint8_t *a, const uint8_t *b, uint32_t bps, const struct boot_field *fields, uint32_t count,
+    const char *sector_name, const char **header){
+    const char *names[2] = {"before", "after"};
+
+    for (uint32_t f = 0; f < count; f++){
+        struct boot_field field = fields[f];
+        field.hint = false; // every change counts between two images
+        d->changes += compare_boot_field(a, b, names, sector_name, &field, header);
+    }
+    if (bps > 512){
+        struct boot_field rest = {"Rest of the sector", 512, bps - 512, false, false};
+        d->changes += compare_boot_field(a, b, names, sector_name, &rest, header);
+    }
+}
+
+/**
+ * @brief Compares the reserved area sector by sector, only reading the sectors in changed blocks.
+ * The boot sector and FSINFO are compared field by field.
+ */
+static void diff_reserved_area(struct image_diff *d){
+    struct fat_boot_sector *fat_sector = d->after->fat_bs;
+    uint32_t bps = d->after->bps;
+    const char *names[2] = {"before", "after"};
+    const char *header = "Changes in the reserved area:\n";
+    uint32_t backup = fat_sector->backup_boot_sector_addr != 0xFFFF ? fat_sector->backup_boot_sector_addr : 0;
+    uint8_t *a = malloc(bps);
+    uint8_t *b = malloc(bps);
+
+    if (a == NULL || b == NULL){
+        free(a);
+        free(b);
+        fprintf(stderr, "Aborting... Out of memory while comparing the reserved areas.\n");
+        fatal();
+    }
+    for (uint32_t sector = 0; sector < fat_sector->reserved_area_size; sector++){
+        if (!range_changed(d, (uint64_t)sector * bps, bps))
+            continue;
+        diff_read(d->before, a, bps, (uint64_t)sector * bps);
+        diff_read(d->after, b, bps, (uint64_t)sector * bps);
+        fg = d->before;
+        if (memcmp(a, b, bps) == 0)
+            continue;
+        if (sector == 0 && fat_sector->is_fat32)
+            diff_boot_fields(d, a, b, bps, fat32_boot_fields, sizeof(fat32_boot_fields) / sizeof(fat32_boot_fields[0]), "Boot Sector", &header);
+        else if (sector == 0)
+            diff_boot_fields(d, a, b, bps, fat_boot_fields, sizeof(fat_boot_fields) / sizeof(fat_boot_fields[0]), "Boot Sector", &header);
+        else if (fat_sector->is_fat32 && sector == fat_sector->fsinfo_sector_addr)
+            diff_boot_fields(d, a, b, bps, fsinfo_fields, sizeof(fsinfo_fields) / sizeof(fsinfo_fields[0]), "FSINFO", &header);
+        else if (fat_sector->is_fat32 && backup && sector == backup)
+            diff_boot_fields(d, a, b, bps, fat32_boot_fields, sizeof(fat32_boot_fields) / sizeof(fat32_boot_fields[0]), "Backup Boot Sector", &header);
+        else if (fat_sector->is_fat32 && backup && sector == backup + fat_sector->fsinfo_sector_addr)
+            diff_boot_fields(d, a, b, bps, fsinfo_fields, sizeof(fsinfo_fields) / sizeof(fsinfo_fields[0]), "Backup FSINFO", &header);
+        else{
+            char sector_name[32];
+            struct boot_field whole = {"Contents", 0, bps, false, false};
+            snprintf(sector_name, sizeof(sector_name), "Sector %u", sector);
+            d->changes += compare_boot_field(a, b, names, sector_name, &whole, &header);
+        }
+    }
+    free(a);
+    free(b);
+}
+
+/**
+ * @brief Reports the run of changed FAT1 entries collected so far, if there is one
+ */
+static void flush_fat_change(struct image_diff *d, struct fat_change_run *run, const char **header){
+    if (!run->open)
+        return;
+    if (*header != NULL){
+        report("%s", *header);
+        *header = NULL;
+    }
+    if (run->start == run->end)
+        report("  Cluster 0x%jx: %s (0x%x -> 0x%x)\n", (uintmax_t)run->start, fat_change_txt[run->type], run->before, run->after);
+    else
+        report("  Clusters 0x%jx to 0x%jx: %s (0x%x -> 0x%x at cluster 0x%jx)\n", (uintmax_t)run->start, (uintmax_t)run->end,
+            fat_change_txt[run->type], run->before, run->after, (uintmax_t)run->start);
+    d->changes++;
+    run->open = false;
+}
+
+/**
+ * @brief Compares FAT1 entry by entry in the blocks that changed, and reports each run of
+ * clusters whose entries changed the same way.  The other FATs are only counted.
+ */
+static void diff_fats(struct image_diff *d){
+    struct fat_boot_sector *fat_sector = d->after->fat_bs;
+    uint64_t fat_start = (uint64_t)fat_sector->reserved_area_size * d->after->bps;
+    uint32_t fat_bytes = d->after->fat_size_in_bytes;
+    uint64_t entries = fat_sector->is_fat32 ? fat_bytes / 4 : fat_sector->is_fat16 ? fat_bytes / 2 : (uint64_t)fat_bytes * 2 / 3;
+    uint32_t bad = fat_sector->is_fat32 ? FAT32_BAD : fat_sector->is_fat16 ? FAT16_BAD : FAT12_BAD;
+    const char *header = "Changes in FAT 1:\n";
+    uint64_t next = 0;
+    struct fat_change_run run = {0};
+
+    for (uint64_t block = fat_start / DIFF_BLOCK_SIZE; block < d->blocks && block * DIFF_BLOCK_SIZE < fat_start + fat_bytes; block++){
+        uint64_t low, high, first, last;
+        if (!d->changed[block])
+            continue;
+        low = block * DIFF_BLOCK_SIZE > fat_start ? block * DIFF_BLOCK_SIZE - fat_start : 0;
+        high = (block + 1) * DIFF_BLOCK_SIZE - fat_start < fat_bytes ? (block + 1) * DIFF_BLOCK_SIZE - fat_start : fat_bytes;
+        // Entries with any byte in the block, FAT12 entries can straddle two blocks
+        first = fat_sector->is_fat32 ? low / 4 : fat_sector->is_fat16 ? low / 2 : low * 2 / 3;
+        last = fat_sector->is_fat32 ? (high + 3) / 4 : fat_sector->is_fat16 ? (high + 1) / 2 : (high * 2 + 2) / 3;
+        if (first < next)
+            first = next;
+        if (last > entries)
+            last = entries;
+        for (uint64_t cluster = first; cluster < last; cluster++){
+            uint32_t value_before = diff_fat_entry(d->before, cluster);
+            uint32_t value_after = diff_fat_entry(d->after, cluster);
+            int type;
+            if (value_before == value_after){
+                flush_fat_change(d, &run, &header);
+                continue;
+            }
+            if (value_after == bad)
+                type = FAT_CHANGE_MARKED_BAD;
+            else if (value_before == bad)
+                type = FAT_CHANGE_UNMARKED_BAD;
+            else if (value_before == 0)
+                type = FAT_CHANGE_ALLOCATED;
+            else if (value_after == 0)
+                type = FAT_CHANGE_FREED;
+            else
+                type = FAT_CHANGE_RELINKED;
+            if (run.open && type == run.type && cluster == run.end + 1){
+                run.end = cluster;
+                continue;
+            }
+            flush_fat_change(d, &run, &header);
+            run = (struct fat_change_run){true, cluster, cluster, value_before, value_after, type};
+        }
+        next = last;
+    }
+    flush_fat_change(d, &run, &header);
+    fg = d->before;
+
+    // The other FATs should match FAT1, the differences between FATs are reported by the normal run
+    for (uint32_t i = 1; i < fat_sector->number_of_fats; i++){
+        uint64_t start = fat_start + (uint64_t)i * fat_bytes;
+        uint64_t changed = 0;
+        uint8_t *a = malloc(DIFF_BLOCK_SIZE);
+        uint8_t *b = malloc(DIFF_BLOCK_SIZE);
+        for (uint64_t offset = start; offset < start + fat_bytes; ){
+            uint64_t block = offset / DIFF_BLOCK_SIZE;
+            uint32_t length = (block + 1) * DIFF_BLOCK_SIZE - offset;
+            uint32_t first;
+            if (length > start + fat_bytes - offset)
+                length = start + fat_bytes - offset;
+            if (block < d->blocks && d->changed[block]){
+                diff_read(d->before, a, length, offset);
+                diff_read(d->after, b, length, offset);
+                changed += count_differing_bytes(a, b, length, &first);
+            }
+            offset += length;
+        }
+        fg = d->before;
+        if (changed){
+            report("FAT %u: %ju bytes changed.\n", i + 1, (uintmax_t)changed);
+            d->changes++;
+        }
+        free(a);
+        free(b);
+    }
+}
+
+/**
+ * @brief Returns the first cluster of a directory entry
+ */
+static uint32_t entry_cluster(struct fat_boot_sector *fat_sector, const uint8_t *raw){
+    uint32_t cluster = le16(raw + LOW_CLUSTER_ADDR);
+
+    if (fat_sector->is_fat32)
+        cluster |= (uint32_t)le16(raw + HIGH_CLUSTER_ADDR) << 16;
+    return cluster;
+}
+
+/**
+ * @brief Orders directory entries by name, ignoring case as FAT does
+ */
+static int compare_diff_entries(const void *a, const void *b){
+    return strcasecmp(((const struct diff_entry *)a)->name, ((const struct diff_entry *)b)->name);
+}
+
+/**
+ * @brief Frees the entries read by read_diff_directory
+ */
+static void free_diff_entries(struct diff_entry *entries, uint64_t count){
+    for (uint64_t i = 0; i < count; i++)
+        free(entries[i].name);
+    free(entries);
+}
+
+/**
+ * @brief Adds the live entries of one buffer of a directory to the listing
+ * @return true at the end of directory marker
+ */
+static bool add_diff_entries(struct diff_listing *list, const uint8_t *data, uint32_t length){
+    char name[LFN_NAME_SIZE];
+
+    for (uint32_t offset = 0; offset + 32 <= length; offset += 32){
+        const uint8_t *raw = data + offset;
+        struct diff_entry *entry;
+        if (raw[0] == 0)
+            return true;
+        // Long name entries are gathered as the walk does, a run can go on into the next cluster
+        if (raw[FILE_ATTRIBUTES] == FLAG_FAT_LONG_FILE_NAME){
+            if (list->lfn_count < LFN_MAX_ENTRIES)
+                memcpy(list->lfn[list->lfn_count], raw, 32);
+            list->lfn_count++;
+            continue;
+        }
+        if (raw[0] == UNALLOCATED || raw[0] == '.' || raw[FILE_ATTRIBUTES] & FLAG_FAT_VOLUME_LABEL){
+            list->lfn_count = 0;
+            continue;
+        }
+        if (!decode_long_name(list->lfn, list->lfn_count, raw, name))
+            format_short_name(raw, name);
+        list->lfn_count = 0;
+        if (list->count == list->capacity){
+            struct diff_entry *grown;
+            list->capacity = list->capacity ? list->capacity * 2 : 64;
+            grown = realloc(list->entries, list->capacity * sizeof(struct diff_entry));
+            if (grown == NULL){
+                free_diff_entries(list->entries, list->count);
+                list->entries = NULL;
+                fprintf(stderr, "Aborting... Out of memory while reading a directory.\n");
+                fatal();
+            }
+            list->entries = grown;
+        }
+        entry = &list->entries[list->count];
+        memcpy(entry->raw, raw, 32);
+        entry->paired = false;
+        entry->name = strdup(name);
+        if (entry->name == NULL){
+            free_diff_entries(list->entries, list->count);
+            list->entries = NULL;
+            fprintf(stderr, "Aborting... Out of memory while reading a directory.\n");
+            fatal();
+        }
+        list->count++;
+    }
+    return false;
+}
+
+/**
+ * @brief Reads the live entries of a directory in one of the images with their long names, sorted
+ * by name.  Deleted entries, the volume label, and the dot entries are left out.
+ *
+ * @param cluster first cluster of the directory, 0 for the FAT12/16 root directory
+ * @param changed set if any of its clusters or FAT entries are in a changed block
+ */
+static struct diff_entry* read_diff_directory(struct image_diff *d, struct fg_volume *volume, uint32_t cluster, uint64_t *count, bool *changed){
+    struct fat_boot_sector *fat_sector = volume->fat_bs;
+    uint32_t cluster_size = volume->bps * volume->spc;
+    uint64_t fat_start = (uint64_t)fat_sector->reserved_area_size * volume->bps;
+    uint32_t eof = fat_sector->is_fat32 ? FAT32_EOF : fat_sector->is_fat16 ? FAT16_EOF : FAT12_EOF;
+    struct diff_listing list = {0};
+    uint64_t end, steps = 0;
+    uint8_t *buf;
+    bool done = false;
+
+    fg = volume;
+    end = data_cluster_count(fat_sector) + 2;
+
+    if (cluster == 0 && !fat_sector->is_fat32){
+        // The FAT12/16 root directory has a fixed place after the FATs
+        uint64_t offset = fat_start + (uint64_t)fat_sector->number_of_fats * volume->fat_size_in_bytes;
+        uint32_t length = fat_sector->max_files_in_root * 32;
+        buf = malloc(length ? length : 1);
+        if (buf == NULL){
+            fprintf(stderr, "Aborting... Out of memory while reading a directory.\n");
+            fatal();
+        }
+        *changed |= range_changed(d, offset, length);
+        diff_read(volume, buf, length, offset);
+        add_diff_entries(&list, buf, length);
+    }
+    else{
+        buf = malloc(cluster_size);
+        if (buf == NULL){
+            fprintf(stderr, "Aborting... Out of memory while reading a directory.\n");
+            fatal();
+        }
+        // The step limit stops at a chain that loops back on itself
+        while (!done && cluster >= 2 && cluster < end && cluster < eof && steps++ < end){
+            fg = volume;
+            *changed |= range_changed(d, cts(cluster), cluster_size) ||
+                range_changed(d, fat_start + fat_entry_offset(fat_sector, cluster), fat_sector->is_fat32 ? 4 : 2);
+            diff_read(volume, buf, cluster_size, cts(cluster));
+            done = add_diff_entries(&list, buf, cluster_size);
+            cluster = diff_fat_entry(volume, cluster);
+        }
+    }
+    free(buf);
+    fg = d->before;
+    if (list.count)
+        qsort(list.entries, list.count, sizeof(struct diff_entry), compare_diff_entries);
+    *count = list.count;
+    return list.entries;
+}
+
+/**
+ * @brief Counts a change to the directories and files, printing the heading before the first one
+ */
+static void begin_change(struct image_diff *d){
+    if (d->header != NULL){
+        report("%s", d->header);
+        d->header = NULL;
+    }
+    d->changes++;
+}
+
+/**
+ * @brief Compares the clusters of a file that lie in changed blocks, the contents and the slack
+ * after the end of the file separately.  This is done even when the directory entry did not
+ * change, a file can be overwritten in place.
+ */
+static void diff_file_data(struct image_diff *d, const char *path, const uint8_t *raw_after){
+    struct fat_boot_sector *fat_sector = d->after->fat_bs;
+    uint32_t cluster_size = d->after->bps * d->after->spc;
+    uint32_t eof = fat_sector->is_fat32 ? FAT32_EOF : fat_sector->is_fat16 ? FAT16_EOF : FAT12_EOF;
+    uint32_t cluster = entry_cluster(fat_sector, raw_after);
+    uint64_t remaining = le32(raw_after + FILE_SIZE);
+    uint64_t clusters = 0, changed_clusters = 0;
+    uint64_t slack_changed = 0, slack_length = 0, slack_first = 0;
+    uint64_t end, steps = 0;
+    uint8_t *a = malloc(cluster_size);
+    uint8_t *b = malloc(cluster_size);
+
+    fg = d->after;
+    end = data_cluster_count(fat_sector) + 2;
+    // Everything after the end of the file up to the end of its chain is slack
+    while (cluster >= 2 && cluster < end && cluster < eof && steps++ < end){
+        uint32_t used = remaining < cluster_size ? remaining : cluster_size;
+        fg = d->after;
+        if (range_changed(d, cts(cluster), cluster_size)){
+            uint32_t first = 0;
+            diff_read(d->before, a, cluster_size, cts(cluster));
+            diff_read(d->after, b, cluster_size, cts(cluster));
+            if (used && count_differing_bytes(a, b, used, &first))
+                changed_clusters++;
+            if (used < cluster_size){
+                uint32_t differ = count_differing_bytes(a + used, b + used, cluster_size - used, &first);
+                if (differ && slack_changed == 0){
+                    fg = d->after;
+                    slack_first = cts(cluster) + used + first;
+                }
+                slack_changed += differ;
+            }
+        }
+        if (used)
+            clusters++;
+        slack_length += cluster_size - used;
+        remaining -= used;
+        cluster = diff_fat_entry(d->after, cluster);
+    }
+    fg = d->before;
+    if (changed_clusters){
+        begin_change(d);
+        report("  Contents of %s changed in %ju of %ju clusters\n", path, (uintmax_t)changed_clusters, (uintmax_t)clusters);
+    }
+    if (slack_changed){
+        begin_change(d);
+        report("  Slack of %s changed: %ju of %ju bytes differ, the first at offset 0x%jx\n", path, (uintmax_t)slack_changed,
+            (uintmax_t)slack_length, (uintmax_t)slack_first);
+    }
+    free(a);
+    free(b);
+}
+
+/**
+ * @brief Marks every cluster of the after image whose chain runs on into a changed block of the
+ * data area, so diff_directory can skip the files with no changed clusters without walking their
+ * chains.  The FAT only links forward, so it is read once to find the cluster before each one.
+ * If that fails, or two chains join, d->changed_chains is left NULL and every chain is followed.
+ */
+static void find_changed_chains(struct image_diff *d){
+    struct fg_volume *volume = d->after;
+    struct fat_boot_sector *fat_sector = volume->fat_bs;
+    uint32_t cluster_size = volume->bps * volume->spc;
+    uint64_t end = data_cluster_count(fat_sector) + 2;
+    uint64_t first_block, last_block;
+    uint32_t *previous = NULL;
+
+    fg = volume;
+    d->changed_chains = calloc((end + 7) / 8, 1);
+    first_block = cts(2) / DIFF_BLOCK_SIZE;
+    last_block = (cts(2) + (end - 2) * cluster_size + DIFF_BLOCK_SIZE - 1) / DIFF_BLOCK_SIZE;
+    // With no changed clusters no chain is followed
+    if (d->changed_chains == NULL || !range_changed(d, cts(2), (end - 2) * cluster_size))
+        goto done;
+
+    previous = calloc(end, sizeof(uint32_t));
+    if (previous == NULL){
+        free(d->changed_chains);
+        d->changed_chains = NULL;
+        goto done;
+    }
+    for (uint64_t cluster = 2; cluster < end; cluster++){
+        uint32_t next = diff_fat_entry(volume, cluster);
+        if (next < 2 || next >= end)
+            continue;
+        if (previous[next] != 0){
+            free(d->changed_chains);
+            d->changed_chains = NULL;
+            goto done;
+        }
+        previous[next] = cluster;
+    }
+    for (uint64_t block = first_block; block < last_block && block < d->blocks; block++){
+        uint64_t low, high;
+        if (!d->changed[block])
+            continue;
+        low = block * DIFF_BLOCK_SIZE < cts(2) ? 2 : (block * DIFF_BLOCK_SIZE - cts(2)) / cluster_size + 2;
+        high = ((block + 1) * DIFF_BLOCK_SIZE - cts(2) + cluster_size - 1) / cluster_size + 2;
+        for (uint64_t cluster = low; cluster < high && cluster < end; cluster++){
+            // A cluster already marked has had the clusters before it marked too, which keeps the pass linear
+            for (uint64_t at = cluster; at != 0 && !(d->changed_chains[at / 8] & 1 << at % 8); at = previous[at])
+                d->changed_chains[at / 8] |= 1 << at % 8;
+        }
+    }
+done:
+    free(previous);
+    fg = d->before;
+}
+
+/**
+ * @brief Tells whether the chain starting at a cluster of the after image runs through a changed block
+ */
+static bool chain_changed(struct image_diff *d, uint32_t cluster){
+    if (d->changed_chains == NULL)
+        return true;
+    if (cluster < 2 || cluster >= data_cluster_count(d->after->fat_bs) + 2)
+        return false;
+    return d->changed_chains[cluster / 8] & 1 << cluster % 8;
+}
+
+/**
+ * @brief Appends a comma separated part to the description of a modified entry
+ */
+static void append_change(char *what, size_t size, size_t *length, const char *format, ...){
+    va_list ap;
+
+    va_start(ap, format);
+    if (*length < size)
+        *length += vsnprintf(what + *length, size - *length, format, ap);
+    va_end(ap);
+}
+
+static void diff_directory(struct image_diff *d, const char *path, uint32_t cluster_before, uint32_t cluster_after, uint32_t depth);
+
+/**
+ * @brief Reports how an entry present in both images changed, and follows it into its
+ * subdirectory or compares its contents
+ *
+ * @param child_before path of the entry in the before image, the same as child unless it was renamed
+ */
+static void diff_matched_entries(struct image_diff *d, const char *child_before, const char *child, const uint8_t *a, const uint8_t *b,
+    bool changed, uint32_t depth){
+    struct fat_boot_sector *fat_sector = d->after->fat_bs;
+    bool directory = a[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY;
+    bool renamed = strcmp(child_before, child) != 0;
+
+    if ((changed && memcmp(a, b, 32) != 0) || renamed){
+        char what[256] = "";
+        size_t length = 0;
+        // A rename changes the 8.3 name too, it is only worth listing when the long name stayed
+        if (!renamed && memcmp(a, b, 11)){
+            char name_a[13], name_b[13];
+            format_short_name(a, name_a);
+            format_short_name(b, name_b);
+            append_change(what, sizeof(what), &length, ", 8.3 name %s -> %s", name_a, name_b);
+        }
+        if (a[FILE_ATTRIBUTES] != b[FILE_ATTRIBUTES])
+            append_change(what, sizeof(what), &length, ", attributes 0x%x -> 0x%x", a[FILE_ATTRIBUTES], b[FILE_ATTRIBUTES]);
+        if (le32(a + FILE_SIZE) != le32(b + FILE_SIZE))
+            append_change(what, sizeof(what), &length, ", size %u -> %u", le32(a + FILE_SIZE), le32(b + FILE_SIZE));
+        if (entry_cluster(fat_sector, a) != entry_cluster(fat_sector, b))
+            append_change(what, sizeof(what), &length, ", first cluster 0x%x -> 0x%x", entry_cluster(fat_sector, a), entry_cluster(fat_sector, b));
+        if (memcmp(a + CREATED_TIME_TENTHS, b + CREATED_TIME_TENTHS, ACCESSED_DAY - CREATED_TIME_TENTHS))
+            append_change(what, sizeof(what), &length, ", created time");
+        if (memcmp(a + ACCESSED_DAY, b + ACCESSED_DAY, 2))
+            append_change(what, sizeof(what), &length, ", accessed date");
+        if (memcmp(a + WRITTEN_TIME_HMS, b + WRITTEN_TIME_HMS, 4))
+            append_change(what, sizeof(what), &length, ", written time");
+        if (length == 0 && memcmp(a + FILE_ATTRIBUTES, b + FILE_ATTRIBUTES, 32 - FILE_ATTRIBUTES))
+            append_change(what, sizeof(what), &length, ", reserved bytes");
+        begin_change(d);
+        if (renamed)
+            report("  Renamed %s%s to %s%s%s%s\n", child_before, directory ? "/" : "", child, directory ? "/" : "", length ? ": " : "",
+                length ? what + 2 : "");
+        else
+            report("  Modified %s: %s\n", child, what + 2);
+    }
+    if (directory && (b[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY) && depth < DIFF_MAX_DEPTH)
+        diff_directory(d, child, entry_cluster(fat_sector, a), entry_cluster(fat_sector, b), depth + 1);
+    else if (!directory && !(b[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY) && chain_changed(d, entry_cluster(fat_sector, b)))
+        diff_file_data(d, child, b);
+}
+
+/**
+ * @brief Compares a directory of the two images entry by entry, by long name, and follows the
+ * subdirectories present in both.  An entry that is only in the before image and one that is only
+ * in the after image with the same first cluster are reported as a rename.  The FAT has no link
+ * from a cluster back to the directory entry of its file, so every directory is still read to
+ * find the files and subdirectories.  A directory with no changed clusters is read once, from the
+ * after image, and its entries are not compared, and the chains of files with no clusters in
+ * changed blocks are not walked.
+ */
+static void diff_directory(struct image_diff *d, const char *path, uint32_t cluster_before, uint32_t cluster_after, uint32_t depth){
+    struct fat_boot_sector *fat_sector = d->after->fat_bs;
+    uint64_t count_before, count_after;
+    bool changed = false;
+    struct diff_entry *after = read_diff_directory(d, d->after, cluster_after, &count_after, &changed);
+    struct diff_entry *before = after;
+    uint64_t i = 0, j = 0;
+    char child[DIFF_PATH_SIZE];
+    char child_before[DIFF_PATH_SIZE];
+
+    // The same clusters with the same FAT entries in unchanged blocks hold the same entries
+    count_before = count_after;
+    if (changed || cluster_before != cluster_after)
+        before = read_diff_directory(d, d->before, cluster_before, &count_before, &changed);
+
+    // Entries only in one image are marked unpaired, entries in both are compared right away
+    while (i < count_before || j < count_after){
+        int order = i == count_before ? 1 : j == count_after ? -1 : compare_diff_entries(&before[i], &after[j]);
+        if (order < 0){
+            before[i++].paired = false;
+            continue;
+        }
+        if (order > 0){
+            after[j++].paired = false;
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, after[j].name);
+        before[i].paired = after[j].paired = true;
+        diff_matched_entries(d, child, child, before[i].raw, after[j].raw, changed, depth);
+        i++;
+        j++;
+    }
+    if (before == after){
+        free_diff_entries(after, count_after);
+        return;
+    }
+
+    for (i = 0; i < count_before; i++){
+        const uint8_t *a = before[i].raw;
+        uint32_t cluster = entry_cluster(fat_sector, a);
+        if (before[i].paired)
+            continue;
+        snprintf(child_before, sizeof(child_before), "%s/%s", path, before[i].name);
+        // A renamed file or directory keeps its clusters
+        for (j = 0; cluster >= 2 && j < count_after; j++){
+            const uint8_t *b = after[j].raw;
+            if (!after[j].paired && entry_cluster(fat_sector, b) == cluster &&
+                (a[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY) == (b[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY))
+                break;
+        }
+        if (cluster >= 2 && j < count_after){
+            after[j].paired = true;
+            snprintf(child, sizeof(child), "%s/%s", path, after[j].name);
+            diff_matched_entries(d, child_before, child, a, after[j].raw, changed, depth);
+            continue;
+        }
+        begin_change(d);
+        report("  Removed %s%s\n", child_before, a[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY ? "/" : "");
+    }
+    for (j = 0; j < count_after; j++){
+        const uint8_t *b = after[j].raw;
+        if (after[j].paired)
+            continue;
+        snprintf(child, sizeof(child), "%s/%s", path, after[j].name);
+        begin_change(d);
+        if (b[FILE_ATTRIBUTES] & FLAG_FAT_DIRECTORY)
+            report("  Added %s/\n", child);
+        else
+            report("  Added %s (%u bytes)\n", child, le32(b + FILE_SIZE));
+    }
+    free_diff_entries(before, count_before);
+    free_diff_entries(after, count_after);
+}
+
+/**
+ * @brief Compares part of a changed block byte by byte
+ */
+static bool part_differs(struct image_diff *d, uint64_t offset, uint64_t length){
+    uint64_t common = d->before->image.size < d->after->image.size ? d->before->image.size : d->after->image.size;
+    uint8_t *a, *b;
+    bool differ;
+
+    if (offset + length > common)
+        return true;
+    a = malloc(length);
+    b = malloc(length);
+    if (a == NULL || b == NULL){
+        free(a);
+        free(b);
+        return true;
+    }
+    diff_read(d->before, a, length, offset);
+    diff_read(d->after, b, length, offset);
+    differ = memcmp(a, b, length) != 0;
+    free(a);
+    free(b);
+    fg = d->before;
+    return differ;
+}
+
+/**
+ * @brief Counts the changed blocks in each region of the FAT volume.  A block that spans the
+ * boundary between regions counts in each region whose part of it changed.
+ */
+static void print_diff_regions(struct image_diff *d){
+    struct fat_boot_sector *fat_sector = d->after->fat_bs;
+    uint64_t fat_start = (uint64_t)fat_sector->reserved_area_size * d->after->bps;
+    uint64_t data_start = fat_start + (uint64_t)fat_sector->number_of_fats * d->after->fat_size_in_bytes;
+    uint64_t sectors = fat_sector->sector_count_16b ? fat_sector->sector_count_16b : fat_sector->sector_count_32b;
+    uint64_t volume_end = sectors * d->after->bps;
+    uint64_t bounds[4] = {fat_start, data_start, volume_end, UINT64_MAX};
+    uint64_t counts[4] = {0};
+
+    for (uint64_t block = 0; block < d->blocks; block++){
+        uint64_t start = block * DIFF_BLOCK_SIZE;
+        uint64_t end = start + DIFF_BLOCK_SIZE;
+        uint64_t region_start = 0;
+        if (!d->changed[block])
+            continue;
+        for (int region = 0; region < 4; region++){
+            uint64_t part_start = start > region_start ? start : region_start;
+            uint64_t part_end = end < bounds[region] ? end : bounds[region];
+            region_start = bounds[region];
+            if (part_start >= part_end)
+                continue;
+            // A block that holds the end of one region and the start of the next is split there
+            if ((part_start == start && part_end == end) || part_differs(d, part_start, part_end - part_start))
+                counts[region]++;
+        }
+    }
+    report("Changed blocks: %ju in the reserved area, %ju in the FATs, %ju in the root directory and data area, %ju past the end of the volume.\n",
+        (uintmax_t)counts[0], (uintmax_t)counts[1], (uintmax_t)counts[2], (uintmax_t)counts[3]);
+}
+
+/**
+ * @brief Compares the partition tables of two full disk images and counts the changed blocks in
+ * each partition
+ */
+static void diff_mbr(struct image_diff *d){
+    uint64_t counts[5] = {0};
+
+    for (int i = 0; i < 4; i++){
+        struct partition_table *a = &d->before->mbr->entry[i];
+        struct partition_table *b = &d->after->mbr->entry[i];
+        if (a->boot_indicator == b->boot_indicator && a->partition_type == b->partition_type &&
+            a->starting_sector == b->starting_sector && a->partition_size == b->partition_size)
+            continue;
+        report("  Partition %d: type 0x%x -> 0x%x, boot flag 0x%x -> 0x%x, start sector %u -> %u, %u -> %u sectors\n", i + 1,
+            a->partition_type, b->partition_type, a->boot_indicator, b->boot_indicator, a->starting_sector, b->starting_sector,
+            a->partition_size, b->partition_size);
+        d->changes++;
+    }
+    for (uint64_t block = 0; block < d->blocks; block++){
+        uint64_t sector = block * DIFF_BLOCK_SIZE / 512;
+        int where = 4;
+        if (!d->changed[block])
+            continue;
+        for (int i = 0; i < 4; i++){
+            struct partition_table *p = &d->after->mbr->entry[i];
+            if (p->partition_type != EMPTY_ENTRY && sector >= p->starting_sector && sector < (uint64_t)p->starting_sector + p->partition_size)
+                where = i;
+        }
+        counts[where]++;
+    }
+    for (int i = 0; i < 4; i++){
+        if (counts[i])
+            report("Partition %d (%s): %ju changed blocks.\n", i + 1, partition_type_txt[d->after->mbr->entry[i].partition_type], (uintmax_t)counts[i]);
+    }
+    if (counts[4])
+        report("Outside of the partitions: %ju changed blocks.\n", (uintmax_t)counts[4]);
+}
+
+/**
+ * @brief Compares two images of the same volume.  Both are hashed a block at a time, at the same
+ * time, and only the file contents and FAT entries in blocks whose digests differ are compared.
+ * FAT volumes with the same geometry are compared as file systems: the reserved area, the FAT
+ * entries, the directory entries, and the contents and slack of files.  The directories are
+ * still all read to find the files, see diff_directory.
+ */
+static void diff_images(struct fg_volume *before, struct fg_volume *after){
+    struct image_diff d = {before, after};
+    struct block_digests digests[2] = {{before}, {after}};
+    pthread_t threads[2];
+    bool started[2];
+    uint64_t size = before->image.size > after->image.size ? before->image.size : after->image.size;
+
+    fg = before;
+    report("\nComparing %s (before) with %s (after)\n", before->args.image_path, after->args.image_path);
+    if (before->image.size != after->image.size)
+        report("The images differ in size: %ju bytes before, %ju after.\n", (uintmax_t)before->image.size, (uintmax_t)after->image.size);
+
+    d.blocks = (size + DIFF_BLOCK_SIZE - 1) / DIFF_BLOCK_SIZE;
+    for (int i = 0; i < 2; i++){
+        digests[i].blocks = (digests[i].volume->image.size + DIFF_BLOCK_SIZE - 1) / DIFF_BLOCK_SIZE;
+        digests[i].digests = calloc(digests[i].blocks ? digests[i].blocks : 1, DIFF_DIGEST_SIZE);
+        if (digests[i].digests == NULL){
+            fprintf(stderr, "Aborting... Out of memory while hashing the images.\n");
+            fatal();
+        }
+        started[i] = pthread_create(&threads[i], NULL, diff_digest_worker, &digests[i]) == 0;
+        if (!started[i]){
+            diff_digest_worker(&digests[i]);
+            fg = before;
+        }
+    }
+    for (int i = 0; i < 2; i++){
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+    if (before->worker_failed || after->worker_failed){
+        free(digests[0].digests);
+        free(digests[1].digests);
+        fatal();
+    }
+
+    d.changed = calloc(d.blocks ? d.blocks : 1, 1);
+    for (uint64_t block = 0; block < d.blocks; block++){
+        d.changed[block] = block >= digests[0].blocks || block >= digests[1].blocks ||
+            memcmp(digests[0].digests[block], digests[1].digests[block], DIFF_DIGEST_SIZE) != 0;
+        d.changed_blocks += d.changed[block];
+    }
+    report("Hashed %ju blocks of %u KiB, %ju differ.\n\n", (uintmax_t)d.blocks, DIFF_BLOCK_SIZE / 1024, (uintmax_t)d.changed_blocks);
+
+    if (d.changed_blocks && before->fat_bs != NULL && after->fat_bs != NULL && same_fat_geometry(&d)){
+        diff_reserved_area(&d);
+        diff_fats(&d);
+        // If only the reserved area changed, the directories and files cannot have
+        fg = after;
+        if (range_changed(&d, (uint64_t)after->fat_bs->reserved_area_size * after->bps, size)){
+            d.header = "Changes in the directories and files:\n";
+            find_changed_chains(&d);
+            diff_directory(&d, "", after->fat_bs->is_fat32 ? before->fat_bs->root_dir_cluster : 0,
+                after->fat_bs->is_fat32 ? after->fat_bs->root_dir_cluster : 0, 0);
+        }
+        fg = before;
+        free(d.changed_chains);
+        print_diff_regions(&d);
+    }
+    else if (d.changed_blocks && before->mbr != NULL && after->mbr != NULL)
+        diff_mbr(&d);
+    fg = before;
+
+    if (d.changed_blocks == 0)
+        report("The images are identical.\n");
+    else
+        report("%ju change%s found.\n", (uintmax_t)d.changes, d.changes == 1 ? "" : "s");
+    free(d.changed);
+    free(digests[0].digests);
+    free(digests[1].digests);
+}
+
+/**
+ * @brief Fills in the default options, the same as the command line defaults
+ */
+void fg_default_options(struct fg_options *options){
+    memset(options, 0, sizeof(struct fg_options));
+    options->cache_size = (uint64_t)BLOCK_CACHE_DEFAULT_MB << 20;
+    options->seed = SAMPLE_DEFAULT_SEED;
+    options->checkpoint_interval = CHECKPOINT_DEFAULT_INTERVAL;
+    strcpy(options->extract_dir, "extracted");
+}
+
+/**
+ * @brief Makes volume the one the calling thread works on.  Every entry point calls this, then
+ * setjmp(volume->fail) so fatal errors return to it.
+ *
+ * @return bool : false if an earlier call on the volume already failed
+ */
+static bool enter_volume(struct fg_volume *volume){
+    fg = volume;
+    volume->api_thread = pthread_self();
+    return !volume->failed;
+}
+
+/**
+ * @brief Opens a disk image and checks that it holds the file system given in the options
+ *
+ * @return fg_volume* : the new volume, or NULL if the image could not be opened
+ */
+fg_volume* fg_open(const struct fg_options *options){
+    struct fg_volume *volume = calloc(1, sizeof(struct fg_volume));
+
+    if (volume == NULL)
+        return NULL;
+    volume->args = *options;
+    volume->fp = -1;
+    volume->tree_arena.fd = -1;
+    volume->bps = 512;
+    volume->out = stdout;
+    enter_volume(volume);
+    if (setjmp(volume->fail)){
+        fg_close(volume);
+        return NULL;
+    }
+
+    if (fg->args.resume && fg->args.checkpoint_path[0] == 0)
+        snprintf(fg->args.checkpoint_path, sizeof(fg->args.checkpoint_path), "%s.checkpoint", fg->args.image_path);
+    if (fg->args.checkpoint_path[0] && fg->args.sample_percent){
+        fprintf(stderr, "\nError! Checkpoints can not be used with --sample.\n");
+        fatal();
+    }
+    verify_fs_arg(&fg->args);
+    fg->fp = open_disk_image(&fg->args);
+    fg->fs_type = verify_disk_image(fg->fp, &fg->args);
+
+    if (fg->args.pattern_path[0])
+        load_patterns(&fg->matcher, fg->args.pattern_path);
+    init_progress(&fg->progress);
+    return volume;
+}
+
+/**
+ * @brief Sets where the report is written, NULL to only get findings through the callback
+ */
+void fg_set_output(fg_volume *volume, FILE *out){
+    volume->out = out;
+}
+
+/**
+ * @brief Sets a function called for every finding, as soon as it is found
+ */
+void fg_set_finding_callback(fg_volume *volume, fg_finding_callback callback, void *user){
+    volume->on_finding = callback;
+    volume->on_finding_user = user;
+}
+
+/**
+ * @brief Reads the MBR or the FAT boot sector and tables of the volume
+ */
+int fg_parse(fg_volume *volume){
+    if (!enter_volume(volume) || setjmp(volume->fail))
+        return -1;
+
+    if (fg->fs_type == RAW){
+        if (fg->args.sample_percent)
+            init_sampler(&fg->sample, &fg->args, 1);
+        fg->mbr = calloc(1, sizeof(struct mbr_sector));
+        read_mbr_sector(fg->fp, fg->mbr);
+        print_mbr_info(fg->mbr);
+    }
+
+    if (fg->fs_type == FAT32 || fg->fs_type == FAT16 || fg->fs_type == FAT12){
+        fg->fat_bs = calloc(1, sizeof(struct fat_boot_sector));
+        read_fat_boot_sector(fg->fp, fg->fat_bs, 0);
+        validate_fat_boot_sector(fg->fat_bs);
+        plan_memory_budget(&fg->args);
+        if (fg->args.sample_percent)
+            init_sampler(&fg->sample, &fg->args, fg->fs_type == FAT32 ? STRATUM_COUNT : STRATUM_COUNT - 1);
+        init_block_cache(&fg->cache, fg->bps * fg->spc, fg->args.cache_size);
+        print_fat_boot_sector_info(fg->fat_bs);
+        check_backup_boot_sector(fg->fat_bs);
+        copy_fats_into_memory(fg->fp, fg->fs_type, fg->fat_bs, &fg->fat1, &fg->fat2);
+        
+        // The readahead only needs the run lengths, the chain index is built for --fragmentation
+        if (fg->args.fragmentation || fg->cache.enabled)
+            analyze_layout(fg->fat_bs, &fg->layout, fg->args.fragmentation);
+        tune_readahead(&fg->cache, &fg->layout);
+        if (fg->args.fragmentation)
+            print_layout_report(&fg->layout);
+
+        if (fg->args.fat_extents)
+            print_fat_extents(fg->fat_bs);
+        else if (fg->args.v_flag == true) //print fat table in verbose mode, streamed from the image in bounded memory mode
+            print_full_fat_tables(fg->fat1, fg->fat2, fg->fat_bs);
+
+        estimate_progress(&fg->progress, fg->fat_bs);
+        if (fg->fs_type == FAT32)
+            fg->root_dir_off = cts(fg->fat_bs->root_dir_cluster);
+        if (fg->fs_type == FAT16)
+            fg->root_dir_off = fg->fat_bs->number_of_fats * (fg->fat_bs->fat_size_in_sectors * fg->bps) + (fg->fat_bs->reserved_area_size * fg->bps);
+    }
+    return 0;
+}
+
+/**
+ * @brief Searches the volume regions outside of files for hidden data (-h): the partition gaps of
+ * an MBR image, or the reserved area, FATs, volume slack and free clusters of a FAT volume
+ */
+int fg_scan(fg_volume *volume){
+    if (!enter_volume(volume) || setjmp(volume->fail))
+        return -1;
+
+    if (fg->fs_type == RAW && fg->args.h_flag && fg->mbr != NULL)
+        check_slack_space(fg->fp, fg->mbr);
+
+    if (fg->fat_bs != NULL && fg->args.h_flag){
+        if (fg->args.checkpoint_path[0])
+            init_checkpoint(&fg->ckpt);
+        progress_phase(PROGRESS_REGIONS);
+        if (fg->ckpt.phase == PHASE_REGIONS){
+            report("Checking the reserved area, FATs, volume slack, and bad clusters for hidden data.\n");
+            check_volume_regions(fg->fp, fg->fat_bs);
+            check_bad_clusters(fg->fp, fg->fat_bs);
+        }
+        if (fg->ckpt.phase <= PHASE_FREE_SPACE){
+            begin_phase(PHASE_FREE_SPACE);
+            progress_phase(PROGRESS_FREE_SPACE);
+            check_free_clusters(fg->fp, fg->fat_bs);
+        }
+        begin_phase(fg->fs_type == FAT32 && fg->ckpt.phase < PHASE_DONE ? PHASE_WALK : PHASE_DONE);
+    }
+    return 0;
+}
+
+/**
+ * @brief Walks the directory tree of a FAT32 volume, checking file and directory slack (-h),
+ * hashing files (--hash), collecting the timeline and the path index, and copying deleted and
+ * allocated files out of the image.  This finishes the scan, so the checkpoint file is removed.
+ */
+int fg_walk(fg_volume *volume){
+    bool collecting; // the walk gathers entries for something other than -h and --hash
+
+    if (!enter_volume(volume) || setjmp(volume->fail))
+        return -1;
+
+    if(fg->fs_type == FAT32 && fg->fat_bs != NULL){
+        if (fg->args.hash)
+            init_hash_pool(&fg->hashes, fg->args.threads, fg->args.max_memory);
+        fg->events.enabled = fg->args.timeline_path[0] || fg->args.bodyfile_path[0];
+        fg->recovered.enabled = fg->args.recover_path[0];
+        init_extraction(&fg->extracted);
+        if ((fg->args.index_path[0] || fg->args.find_name[0] || fg->args.ls_path[0]) && !(fg->args.index_path[0] && load_path_index(&fg->paths, fg->args.index_path)))
+            fg->paths.collecting = true;
+        collecting = fg->events.enabled || fg->paths.collecting || fg->recovered.enabled || fg->extracted.enabled;
+        if (collecting && fg->ckpt.resume_dir_count)
+            fprintf(stderr, "Warning!  The timeline, path index, recovery, and extraction only cover the directories read after resuming from the checkpoint.\n");
+        if ((fg->args.h_flag && fg->ckpt.phase == PHASE_WALK) || (!fg->args.h_flag && (fg->args.hash || collecting))){
+            report("Starting to read Fat32 filesystem.\n");
+            progress_phase(PROGRESS_WALK);
+            walk_fat32_filesystem(fg->fp, fg->fat_bs->root_dir_cluster);
+        }
+        finish_hash_pool(&fg->hashes);
+        finish_timeline(&fg->events);
+        finish_path_index(&fg->paths);
+        finish_recovery(&fg->recovered, fg->args.recover_path);
+        finish_extraction(&fg->extracted);
+        check_workers();
+        if (fg->args.v_flag && fg->args.hash)
+            report("Hashed %ju files, %ju bytes.\n", (uintmax_t)fg->hashes.files, (uintmax_t)fg->hashes.bytes);
+        if (fg->args.h_flag && !fg->hidden_data_found){
+            report("Completed reading file system.  No data was located in the slack regions of allocated clusters.\n");
+        }
+        if (fg->args.v_flag && fg->cache.enabled)
+            report("Cluster cache: %ju hits, %ju misses, %ju clusters read ahead.\n",
+                (uintmax_t)fg->cache.hits, (uintmax_t)fg->cache.misses, (uintmax_t)fg->cache.readahead_blocks);
+    }
+    finish_checkpoint(&fg->ckpt);
+    if (fg->fat_bs != NULL && fg->fs_type != FAT32 && fg->args.hash)
+        report("File hashing is only supported on FAT32 file systems.\n");
+    if (fg->fat_bs != NULL && fg->fs_type != FAT32 && (fg->args.timeline_path[0] || fg->args.bodyfile_path[0]))
+        report("Timelines are only supported on FAT32 file systems.\n");
+    if (fg->fat_bs != NULL && fg->fs_type != FAT32 && (fg->args.index_path[0] || fg->args.find_name[0] || fg->args.ls_path[0]))
+        report("Path indexes are only supported on FAT32 file systems.\n");
+    if (fg->fat_bs != NULL && fg->fs_type != FAT32 && fg->args.recover_path[0])
+        report("Deleted file recovery is only supported on FAT32 file systems.\n");
+    if (fg->fat_bs != NULL && fg->fs_type != FAT32 && (fg->args.extract_path[0] || fg->args.extract_all))
+        report("File extraction is only supported on FAT32 file systems.\n");
+    return 0;
+}
+
+/**
+ * @brief Stops progress reporting and prints the ranked findings, the sampling estimates and
+ * the pattern search totals
+ */
+int fg_summarize(fg_volume *volume){
+    if (!enter_volume(volume) || setjmp(volume->fail))
+        return -1;
+
+    finish_progress(&fg->progress);
+    if (fg->args.h_flag)
+        print_ranked_findings(&fg->findings);
+    if (fg->sample.enabled)
+        print_sample_report(&fg->sample);
+    if (fg->matcher.enabled)
+        report("Pattern search complete: %ju hits for %u patterns.\n", (uintmax_t)fg->matcher.hits, fg->matcher.pattern_count);
+    return 0;
+}
+
+/**
+ * @brief Compares two parsed volumes, e.g. two acquisitions of the same card, and reports what
+ * changed from before to after.  The report goes to the output of before.
+ */
+int fg_diff(fg_volume *before, fg_volume *after){
+    FILE *after_out = after->out;
+
+    if (!enter_volume(after) || setjmp(after->fail)){
+        after->out = after_out;
+        return -1;
+    }
+    if (!enter_volume(before) || setjmp(before->fail)){
+        after->out = after_out;
+        return -1;
+    }
+    after->out = before->out;
+    diff_images(before, after);
+    after->out = after_out;
+    return 0;
+}
+
+bool fg_hidden_data_found(fg_volume *volume){
+    return volume->hidden_data_found;
+}
+
+/**
+ * @brief Releases everything held by a volume
+ */
+void fg_close(fg_volume *volume){
+    if (volume == NULL)
+        return;
+    fg = volume;
+    finish_progress(&fg->progress);
+    finish_hash_pool(&fg->hashes);
+    if (fg->ckpt.enabled){
+        // The scan did not finish, the checkpoint file is kept so it can be resumed
+        free(fg->ckpt.resume_clusters);
+        free(fg->ckpt.resume_names);
+        free(fg->ckpt.resume_long_names);
+        free(fg->ckpt.resume_depths);
+    }
+    if (fg->fp > 0)
+        close(fg->fp); // close file
+    if (fg->mbr != NULL)
+        free(fg->mbr);
+    if (fg->fat_bs != NULL)
+        free(fg->fat_bs);
+    free(fg->boot_region);
+    if (fg->fat1 != NULL)
+        free(fg->fat1);
+    if (fg->fat2 != NULL)
+        free(fg->fat2);
+    free(fg->dirs.items);
+    free(fg->events.entries);
+    free(fg->events.keys);
+    free(fg->paths.records);
+    free(fg->paths.names);
+    free(fg->recovered.jobs);
+    free(fg->extracted.jobs);
+    free_arena(&fg->tree_arena);
+    free_fat_page_cache(&fg->fat_cache);
+    free_extents(&fg->free_space);
+    free_extents(&fg->bad_clusters);
+    free_patterns(&fg->matcher);
+    free(fg->findings.items);
+    free_block_cache(&fg->cache);
+    close_image_backend(&fg->image);
+    free(volume);
+    fg = NULL;
+    
+    //Need to add code to cleanup MBR Table structs
+}
@@ -0,0 +1,99 @@
+/**
+ * @file feelergauge.h
+ * @brief Feeler Gauge library interface
+ *
+ * Every volume is analyzed through its own fg_volume context, so several volumes can be opened and
+ * scanned at the same time, one per thread.  A context must only be used by one thread at a time.
+ *
+ * Typical use:
+ *  fg_default_options(&options);
+ *  (fill in image_path, file_system, h_flag, ...)
+ *  volume = fg_open(&options);
+ *  fg_set_finding_callback(volume, callback, user);
+ *  fg_parse(volume);
+ *  fg_scan(volume);
+ *  fg_walk(volume);
+ *  fg_summarize(volume);
+ *  fg_close(volume);
+ *
+ * Two parsed volumes, e.g. two acquisitions of the same card, can be compared with fg_diff() instead
+ * of being scanned.
+ *
+ * The report is written to stdout unless fg_set_output() picks another stream, or NULL for none.
+ * The functions returning int return 0 on success and -1 if the image could not be read, after
+ * which the volume can only be closed.
+ */
+
+#ifndef FEELERGAUGE_H
+#define FEELERGAUGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Opaque per volume context
+typedef struct fg_volume fg_volume;
+
+// What to analyze and how, the same settings as the command line options
+typedef struct fg_options {
+    bool v_flag; // verbose
+    bool h_flag; // search for hidden data
+
+    char image_path[255];
+    char file_system[8]; // fat12, fat16, fat32, ntfs or raw
+    int fs_type;
+    uint64_t cache_size; // in bytes
+    bool hash; // hash the contents of every file
+    uint32_t threads; // hashing worker threads
+    char pattern_path[255];
+    double sample_percent; // 0 to check everything
+    uint64_t seed;
+    double time_budget; // seconds, 0 for no limit
+    uint64_t byte_budget; // bytes, 0 for no limit
+    char checkpoint_path[512];
+    double checkpoint_interval; // seconds
+    bool resume;
+    bool progress;
+    char status_path[512];
+    uint64_t max_memory; // in bytes, 0 if unbounded
+    bool fat_extents; // list FAT1 as runs of clusters instead of printing every entry
+    bool fragmentation; // report how fragmented the files and free space are
+    char timeline_path[512]; // CSV of every created, accessed, and written time, sorted by time
+    char bodyfile_path[512]; // the same times in the Sleuth Kit body file format, for mactime
+    char index_path[512]; // path index file, loaded if it matches the image, written otherwise
+    char find_name[255]; // list the paths whose file name matches this pattern
+    char ls_path[512]; // list everything under this directory
+    char recover_path[512]; // copy the deleted files whose clusters are still free to this directory
+    char extract_path[512]; // copy this file, or everything under this directory, out of the image
+    bool extract_all; // copy every allocated file out of the image
+    bool extract_slack; // also write the slack of each extracted file to <file>.slack
+    char extract_dir[512]; // where extracted files go
+} fg_options;
+
+// A region that holds data it should not, passed to the finding callback
+typedef struct fg_finding {
+    const char *region; // kind of region, e.g. "file slack" or "free clusters"
+    const char *label; // which one, e.g. the file name or cluster range
+    uint64_t offset; // image offset of the region
+    uint64_t length;
+    uint64_t nonzero; // non-zero bytes in the region
+    uint64_t first_nonzero; // image offset of the first one
+    double entropy; // bits per byte of the non-zero bytes
+    const char *kind; // likely content, e.g. "text" or "compressed or encrypted"
+} fg_finding;
+
+typedef void (*fg_finding_callback)(const struct fg_finding *finding, void *user);
+
+void fg_default_options(struct fg_options *options);
+fg_volume* fg_open(const struct fg_options *options);
+void fg_set_output(fg_volume *volume, FILE *out);
+void fg_set_finding_callback(fg_volume *volume, fg_finding_callback callback, void *user);
+int fg_parse(fg_volume *volume);
+int fg_scan(fg_volume *volume);
+int fg_walk(fg_volume *volume);
+int fg_summarize(fg_volume *volume);
+int fg_diff(fg_volume *before, fg_volume *after);
+bool fg_hidden_data_found(fg_volume *volume);
+void fg_close(fg_volume *volume);
+
+#endif
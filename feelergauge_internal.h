@@ -0,0 +1,1684 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <zlib.h>
+#include <openssl/evp.h>
+#ifdef FG_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "feelergauge.h"
+
+static void fatal(void) __attribute__((noreturn));
+
+static void read_error(void) {
+    fprintf(stderr, "Unable to read disk image. Please make sure the file has not been moved or deleted.\n");
+    fatal();
+}
+
+// Text Headers when printing MBR to console
+static const char header[7][10] = {
+    "ENTRY#",
+    "BOOT",
+    "START",
+    "END",
+    "BLOCKS",
+    "ID",
+    "TYPE"
+};
+
+
+/**
+ * @brief Common partition type codes for MBR entries
+ */
+enum partition_type {
+    FAT12 = 0x1,
+    FAT16 = 0x4,
+    FAT32_CHS = 0x0B,
+    FAT32 = 0x0C, //FAT32 with LBA
+    EXTENDED = 0x05,
+    EXTENDED_LBA = 0x0F,
+    NTFS = 0x7,
+    LINUX_SWAP = 0x82,
+    LINUX_FILE_SYS = 0x83,
+    EMPTY_ENTRY = 0x00,
+    RAW = 0
+};
+
+/**
+ * @brief Common offsets within MBR/EBR table
+ */
+enum offsets {
+    // Master Boot Record Offsets
+    MBR_SIG_OFF = 0x1FE, // MBR Signature Field Offset
+    MBR_PART1_OFF = 0x1BE, // MBR Partition 1 Field Offset
+    MBR_PART2_OFF = 0x1CE, // MBR Partition 2 Field Offset
+    MBR_PART3_OFF = 0x1DE, // MBR Partition 3 Field Offset
+    MBR_PART4_OFF = 0x1EE, // MBR Partition 4 Field Offset
+
+    // MBR Partition Table Entry Relative Offsets
+    BOOT_INDICATOR = 0,
+    PARTITION_TYPE = 4,
+    STARTING_SECTOR = 8,
+    PARTITION_SIZE = 12,
+
+    // Extended Boot Record Offsets
+    EBR_PART_TABLE_OFF = 0x1BE,
+    EBR_ENTRY_OFF = 0x1BE,
+    EBR_NEXT_PART_OFF = 0x1CE,
+    ERB_SIG_OFF = 0x1FE,
+
+    // FAT Boot Sector Offsets
+    JUMP_INSTRUCTION = 0,
+    OEM_NAME = 3,
+    BYTES_PER_SECTOR = 11,
+    SECTORS_PER_CLUSTER = 13,
+    RESERVED_AREA_SIZE = 14,
+    NUMBER_OF_FATS = 16,
+    MAX_FILES_IN_ROOT = 17,
+    SECTOR_COUNT_16B = 19,
+    MEDIA_TYPE = 21,
+    FAT_SIZE_IN_SECTORS = 22,
+    SECTORS_PER_TRACK = 24,
+    HEAD_NUMBER = 26,
+    SECTORS_BEFORE_PARTITION = 28,
+    SECTOR_COUNT_32B = 32,
+    BIOS_DRIVE_NUMBER = 36,
+    EXTENDED_BOOT_SIG = 38,
+    VOLUME_SERIAL = 39,
+    VOLUME_LABEL = 43,
+    FS_TYPE_LABEL = 54,
+    FAT_RESERVED = 37,
+    FAT_BOOT_CODE = 62,
+    FS_SIGNATURE = 510,
+
+    // FAT32 Boot Sector Extended Offsets
+    FAT32_SIZE_IN_SECTORS = 36,
+    FAT_MODE = 40,
+    FAT32_VERSION = 42,
+    ROOT_DIR_CLUSTER = 44,
+    FSINFO_SECTOR = 48,
+    BACKUP_BOOT_SECTOR_ADDR = 50,
+    FAT32_BIOS_DRIVE_NUMBER = 64,
+    FAT32_EXTENDED_BOOT_SIG = 66,
+    FAT32_VOLUME_SERIAL= 67,
+    FAT32_VOLUME_LABEL =  71,
+    FAT32_FS_TYPE_LABEL = 82,
+    FAT32_RESERVED = 52,
+    FAT32_RESERVED_1 = 65,
+    FAT32_BOOT_CODE = 90,
+
+    // FAT32 FSINFO Sector Offsets
+    FSINFO_LEAD_SIG_OFF = 0,
+    FSINFO_RESERVED = 4,
+    FSINFO_STRUCT_SIG_OFF = 484,
+    FSINFO_FREE_COUNT = 488,
+    FSINFO_NEXT_FREE = 492,
+    FSINFO_RESERVED_2 = 496,
+    FSINFO_TRAIL_SIG_OFF = 508,
+
+    // FAT Directory Entry
+    ALLOCATION_STATUS = 0,
+    FILE_NAME = 0,
+    FILE_ATTRIBUTES = 11,
+    CREATED_TIME_TENTHS = 13,
+    CREATED_TIME_HMS = 14,
+    CREATED_DAY = 16,
+    ACCESSED_DAY = 18,
+    HIGH_CLUSTER_ADDR = 20,
+    WRITTEN_TIME_HMS = 22,
+    WRITTEN_DAY = 24,
+    LOW_CLUSTER_ADDR = 26,
+    FILE_SIZE = 28,
+    NAME_CASE_FLAGS = 12, // set by Windows NT for 8.3 names that are all lower case
+
+    // FAT Long File Name Entry
+    LFN_SEQUENCE = 0,
+    LFN_CHARS_1 = 1, // five UTF-16 characters
+    LFN_CHECKSUM = 13,
+    LFN_CHARS_2 = 14, // six
+    LFN_CHARS_3 = 28, // two
+
+
+    // FAT Flag Values
+    FLAG_FAT_READ_ONLY = 0x1,
+    FLAG_FAT_HIDDEN_FILE = 0x2,
+    FLAG_FAT_SYSTEM_FILE = 0x3,
+    FLAG_FAT_VOLUME_LABEL = 0x8,
+    FLAG_FAT_LONG_FILE_NAME = 0x0F,
+    FLAG_FAT_DIRECTORY = 0x10,
+    FLAG_FAT_ARCHIVE = 0x20,
+
+    // Name case flags
+    FLAG_LOWER_CASE_BASE = 0x08,
+    FLAG_LOWER_CASE_EXTENSION = 0x10,
+
+    // Long file name sequence numbers
+    LFN_LAST_ENTRY = 0x40,
+    LFN_SEQUENCE_MASK = 0x1F
+};
+
+enum media_types{
+    REMOVABLE = 0xf0,
+    FIXED = 0xf8
+};
+
+/**
+ * @brief 
+ */
+enum signatures {
+    MBR_SIG = 0x55AA,
+    NTFS_SIG = 0xEB5290,
+    FAT12_SIG = 0xEB3F90,
+    FAT16_SIG = 0xEB3C90,
+    FAT32_SIG = 0xEB5890,
+    FSINFO_LEAD_SIG = 0x41615252,
+    FSINFO_STRUCT_SIG = 0x61417272,
+    FSINFO_TRAIL_SIG = 0xAA550000,
+    FSINFO_UNKNOWN = 0xFFFFFFFF // free count or next free cluster not set
+};
+
+/**
+ * @brief 
+ */
+enum eof {
+    FAT12_EOF = 0xff8,
+    FAT16_EOF = 0xfff8,
+    FAT32_EOF = 0x0ffffff8
+};
+
+/**
+ * @brief 
+ */
+enum bad_sector {
+    FAT12_BAD = 0xff7,
+    FAT16_BAD = 0xfff7,
+    FAT32_BAD = 0x0ffffff7
+};
+
+/**
+ * @brief Bits of a FAT entry
+ */
+enum fat_entry_bits {
+    FAT32_ENTRY_MASK = 0x0fffffff // the top 4 bits of a FAT32 entry are reserved
+};
+
+/**
+ * @brief Limits past which the bad cluster count of a volume is reported as implausible
+ */
+enum bad_cluster_thresholds {
+    BAD_CLUSTERS_REMOVABLE_PERMILLE = 10 // more bad clusters than this on removable media is implausible
+};
+
+/**
+ * @brief 
+ */
+enum file_allocation_status {
+    UNALLOCATED = 0xe5
+};
+
+/**
+ * @brief Container format of the disk image supplied with -i
+ */
+enum image_format {
+    IMAGE_RAW = 0,
+    IMAGE_GZIP = 1,
+    IMAGE_ZSTD = 2
+};
+
+/**
+ * @brief Magic numbers used to detect and index compressed disk images
+ */
+enum compressed_signatures {
+    GZIP_SIG = 0x8b1f, // first two bytes of a gzip member, read little endian
+    ZSTD_FRAME_SIG = 0xFD2FB528,
+    ZSTD_SKIPPABLE_SIG = 0x184D2A50, // low nibble may be 0-F
+    ZSTD_SEEKABLE_SIG = 0x8F92EAB1 // last four bytes of a zstd seekable seek table
+};
+
+/**
+ * @brief Tunables for compressed disk images
+ */
+enum compressed_image_sizes {
+    GZIP_INDEX_SPAN = 1048576, // decompressed bytes between gzip access points
+    GZIP_WINDOW_SIZE = 32768, // deflate history needed to resume at an access point
+    GZIP_READ_CHUNK = 16384,
+    ZSTD_SEEK_TABLE_FOOTER_SIZE = 9,
+    ZSTD_MAX_FRAME_SIZE = 16777216, // decompressed bytes, larger frames would not fit the cache
+    COMPRESSED_CACHE_LIMIT = 67108864, // bytes of decompressed blocks kept by the LRU cache
+    GZIP_SAVED_INDEX_VERSION = 1,
+    COMPRESSED_CACHE_SLOTS = 1024
+};
+
+/**
+ * @brief Tunables for the cluster cache in front of the disk image
+ */
+enum block_cache_sizes {
+    BLOCK_CACHE_SHARDS = 16, // must be a power of 2
+    BLOCK_CACHE_DEFAULT_MB = 64,
+    BLOCK_CACHE_READAHEAD_MAX = 1048576 // largest sequential readahead in bytes
+};
+
+/**
+ * @brief Kinds of regions swept for hidden data
+ */
+enum region_type {
+    REGION_FILE_SLACK,
+    REGION_DIRECTORY_SLACK,
+    REGION_PARTITION_GAP,
+    REGION_RESERVED_AREA,
+    REGION_FAT_TAIL,
+    REGION_VOLUME_SLACK,
+    REGION_PAST_FILE_SYSTEM,
+    REGION_FREE_SPACE,
+    REGION_RAM_SLACK, // rest of the last sector of a file
+    REGION_DRIVE_SLACK, // whole sectors after the last sector of a file
+    REGION_BAD_CLUSTERS,
+    REGION_TYPE_COUNT
+};
+
+/**
+ * @brief Lookup table for region type -> txt string
+ */
+static const char region_type_txt[REGION_TYPE_COUNT][32] = {
+    "file slack",
+    "directory slack",
+    "partition gap",
+    "reserved area",
+    "unused FAT entries",
+    "volume slack",
+    "data past end of file system",
+    "free clusters",
+    "RAM slack",
+    "drive slack",
+    "clusters marked bad"
+};
+
+enum scan_sizes {
+    SCAN_CHUNK_SIZE = 1048576, // bytes read per call when sweeping a region
+    SCAN_VECTOR_SIZE = 32,
+    HISTOGRAM_BANKS = 4, // separate counters so back to back bytes don't wait on the same increment
+    RANKED_FINDINGS_MAX = 25 // findings listed in the ranking unless running in verbose mode
+};
+
+/**
+ * @brief Sizes used by the verbose FAT dump
+ */
+enum fat_dump_sizes {
+    FAT_DUMP_ROW_ENTRIES = 8,
+    FAT_DUMP_BUFFER_SIZE = 1048576, // formatted output collected before each write
+    FAT_DUMP_CHUNK_SIZE = 96 * 8192 // FAT bytes read at a time in bounded memory mode, a whole number of rows at every FAT width
+};
+
+/**
+ * @brief Classes of bytes reported for each finding
+ */
+enum byte_class {
+    BYTE_ZERO,
+    BYTE_ASCII, // printable ASCII and whitespace
+    BYTE_CONTROL, // other values below 0x80
+    BYTE_HIGH, // 0x80 and up
+    BYTE_CLASS_COUNT
+};
+
+// Vector of bytes used by the bulk zero test (GCC vector extension)
+typedef uint8_t byte_vector __attribute__((vector_size(SCAN_VECTOR_SIZE)));
+typedef uint32_t fat32_vector __attribute__((vector_size(SCAN_VECTOR_SIZE)));
+typedef uint16_t fat16_vector __attribute__((vector_size(SCAN_VECTOR_SIZE)));
+
+/**
+ * @brief Tunables for bounded memory mode (--max-memory)
+ */
+enum bounded_memory_sizes {
+    FAT_PAGE_SIZE = 65536, // FAT bytes paged in at a time when the FATs are not kept in memory
+    ARENA_CHUNK_SIZE = 1048576,
+    RSS_CHECK_INTERVAL = 64 // directories read between checks of the resident set size
+};
+
+/**
+ * @brief Tunables for the file hashing pass (--hash)
+ */
+enum hash_sizes {
+    HASH_RUN_SIZE = 4194304, // most bytes of a contiguous cluster run read per call
+    HASH_QUEUE_DEPTH = 256, // files waiting for a worker before the walk blocks
+    HASH_MAX_THREADS = 64,
+    HASH_PATH_SIZE = 1024
+};
+
+/**
+ * @brief BLAKE3 constants
+ */
+enum blake3_constants {
+    BLAKE3_BLOCK_LEN = 64,
+    BLAKE3_CHUNK_LEN = 1024,
+    BLAKE3_OUT_LEN = 32,
+    BLAKE3_MAX_DEPTH = 54,
+    BLAKE3_CHUNK_START = 1,
+    BLAKE3_CHUNK_END = 2,
+    BLAKE3_PARENT = 4,
+    BLAKE3_ROOT = 8
+};
+
+static const uint32_t blake3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint8_t blake3_msg_permutation[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+/**
+ * @brief Groups of units that are sampled separately in --sample mode, each gets its share of the
+ * budgets
+ */
+enum sample_stratum_type {
+    STRATUM_REGIONS, // reserved area, FAT tails, volume slack, partition gaps
+    STRATUM_FREE_SPACE,
+    STRATUM_FILE_SLACK,
+    STRATUM_COUNT
+};
+
+/**
+ * @brief Lookup table for stratum -> txt string
+ */
+static const char stratum_txt[STRATUM_COUNT][32] = {
+    "volume regions and gaps",
+    "free clusters",
+    "file slack"
+};
+
+enum sample_sizes {
+    SAMPLE_REGION_UNIT = 65536, // regions outside the clusters are sampled in units of this many bytes
+    SAMPLE_DEFAULT_SEED = 1
+};
+
+/**
+ * @brief Passes of a -h scan of a FAT volume, in the order they run.  Checkpoints record the pass
+ * that was running.
+ */
+enum scan_phase {
+    PHASE_REGIONS,
+    PHASE_FREE_SPACE,
+    PHASE_WALK,
+    PHASE_DONE
+};
+
+enum checkpoint_sizes {
+    CHECKPOINT_VERSION = 2,
+    CHECKPOINT_DEFAULT_INTERVAL = 60, // seconds
+    CHECKPOINT_SPAN = 67108864 // bytes of free clusters scanned between chances to checkpoint
+};
+
+/**
+ * @brief Sizes used to decode long file names
+ */
+enum lfn_sizes {
+    LFN_MAX_ENTRIES = 20, // 255 characters
+    LFN_CHARS_PER_ENTRY = 13,
+    LFN_NAME_SIZE = 1024 // UTF-8 bytes, enough for any long name
+};
+
+// The names of the . and .. directory entries, read as 8 and 3 little endian bytes so skipping them
+// takes two integer compares
+static const uint64_t DOT_NAME_BASE = 0x202020202020202e;
+static const uint64_t DOT_DOT_NAME_BASE = 0x2020202020202e2e;
+static const uint32_t DOT_NAME_EXTENSION = 0x202020;
+
+enum path_index_sizes {
+    PATH_INDEX_VERSION = 3,
+    PATH_INDEX_PATH_SIZE = 1024
+};
+
+/**
+ * @brief Best guesses at what the data in a finding is
+ */
+enum data_kind {
+    DATA_STRAY_BYTES,
+    DATA_TEXT,
+    DATA_BINARY,
+    DATA_ENCRYPTED,
+    DATA_KIND_COUNT
+};
+
+/**
+ * @brief Lookup table for data kind -> txt string
+ */
+static const char data_kind_txt[DATA_KIND_COUNT][32] = {
+    "stray bytes",
+    "text",
+    "binary",
+    "encrypted or compressed"
+};
+
+/**
+ * @brief What a run of FAT entries holds, shown by --fat-extents
+ */
+enum fat_extent_type {
+    EXTENT_CHAIN, // part of a chain that continues at another cluster
+    EXTENT_EOF, // last run of a chain
+    EXTENT_FREE,
+    EXTENT_BAD,
+    EXTENT_INVALID, // links to a free or bad cluster, or to one outside the volume
+    EXTENT_TYPE_COUNT
+};
+
+static const char fat_extent_type_txt[EXTENT_TYPE_COUNT][16] = {
+    "chain",
+    "EOF",
+    "free",
+    "bad",
+    "invalid"
+};
+
+/**
+ * @brief Buckets of the extents per chain histogram
+ */
+enum layout_sizes {
+    FRAGMENT_BUCKETS = 8
+};
+
+static const char fragment_bucket_txt[FRAGMENT_BUCKETS][8] = {
+    "1",
+    "2",
+    "3-4",
+    "5-8",
+    "9-16",
+    "17-32",
+    "33-64",
+    "65+"
+};
+
+/**
+ * @brief Sizes used by the image to image differential scan
+ */
+enum diff_sizes {
+    DIFF_BLOCK_SIZE = 65536, // bytes hashed per block
+    DIFF_DIGEST_SIZE = 16, // leading bytes of the SHA-256 digest kept for each block
+    DIFF_MAX_DEPTH = 64, // directory levels followed
+    DIFF_PATH_SIZE = 1024
+};
+
+/**
+ * @brief How a FAT entry changed between the two images
+ */
+enum fat_change {
+    FAT_CHANGE_ALLOCATED,
+    FAT_CHANGE_FREED,
+    FAT_CHANGE_MARKED_BAD,
+    FAT_CHANGE_UNMARKED_BAD,
+    FAT_CHANGE_RELINKED,
+    FAT_CHANGE_COUNT
+};
+
+static const char fat_change_txt[FAT_CHANGE_COUNT][24] = {
+    "allocated",
+    "freed",
+    "marked bad",
+    "no longer marked bad",
+    "relinked"
+};
+
+/**
+ * @brief Sizes used by the MAC time timeline
+ */
+enum timeline_sizes {
+    TIMELINE_SORT_MIN_PER_THREAD = 65536, // fewer events per thread are sorted by fewer threads
+    TIMELINE_RADIX_BITS = 8,
+    TIMELINE_RADIX_BUCKETS = 1 << TIMELINE_RADIX_BITS,
+    TIMELINE_INDEX_SHIFT = 2, // the low 32 bits of an event key are the entry index and the event type
+    TIMELINE_MAX_ENTRIES = 1 << 30,
+    TIMELINE_PATH_SIZE = 1024
+};
+
+/**
+ * @brief The times kept in a FAT directory entry.  FAT has no inode change time.
+ */
+enum timeline_event {
+    EVENT_CREATED,
+    EVENT_ACCESSED, // a date only
+    EVENT_WRITTEN,
+    EVENT_TYPE_COUNT
+};
+
+static const char timeline_event_txt[EVENT_TYPE_COUNT][16] = {
+    "created",
+    "accessed",
+    "written"
+};
+
+/**
+ * @brief Sizes used when copying files out of the image
+ */
+enum copy_sizes {
+    COPY_BUFFER_SIZE = 1048576, // per worker, for compressed images and file systems that cannot copy_file_range
+    COPY_NAME_SIZE = 64
+};
+
+/**
+ * @brief I/O priority of the recovery workers, see ioprio_set(2).  The idle class only gets disk
+ * time when nothing else wants it, so recovering files does not slow down other work on the disk.
+ */
+enum io_priority {
+    IOPRIO_WHO_THREAD = 1, // IOPRIO_WHO_PROCESS, which is per thread on Linux
+    IOPRIO_CLASS_SHIFT = 13,
+    IOPRIO_CLASS_IDLE = 3
+};
+
+/**
+ * @brief What happened to a deleted file when it was recovered
+ */
+enum recovery_status {
+    RECOVERY_PENDING,
+    RECOVERY_RECOVERED,
+    RECOVERY_REALLOCATED,
+    RECOVERY_OUT_OF_RANGE,
+    RECOVERY_FAILED,
+    RECOVERY_DUPLICATE, // another deleted entry has the same first cluster and name
+    RECOVERY_STATUS_COUNT
+};
+
+static const char recovery_status_txt[RECOVERY_STATUS_COUNT][56] = {
+    "pending",
+    "recovered",
+    "not recovered, clusters reallocated",
+    "not recovered, clusters past the end of the volume",
+    "not recovered, could not be written",
+    "not recovered, same file as another entry"
+};
+
+/**
+ * @brief What happened to a file when it was extracted
+ */
+enum extract_status {
+    EXTRACT_PENDING,
+    EXTRACT_DONE,
+    EXTRACT_TRUNCATED,
+    EXTRACT_FAILED,
+    EXTRACT_STATUS_COUNT
+};
+
+static const char extract_status_txt[EXTRACT_STATUS_COUNT][48] = {
+    "pending",
+    "extracted",
+    "cluster chain ends before the end of the file",
+    "could not be written"
+};
+
+/**
+ * @brief What the scan is doing, shown in progress reports
+ */
+enum progress_phase {
+    PROGRESS_STARTING,
+    PROGRESS_REGIONS,
+    PROGRESS_FREE_SPACE,
+    PROGRESS_WALK,
+    PROGRESS_DONE,
+    PROGRESS_PHASE_COUNT
+};
+
+/**
+ * @brief Lookup table for progress phase -> txt string
+ */
+static const char progress_phase_txt[PROGRESS_PHASE_COUNT][32] = {
+    "starting",
+    "volume regions",
+    "free clusters",
+    "directory walk",
+    "done"
+};
+
+enum progress_sizes {
+    PROGRESS_INTERVAL_MS = 1000
+};
+
+
+// Reference for MBR and EBR data structure and offsets:
+// https://thestarman.pcministry.com/asm/mbr/PartTables.htm
+typedef struct ebr_table {
+    uint32_t offset; // The lba of this ebr_entry   
+    uint32_t starting_sector; // add offset + starting sector to find first block of partition
+    uint32_t partition_size;  // size in sectors
+    uint32_t next_partition_ebr;
+    struct ebr_table *next_ebr_table;
+} ebr_table;
+
+// Struct to store MBR fields
+typedef struct partition_table {
+    // Booleans to specify if flag was present
+    uint8_t boot_indicator;
+    uint8_t partition_type;
+    uint32_t starting_sector;
+    uint32_t partition_size;  // size in sectors
+    struct ebr_table *ebr_table; // will be NULL if partition is not extended
+} partition_table;
+
+// Struct to store array of MBR Table Entries
+typedef struct mbr_sector {
+    struct partition_table entry[4];
+} mbr_sector;
+
+// Struct to store FAT Boot Sector fields
+typedef struct fat_boot_sector {
+    bool is_fat32;
+    bool is_fat16;
+    bool is_fat12;
+    
+    char oem_name[9];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_area_size; // size is in sectors
+    uint8_t number_of_fats;
+    uint16_t max_files_in_root;
+    uint16_t sector_count_16b;
+    uint8_t media_type;
+    uint16_t fat_size_in_sectors;  // used for FAT12/16, will be 0 in FAT32
+    uint16_t sectors_per_track;
+    uint16_t head_number;
+    uint32_t sectors_before_partition;
+    uint32_t sector_count_32b; // if this is set, sector_count must be 0
+    uint8_t bios_drive_number;
+    uint8_t extended_boot_sig;
+    uint32_t volume_serial;
+    char volume_label[12];
+    char fs_type_label[9]; // not required, but can be FAT, FAT12, FAT16
+    uint16_t fs_signature;
+
+    // The below fields only apply to FAT32
+    uint32_t fat32_size_in_sectors;
+    uint16_t fat_mode;
+    uint16_t fat32_version;
+    uint32_t root_dir_cluster;
+    uint16_t fsinfo_sector_addr;
+    uint16_t backup_boot_sector_addr;
+    uint8_t fat32_bios_drive_number;
+    uint8_t fat32_extended_boot_sig;
+    uint32_t fat32_volume_serial;
+    char fat32_volume_label[12];
+    char fat32_fs_type_label[9];
+
+} fat_boot_sector;
+
+/**
+ * @brief Sizes used when reading the boot region of a FAT volume
+ */
+enum boot_region_sizes {
+    BOOT_REGION_SIZE = 16 * 4096, // the first 16 sectors at the largest sector size, read in one go
+    BOOT_RECORD_SECTORS = 3 // boot sector, FSINFO, and the second boot code sector, each with a backup copy
+};
+
+/**
+ * @brief A field of a boot record sector, compared between the primary and backup copies
+ */
+typedef struct boot_field {
+    const char *name;
+    uint16_t offset;
+    uint16_t size;
+    bool text; // printed as a string rather than a number
+    bool hint; // kept up to date in the primary only, so a stale backup is normal
+} boot_field;
+
+// Every byte of the FAT32 boot sector
+static const struct boot_field fat32_boot_fields[] = {
+    {"Jump Instruction", JUMP_INSTRUCTION, 3, false, false},
+    {"OEM Name", OEM_NAME, 8, true, false},
+    {"Bytes per sector", BYTES_PER_SECTOR, 2, false, false},
+    {"Sectors per cluster", SECTORS_PER_CLUSTER, 1, false, false},
+    {"Size of Reserved Area", RESERVED_AREA_SIZE, 2, false, false},
+    {"Number of FATs", NUMBER_OF_FATS, 1, false, false},
+    {"Maximum number of files in Root Dir", MAX_FILES_IN_ROOT, 2, false, false},
+    {"Number of sectors (16 bit)", SECTOR_COUNT_16B, 2, false, false},
+    {"Media Type", MEDIA_TYPE, 1, false, false},
+    {"FAT size in sectors (16 bit)", FAT_SIZE_IN_SECTORS, 2, false, false},
+    {"Sectors per track", SECTORS_PER_TRACK, 2, false, false},
+    {"Number of heads", HEAD_NUMBER, 2, false, false},
+    {"Sectors before start of partition", SECTORS_BEFORE_PARTITION, 4, false, false},
+    {"Number of sectors", SECTOR_COUNT_32B, 4, false, false},
+    {"FAT size in sectors", FAT32_SIZE_IN_SECTORS, 4, false, false},
+    {"FAT Mode", FAT_MODE, 2, false, false},
+    {"FAT32 Version", FAT32_VERSION, 2, false, false},
+    {"Root Dir Cluster", ROOT_DIR_CLUSTER, 4, false, false},
+    {"FSINFO Sector", FSINFO_SECTOR, 2, false, false},
+    {"Backup Boot Sector", BACKUP_BOOT_SECTOR_ADDR, 2, false, false},
+    {"Reserved", FAT32_RESERVED, 12, false, false},
+    {"BIOS Drive Number", FAT32_BIOS_DRIVE_NUMBER, 1, false, false},
+    {"Reserved", FAT32_RESERVED_1, 1, false, false},
+    {"Extended Boot Signature", FAT32_EXTENDED_BOOT_SIG, 1, false, false},
+    {"Volume Serial", FAT32_VOLUME_SERIAL, 4, false, false},
+    {"Volume Label", FAT32_VOLUME_LABEL, 11, true, false},
+    {"File System Label", FAT32_FS_TYPE_LABEL, 8, true, false},
+    {"Boot Code", FAT32_BOOT_CODE, FS_SIGNATURE - FAT32_BOOT_CODE, false, false},
+    {"Signature", FS_SIGNATURE, 2, false, false}
+};
+
+// Every byte of the FAT12/16 boot sector
+static const struct boot_field fat_boot_fields[] = {
+    {"Jump Instruction", JUMP_INSTRUCTION, 3, false, false},
+    {"OEM Name", OEM_NAME, 8, true, false},
+    {"Bytes per sector", BYTES_PER_SECTOR, 2, false, false},
+    {"Sectors per cluster", SECTORS_PER_CLUSTER, 1, false, false},
+    {"Size of Reserved Area", RESERVED_AREA_SIZE, 2, false, false},
+    {"Number of FATs", NUMBER_OF_FATS, 1, false, false},
+    {"Maximum number of files in Root Dir", MAX_FILES_IN_ROOT, 2, false, false},
+    {"Number of sectors (16 bit)", SECTOR_COUNT_16B, 2, false, false},
+    {"Media Type", MEDIA_TYPE, 1, false, false},
+    {"FAT size in sectors", FAT_SIZE_IN_SECTORS, 2, false, false},
+    {"Sectors per track", SECTORS_PER_TRACK, 2, false, false},
+    {"Number of heads", HEAD_NUMBER, 2, false, false},
+    {"Sectors before start of partition", SECTORS_BEFORE_PARTITION, 4, false, false},
+    {"Number of sectors", SECTOR_COUNT_32B, 4, false, false},
+    {"BIOS Drive Number", BIOS_DRIVE_NUMBER, 1, false, false},
+    {"Reserved", FAT_RESERVED, 1, false, false},
+    {"Extended Boot Signature", EXTENDED_BOOT_SIG, 1, false, false},
+    {"Volume Serial", VOLUME_SERIAL, 4, false, false},
+    {"Volume Label", VOLUME_LABEL, 11, true, false},
+    {"File System Label", FS_TYPE_LABEL, 8, true, false},
+    {"Boot Code", FAT_BOOT_CODE, FS_SIGNATURE - FAT_BOOT_CODE, false, false},
+    {"Signature", FS_SIGNATURE, 2, false, false}
+};
+
+// Every byte of the FAT32 FSINFO sector
+static const struct boot_field fsinfo_fields[] = {
+    {"Lead Signature", FSINFO_LEAD_SIG_OFF, 4, false, false},
+    {"Reserved", FSINFO_RESERVED, FSINFO_STRUCT_SIG_OFF - FSINFO_RESERVED, false, false},
+    {"Structure Signature", FSINFO_STRUCT_SIG_OFF, 4, false, false},
+    {"Free Cluster Count", FSINFO_FREE_COUNT, 4, false, true},
+    {"Next Free Cluster", FSINFO_NEXT_FREE, 4, false, true},
+    {"Reserved", FSINFO_RESERVED_2, FSINFO_TRAIL_SIG_OFF - FSINFO_RESERVED_2, false, false},
+    {"Trail Signature", FSINFO_TRAIL_SIG_OFF, 4, false, false}
+};
+
+typedef struct fat_dir_entry{
+    bool is_directory;
+    bool is_deleted; // entry was marked unallocated (0xE5)
+    union {
+        char alloc_status;
+        char filename[12];
+    } info;
+    const char *name; // long name, or the 8.3 name as NAME.EXT if there is none, in the tree arena
+    uint8_t file_attributes;
+    uint8_t created_time_tenths;
+    uint16_t created_time_hms;
+    uint16_t created_day;
+    uint16_t accessed_day;
+    uint32_t low_cluster_addr;
+    uint32_t high_cluster_addr;
+    uint32_t cluster_addr; // generated by combining low and high cluster addr
+    uint16_t written_time_hms;
+    uint16_t written_day;
+    uint32_t file_size; // in bytes
+    uint32_t last_cluster; // Store the last cluster of the file/dir for feeler gauge checks
+
+    // Linked List of parent
+    struct fat_dir_entry* parent_dir;
+
+    // Linked List to files and subfolders
+    struct fat_dir_entry* dir_contents;
+
+    // Linked List of deleted (0xE5) entries found within this directory
+    struct fat_dir_entry* deleted_contents;
+
+    // Double linked list of all files/folders within the same directory
+    struct fat_dir_entry* next;
+     struct fat_dir_entry* prev;
+
+} fat_dir_entry;
+
+typedef struct read_parameters{
+    uint32_t start_cluster; // cluster where the file/data to be read begins
+    uint32_t *cluster_list; // list of clusters that contain the other segments of the file
+    uint32_t list_length; // # of clusters in the list
+    uint32_t entry_offset; // offset within the custer to begin reading (used for directory entries)
+} read_parameters;
+
+// Access point into a gzip stream, based on zlib's examples/zran.c
+typedef struct gzip_access_point {
+    uint64_t in; // offset in the compressed file of the first full byte
+    int bits; // number of bits (1-7) used from the byte at in - 1, or 0
+    uint8_t *window; // preceding 32K of decompressed data, deflate compressed to save memory
+    uint32_t window_length;
+} gzip_access_point;
+
+// Fixed part of a saved gzip index, <image>.fgzi, followed by the block starts and the access
+// points with their windows.  Like checkpoints, it is only read back on the machine that wrote it.
+typedef struct gzip_index_header {
+    char magic[8]; // "FGGZIDX\0"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t file_size; // of the gzip image, with its modification time to tell it changed
+    int64_t modified;
+    uint64_t block_count;
+} gzip_index_header;
+
+// One decompressed block held by the compressed image LRU cache
+typedef struct cached_block {
+    uint64_t block; // index of the block within the image, valid only if data != NULL
+    uint64_t last_used;
+    uint8_t *data;
+    uint32_t length;
+} cached_block;
+
+// State needed to serve reads from a compressed disk image
+typedef struct image_backend {
+    int format; // enum image_format
+    int fp;
+    uint64_t file_size; // size of the (compressed) file on disk
+    uint64_t size; // decompressed size of the disk image
+
+    // Block index. Block i covers [block_start[i], block_start[i + 1]) of the decompressed image
+    uint64_t block_count;
+    uint64_t *block_start;
+    uint64_t *frame_offset; // zstd: compressed offset of each frame (block_count + 1 entries)
+    struct gzip_access_point *points; // gzip: access point that starts each block
+
+    // Bounded LRU cache of decompressed blocks
+    struct cached_block cache[COMPRESSED_CACHE_SLOTS];
+    uint64_t cache_bytes;
+    uint64_t cache_tick;
+    uint64_t cache_limit; // bytes
+    pthread_mutex_t lock;
+} image_backend;
+
+// Results of sweeping one region of the disk image for non-zero bytes
+typedef struct region_scan {
+    int type; // enum region_type
+    uint64_t offset; // offset of the region within the disk image
+    uint64_t length;
+    uint64_t nonzero; // number of non-zero bytes found
+    uint64_t first_nonzero; // offset within the disk image of the first non-zero byte
+    const char *label; // optional, names the region in pattern hits
+    uint32_t match_state; // pattern matcher state, carried between buffers so hits can span them
+    uint64_t scanned; // bytes fed to the scan
+    uint64_t histogram[256]; // counts of the non-zero byte values, zeros are scanned - nonzero
+} region_scan;
+
+// Byte statistics of a region with hidden data
+typedef struct byte_profile {
+    double entropy; // Shannon entropy of the non-zero bytes, in bits per byte
+    double class_percent[BYTE_CLASS_COUNT]; // zeros as a share of the region, the rest as a share of the non-zero bytes
+    int kind; // enum data_kind, best guess at what the data is
+    double suspicion; // used to rank findings
+} byte_profile;
+
+// A region reported as containing possible hidden data
+typedef struct finding {
+    int type; // enum region_type
+    char label[96];
+    uint64_t offset; // offset of the first non-zero byte
+    uint64_t nonzero;
+    struct byte_profile profile;
+} finding;
+
+typedef struct finding_list {
+    struct finding *items;
+    uint64_t count;
+    uint64_t capacity;
+} finding_list;
+
+// State of the verbose FAT dump, the formatted output and the part of FAT1 being printed
+typedef struct fat_dump {
+    struct fat_boot_sector *fat_sector;
+    int width; // hex digits per entry
+    uint32_t inner_width; // width of a row between the bars
+    char *out; // FAT_DUMP_BUFFER_SIZE bytes
+    size_t used;
+    const uint8_t *fat1; // all of FAT1 if it is in memory, otherwise NULL and it is streamed through chunk
+    uint8_t *chunk;
+    uint32_t chunk_start;
+    uint32_t chunk_length;
+    uint32_t fat_bytes;
+    uint64_t fat_offset; // image offset of FAT1
+} fat_dump;
+
+// Run of consecutive clusters
+typedef struct cluster_extent {
+    uint32_t start;
+    uint32_t count;
+} cluster_extent;
+
+// List of cluster runs, e.g. the free space of the volume
+typedef struct extent_list {
+    struct cluster_extent *extents;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t clusters; // total clusters in all extents
+} extent_list;
+
+// Run of consecutive clusters of one chain, an entry of the chain index built by analyze_layout
+typedef struct chain_run {
+    uint32_t start;
+    uint32_t count;
+    uint32_t next; // first cluster of the next run of the chain, 0 at the end of the chain
+} chain_run;
+
+// Block digests of one image for the differential scan, filled in by diff_digest_worker
+typedef struct block_digests {
+    struct fg_volume *volume;
+    uint64_t blocks; // blocks the image has
+    uint8_t (*digests)[DIFF_DIGEST_SIZE];
+} block_digests;
+
+// A live directory entry, matched between the two images by its long name, or its 8.3 name if it
+// has none
+typedef struct diff_entry {
+    uint8_t raw[32];
+    char *name;
+    bool paired; // matched to an entry of the other image with another name, as a rename
+} diff_entry;
+
+// State of a differential scan between two images of the same volume
+typedef struct image_diff {
+    struct fg_volume *before;
+    struct fg_volume *after;
+    uint8_t *changed; // one byte per block, set if the block differs
+    uint64_t blocks;
+    uint64_t changed_blocks;
+    uint64_t changes; // differences reported
+    const char *header; // printed before the first change of a section
+    uint8_t *changed_chains; // bit per cluster of the after image, set if its chain runs through a changed block, NULL to follow every chain
+} image_diff;
+
+// Run of clusters whose FAT1 entries changed the same way, collected by diff_fats
+typedef struct fat_change_run {
+    bool open;
+    uint64_t start;
+    uint64_t end;
+    uint32_t before; // entries of the first cluster
+    uint32_t after;
+    int type; // enum fat_change
+} fat_change_run;
+
+// Live entries of a directory read by read_diff_directory
+typedef struct diff_listing {
+    struct diff_entry *entries;
+    uint64_t count;
+    uint64_t capacity;
+    uint8_t lfn[LFN_MAX_ENTRIES][32]; // long name entries in front of the next 8.3 entry
+    uint32_t lfn_count;
+} diff_listing;
+
+// How fragmented the files and free space of a volume are
+typedef struct layout_stats {
+    bool valid;
+    bool per_chain; // false if the chain index did not fit in the memory budget
+    uint64_t chains;
+    uint64_t fragmented_chains;
+    uint64_t max_extents;
+    uint64_t histogram[FRAGMENT_BUCKETS]; // chains by number of extents
+    uint64_t allocated_runs;
+    uint64_t allocated_clusters;
+    uint64_t weighted_run_sum; // sum of the squared run lengths, over allocated_clusters it is the run length of the average cluster
+    uint64_t seeks; // jumps between runs when every chain is read in order
+    uint64_t seek_distance; // in clusters
+    uint64_t free_runs;
+    uint64_t free_clusters;
+    uint32_t largest_free_start;
+    uint64_t largest_free_count;
+} layout_stats;
+
+// Sampling results for one stratum
+typedef struct sample_stratum {
+    bool started;
+    bool exhausted; // ran out of budget before the planned sample was checked
+    uint64_t population; // units that could have been checked
+    uint64_t sampled; // units checked
+    uint64_t positive; // units that held non-zero data
+    uint64_t bytes; // bytes read
+    uint64_t byte_limit; // 0 for no limit
+    double deadline; // 0 for no limit
+} sample_stratum;
+
+// State of --sample mode.  Each stratum gets an even share of whatever budget is left when it starts.
+typedef struct sampler {
+    bool enabled;
+    double fraction; // of the units in each stratum to check
+    uint64_t rng; // splitmix64 state
+    double start; // seconds, monotonic clock
+    uint32_t strata_pending; // strata that will run but have not started yet
+    uint64_t bytes; // read by all strata
+    struct sample_stratum strata[STRATUM_COUNT];
+    uint64_t file_bin; // bin of the file slack stratum being filled
+    uint64_t file_bin_seen; // files with slack seen in it so far
+    struct fat_dir_entry *file_pick; // the file picked from it so far
+} sampler;
+
+// Progress of the free cluster sweep
+typedef struct free_space_progress {
+    uint32_t cursor; // clusters below this have been swept
+    uint64_t extents_with_data;
+    struct region_scan total; // all free clusters swept so far
+    struct region_scan extent; // the extent the cursor is in, if it was only partly swept
+} free_space_progress;
+
+// Fixed part of a checkpoint file.  It is followed by the free space totals, the findings, and
+// the directory queue.  Checkpoints are only read back on the machine that wrote them.
+typedef struct checkpoint_header {
+    char magic[8]; // "FGCKPT\0\0"
+    uint32_t version;
+    uint32_t phase; // enum scan_phase
+    uint64_t image_size;
+    uint32_t boot_sector_crc; // identifies the volume together with the image size
+    bool hidden_data_found;
+    uint64_t pattern_hits;
+    uint64_t hashed_files;
+    uint64_t hashed_bytes;
+    uint64_t finding_count;
+    uint64_t dir_count;
+} checkpoint_header;
+
+// One file or directory in the path index.  Fixed width so the index can be saved as it is.
+typedef struct path_record {
+    uint64_t path; // offset of the full path in the name pool
+    uint32_t first_cluster;
+    uint32_t file_size;
+    uint16_t written_day;
+    uint16_t written_time_hms;
+    uint8_t attributes;
+    bool deleted;
+    uint16_t reserved;
+} path_record;
+
+// Every path found by the walk, sorted so --ls is a binary search for the prefix.  The records
+// and the name pool can be saved to an index file and loaded instead of walking again.
+typedef struct path_index {
+    bool collecting; // the walk adds the entries it reads
+    bool ready; // sorted and ready for queries
+    struct path_record *records;
+    uint64_t count;
+    uint64_t capacity;
+    char *names; // NUL terminated paths
+    uint64_t names_size;
+    uint64_t names_capacity;
+} path_index;
+
+// Fixed part of an index file, followed by the records and the name pool.  Like checkpoints,
+// index files are only read back on the machine that wrote them.
+typedef struct path_index_header {
+    char magic[8]; // "FGINDEX\0"
+    uint32_t version;
+    uint32_t boot_sector_crc;
+    uint32_t fat_crc; // changes whenever a file is created, deleted, or resized
+    uint32_t directory_crc; // changes whenever a file is renamed or its entry rewritten
+    uint64_t image_size;
+    uint64_t count;
+    uint64_t names_size;
+} path_index_header;
+
+// A deleted file to recover, its clusters are taken to be contiguous from the start cluster
+typedef struct recovery_job {
+    char path[PATH_INDEX_PATH_SIZE];
+    char name[COPY_NAME_SIZE]; // file name in the output directory
+    uint32_t first_cluster;
+    uint32_t file_size;
+    int status; // enum recovery_status
+} recovery_job;
+
+// Deleted files found by the walk for --recover, copied out by a pool of workers after the walk
+typedef struct recovery {
+    bool enabled;
+    struct recovery_job *jobs;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t next; // next job to take, shared by the workers
+    int dir_fd; // output directory
+} recovery;
+
+// An allocated file to copy out of the image by following its cluster chain
+typedef struct extract_job {
+    char path[PATH_INDEX_PATH_SIZE];
+    char output[PATH_INDEX_PATH_SIZE]; // its path under the output directory, see output_path
+    uint32_t first_cluster;
+    uint32_t file_size;
+    uint64_t copied;
+    uint64_t slack; // bytes written to the slack sidecar
+    int status; // enum extract_status
+    int fd; // file being written, -1 if none, closed by the worker if the copy fails part way
+} extract_job;
+
+// Files found by the walk for --extract and --extract-all, copied out by a pool of workers after the walk
+typedef struct extraction {
+    bool enabled;
+    char match[PATH_INDEX_PATH_SIZE]; // the path to extract, everything under it if it is a directory
+    struct extract_job *jobs;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t next; // next job to take, shared by the workers
+    int dir_fd; // output directory
+} extraction;
+
+// Periodic checkpoints of a -h scan, and what was restored from one on --resume
+typedef struct checkpoint {
+    bool enabled;
+    int phase; // enum scan_phase, the pass currently running
+    double last_write;
+    uint32_t boot_sector_crc;
+    uint64_t writes;
+    struct free_space_progress free_space;
+
+    // Directories that were still queued when the checkpoint was written, only set on --resume
+    uint32_t *resume_clusters;
+    char (*resume_names)[11];
+    char *resume_long_names; // the name of each of resume_names as shown in messages, NUL terminated one after another
+    uint32_t *resume_depths; // number of names per directory, root not included
+    uint64_t resume_dir_count;
+} checkpoint;
+
+// Progress counters.  The scan updates them with relaxed atomics and a reporting thread reads
+// them, so the hot loops never take a lock for reporting.
+typedef struct progress_report {
+    bool enabled;
+    pthread_t thread;
+    pthread_mutex_t lock; // only protects stop, for the reporting thread's timed wait
+    pthread_cond_t wake;
+    bool stop;
+    double start; // seconds, monotonic clock
+
+    int phase; // enum progress_phase
+    uint64_t bytes; // bytes scanned or hashed
+    uint64_t clusters; // clusters read by the scan
+    uint64_t dirs_done;
+    uint64_t dirs_queued;
+    uint64_t files;
+    uint64_t expected_clusters; // clusters the whole run is expected to read, from the FAT allocation counts
+
+    // Reporting thread only
+    double last_time;
+    uint64_t last_bytes;
+} progress_report;
+
+// A search pattern from the --patterns file
+typedef struct pattern {
+    uint8_t *bytes;
+    uint32_t length;
+    char *text; // the pattern as written in the file, used in messages
+} pattern;
+
+// Aho-Corasick automaton for the search patterns, stored as a full DFA (256 transitions per state)
+// so matching is one table lookup per byte
+typedef struct pattern_matcher {
+    bool enabled;
+    struct pattern *patterns;
+    uint32_t pattern_count;
+    uint32_t (*next)[256];
+    uint32_t *match; // pattern index + 1 of the longest pattern ending in each state, 0 if none
+    uint32_t *match_link; // closest state on the failure chain that ends a pattern, 0 if none
+    uint32_t state_count;
+    bool skip_zeros; // no pattern starts with 0x00, so zero runs can be skipped from the root state
+    uint64_t hits;
+} pattern_matcher;
+
+// Block of memory that arena allocations are carved from
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t size;
+    uint8_t data[];
+} arena_chunk;
+
+// Bump allocator for the directory tree.  When spilling, chunks are mmap'd from an unlinked
+// temporary file so the kernel can write them back and the pages can be dropped from RSS.
+typedef struct arena {
+    int fd; // backing temporary file, -1 if chunks are plain heap memory
+    uint64_t file_size;
+    struct arena_chunk *chunks; // most recent chunk first
+    uint64_t resident; // bytes allocated since the arena was last trimmed
+    uint64_t resident_limit; // trim once this many bytes have been allocated, 0 to never trim
+} arena;
+
+// FAT pages read on demand when the FATs are not held in memory
+typedef struct fat_page_cache {
+    uint32_t slots;
+    uint64_t *page; // page index held by each slot, UINT64_MAX if empty
+    uint8_t *data; // slots * FAT_PAGE_SIZE bytes
+    pthread_mutex_t lock;
+} fat_page_cache;
+
+// Directories found by the walk that have not been read yet
+typedef struct dir_queue {
+    struct fat_dir_entry **items;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t limit; // most directories that may wait in the queue, 0 if unbounded
+} dir_queue;
+
+// One cluster held by the block cache.  The cluster data follows the struct in the same allocation
+typedef struct cache_entry {
+    uint32_t cluster;
+    uint8_t *data;
+    struct cache_entry *hash_next;
+    struct cache_entry *lru_prev; // towards the most recently used entry
+    struct cache_entry *lru_next;
+} cache_entry;
+
+// Each shard has its own lock, hash table, and LRU list so threads rarely contend
+typedef struct cache_shard {
+    pthread_mutex_t lock;
+    struct cache_entry **buckets;
+    uint32_t bucket_mask;
+    struct cache_entry *lru_head; // most recently used
+    struct cache_entry *lru_tail; // next to be evicted
+    uint32_t count;
+    uint32_t capacity; // in clusters
+} cache_shard;
+
+// Cluster sized block cache used by the cluster read path
+typedef struct block_cache {
+    bool enabled;
+    uint32_t block_size; // bytes per cluster
+    uint32_t readahead_max; // in clusters
+    struct cache_shard shards[BLOCK_CACHE_SHARDS];
+
+    // Sequential readahead state, only a hint so races between threads are harmless
+    uint32_t next_expected;
+    uint32_t readahead_window;
+
+    // Statistics, updated atomically
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead_blocks;
+} block_cache;
+
+// State of the BLAKE3 chunk currently being compressed
+typedef struct blake3_chunk_state {
+    uint32_t cv[8];
+    uint64_t chunk_counter;
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint8_t block_len;
+    uint8_t blocks_compressed;
+} blake3_chunk_state;
+
+// Incremental BLAKE3 hasher (unkeyed hash mode only)
+typedef struct blake3_hasher {
+    struct blake3_chunk_state chunk;
+    uint32_t cv_stack[BLAKE3_MAX_DEPTH][8]; // chaining values of completed subtrees
+    uint8_t cv_stack_len;
+} blake3_hasher;
+
+// A file waiting to be hashed.  Only what the worker needs is copied so the tree can be trimmed.
+typedef struct hash_job {
+    char path[HASH_PATH_SIZE];
+    uint32_t first_cluster;
+    uint32_t file_size;
+} hash_job;
+
+// Worker threads hashing files found by the walk.  The job queue is a bounded ring, the walk
+// blocks when it is full so it can never get far ahead of the workers.
+typedef struct hash_pool {
+    bool enabled;
+    pthread_t threads[HASH_MAX_THREADS];
+    uint32_t thread_count;
+    uint32_t run_size; // bytes read per call by each worker
+    struct hash_job *jobs; // HASH_QUEUE_DEPTH jobs
+    uint32_t head;
+    uint32_t count;
+    uint32_t active; // jobs taken off the queue that are still being hashed
+    bool done;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t idle; // signalled when the queue is empty and no job is active
+
+    // Statistics, updated under the lock
+    uint64_t files;
+    uint64_t bytes;
+} hash_pool;
+
+// Entries seen by the walk for --timeline and --bodyfile.  Events are kept as packed 64 bit keys,
+// the DOS date and time in the high 32 bits and the entry index and event type in the low 32 bits,
+// so sorting the keys sorts the timeline.
+typedef struct timeline {
+    bool enabled;
+    struct fat_dir_entry **entries;
+    uint64_t entry_count;
+    uint64_t entry_capacity;
+    uint64_t *keys;
+    uint64_t event_count;
+    uint64_t invalid; // times that are not valid DOS dates, left out of the timeline
+} timeline;
+
+// One radix sort thread and its share of the keys
+typedef struct radix_sort_worker {
+    struct radix_sort *sort;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t counts[TIMELINE_RADIX_BUCKETS]; // keys of the share in each bucket, then where the first of them goes
+    pthread_t thread;
+} radix_sort_worker;
+
+// Parallel LSD radix sort of the timeline keys by their high 32 bits.  The sort is stable, so keys
+// with the same time stay in the order they were added.
+typedef struct radix_sort {
+    uint64_t *src;
+    uint64_t *dst;
+    uint64_t count;
+    uint32_t shift; // digit being sorted on
+    uint32_t thread_count;
+    struct radix_sort_worker *workers;
+} radix_sort;
+
+/**
+ * @brief Lookup table for partition code -> txt string
+ */
+static const char partition_type_txt [256][20]={
+    "EMPTY",            // [0] -> 0x00
+    "FAT12",            // [1] -> 0x01
+    "XENIX ROOT",       // [2] -> 0x2
+    "XENIX USR",        // [3] -> 0x3
+    "FAT16 (CHS)",      // [4] -> 0x4
+    "EXTENDED (CHS)",   // [5] -> 0x5
+    "FAT16B (CHS)",     // [6] -> 0x6
+    "NTFS",             // [7] -> 0x7
+    "IBM AIX",          // [8] -> 0x8
+    "IBM AIX",          // [9] -> 0x9
+    "IBM OS/2",         // [10] -> 0xA
+    "FAT32 (CHS)",      // [11] -> 0xB
+    "FAT32 (LBA)",      // [12] -> 0xC
+    "????",             // [13] -> 0xD
+    "FAT16 (LBA)",      // [14] -> 0xE
+    "EXTENDED (LBA)",   // [15] -> 0xF
+    "Hidden IBM OS/2",  // [16] -> 0x10
+    "Hidden NTFS",      // [17] -> 0x11
+    "????",             // [18] -> 0x12
+    "????",             // [19] -> 0x13
+    "Hidden FAT16",     // [20] -> 0x14
+    "????",             // [21] -> 0x15
+    "Hidden FAT16",     // [22] -> 0x16
+    "????",             // [23] -> 0x17
+    "????",             // [24] -> 0x18
+    "????",             // [25] -> 0x19
+    "????",             // [26] -> 0x1A
+    "Hidden FAT32",     // [27] -> 0x1B
+    "Hidden FAT32",     // [28] -> 0x1C
+    "????",             // [29] -> 0x1D
+    "Hidden FAT16",     // [30] -> 0x1E
+    "????",             // [31] -> 0x1F
+    "????",             // [32] -> 0x20
+    "????",             // [33] -> 0x21
+    "????",             // [34] -> 0x22
+    "????",             // [35] -> 0x23
+    "????",             // [36] -> 0x24
+    "????",             // [37] -> 0x25
+    "????",             // [38] -> 0x26
+    "????",             // [39] -> 0x27
+    "????",             // [40] -> 0x28
+    "????",             // [41] -> 0x29
+    "MBR Dynamic",      // [42] -> 0x2A
+    "????",             // [43] -> 0x2B
+    "????",             // [44] -> 0x2C
+    "????",             // [45] -> 0x2D
+    "????",             // [46] -> 0x2E
+    "????",             // [47] -> 0x2F
+    "????",             // [48] -> 0x30
+    "????",             // [49] -> 0x31
+    "????",             // [50] -> 0x32
+    "????",             // [51] -> 0x33
+    "????",             // [52] -> 0x34
+    "????",             // [53] -> 0x35
+    "????",             // [54] -> 0x36
+    "????",             // [55] -> 0x37
+    "????",             // [56] -> 0x38
+    "????",             // [57] -> 0x39
+    "????",             // [58] -> 0x3A
+    "????",             // [59] -> 0x3B
+    "????",             // [60] -> 0x3C
+    "????",             // [61] -> 0x3D
+    "????",             // [62] -> 0x3E
+    "????",             // [63] -> 0x3F
+    "????",             // [64] -> 0x40
+    "????",             // [65] -> 0x41
+    "????",             // [66] -> 0x42
+    "????",             // [67] -> 0x43
+    "????",             // [68] -> 0x44
+    "????",             // [69] -> 0x45
+    "????",             // [70] -> 0x46
+    "????",             // [71] -> 0x47
+    "????",             // [72] -> 0x48
+    "????",             // [73] -> 0x49
+    "????",             // [74] -> 0x4A
+    "????",             // [75] -> 0x4B
+    "????",             // [76] -> 0x4C
+    "????",             // [77] -> 0x4D
+    "????",             // [78] -> 0x4E
+    "????",             // [79] -> 0x4F
+    "????",             // [80] -> 0x50
+    "????",             // [81] -> 0x51
+    "????",             // [82] -> 0x52
+    "????",             // [83] -> 0x53
+    "????",             // [84] -> 0x54
+    "????",             // [85] -> 0x55
+    "????",             // [86] -> 0x56
+    "????",             // [87] -> 0x57
+    "????",             // [88] -> 0x58
+    "????",             // [89] -> 0x59
+    "????",             // [90] -> 0x5A
+    "????",             // [91] -> 0x5B
+    "????",             // [92] -> 0x5C
+    "????",             // [93] -> 0x5D
+    "????",             // [94] -> 0x5E
+    "????",             // [95] -> 0x5F
+    "????",             // [96] -> 0x60
+    "????",             // [97] -> 0x61
+    "????",             // [98] -> 0x62
+    "????",             // [99] -> 0x63
+    "????",             // [100] -> 0x64
+    "????",             // [101] -> 0x65
+    "????",             // [102] -> 0x66
+    "????",             // [103] -> 0x67
+    "????",             // [104] -> 0x68
+    "????",             // [105] -> 0x69
+    "????",             // [106] -> 0x6A
+    "????",             // [107] -> 0x6B
+    "????",             // [108] -> 0x6C
+    "????",             // [109] -> 0x6D
+    "????",             // [110] -> 0x6E
+    "????",             // [111] -> 0x6F
+    "????",             // [112] -> 0x70
+    "????",             // [113] -> 0x71
+    "????",             // [114] -> 0x72
+    "????",             // [115] -> 0x73
+    "????",             // [116] -> 0x74
+    "????",             // [117] -> 0x75
+    "????",             // [118] -> 0x76
+    "????",             // [119] -> 0x77
+    "????",             // [120] -> 0x78
+    "????",             // [121] -> 0x79
+    "????",             // [122] -> 0x7A
+    "????",             // [123] -> 0x7B
+    "????",             // [124] -> 0x7C
+    "????",             // [125] -> 0x7D
+    "????",             // [126] -> 0x7E
+    "????",             // [127] -> 0x7F
+    "????",             // [128] -> 0x80
+    "????",             // [129] -> 0x81
+    "Linux Swap",       // [130] -> 0x82
+    "Linux",            // [131] -> 0x83
+    "Hibernation",      // [132] -> 0x84
+    "EXTENDED (Linux)", // [133] -> 0x85
+    "NTFS Vol Set",     // [134] -> 0x86
+    "NTFS Vol Set",     // [135] -> 0x87
+    "????",             // [136] -> 0x88
+    "????",             // [137] -> 0x89
+    "????",             // [138] -> 0x8A
+    "????",             // [139] -> 0x8B
+    "????",             // [140] -> 0x8C
+    "????",             // [141] -> 0x8D
+    "????",             // [142] -> 0x8E
+    "????",             // [143] -> 0x8F
+    "????",             // [144] -> 0x90
+    "????",             // [145] -> 0x91
+    "????",             // [146] -> 0x92
+    "????",             // [147] -> 0x93
+    "????",             // [148] -> 0x94
+    "????",             // [149] -> 0x95
+    "????",             // [150] -> 0x96
+    "????",             // [151] -> 0x97
+    "????",             // [152] -> 0x98
+    "????",             // [153] -> 0x99
+    "????",             // [154] -> 0x9A
+    "????",             // [155] -> 0x9B
+    "????",             // [156] -> 0x9C
+    "????",             // [157] -> 0x9D
+    "????",             // [158] -> 0x9E
+    "????",             // [159] -> 0x9F
+    "Hibernation",      // [160] -> 0xA0
+    "Hibernation",      // [161] -> 0xA1
+    "????",             // [162] -> 0xA2
+    "????",             // [163] -> 0xA3
+    "????",             // [164] -> 0xA4
+    "FreeBSD",          // [165] -> 0xA5
+    "OpenBSD",          // [166] -> 0xA6
+    "????",             // [167] -> 0xA7
+    "MacOS X",          // [168] -> 0xA8
+    "NetBSD",           // [169] -> 0xA9
+    "????",             // [170] -> 0xAA
+    "MacOS X Boot",     // [171] -> 0xAB
+    "????",             // [172] -> 0xAC
+    "????",             // [173] -> 0xAD
+    "????",             // [174] -> 0xAE
+    "????",             // [175] -> 0xAF
+    "????",             // [176] -> 0xB0
+    "????",             // [177] -> 0xB1
+    "????",             // [178] -> 0xB2
+    "????",             // [179] -> 0xB3
+    "????",             // [180] -> 0xB4
+    "????",             // [181] -> 0xB5
+    "????",             // [182] -> 0xB6
+    "????",             // [183] -> 0xB7
+    "????",             // [184] -> 0xB8
+    "????",             // [185] -> 0xB9
+    "????",             // [186] -> 0xBA
+    "????",             // [187] -> 0xBB
+    "????",             // [188] -> 0xBC
+    "????",             // [189] -> 0xBD
+    "????",             // [190] -> 0xBE
+    "????",             // [191] -> 0xBF
+    "????",             // [192] -> 0xC0
+    "????",             // [193] -> 0xC1
+    "????",             // [194] -> 0xC2
+    "????",             // [195] -> 0xC3
+    "????",             // [196] -> 0xC4
+    "????",             // [197] -> 0xC5
+    "????",             // [198] -> 0xC6
+    "????",             // [199] -> 0xC7
+    "????",             // [200] -> 0xC8
+    "????",             // [201] -> 0xC9
+    "????",             // [202] -> 0xCA
+    "????",             // [203] -> 0xCB
+    "????",             // [204] -> 0xCC
+    "????",             // [205] -> 0xCD
+    "????",             // [206] -> 0xCE
+    "????",             // [207] -> 0xCF
+    "????",             // [208] -> 0xD0
+    "????",             // [209] -> 0xD1
+    "????",             // [210] -> 0xD2
+    "????",             // [211] -> 0xD3
+    "????",             // [212] -> 0xD4
+    "????",             // [213] -> 0xD5
+    "????",             // [214] -> 0xD6
+    "????",             // [215] -> 0xD7
+    "????",             // [216] -> 0xD8
+    "????",             // [217] -> 0xD9
+    "????",             // [218] -> 0xDA
+    "????",             // [219] -> 0xDB
+    "????",             // [220] -> 0xDC
+    "????",             // [221] -> 0xDD
+    "????",             // [222] -> 0xDE
+    "????",             // [223] -> 0xDF
+    "????",             // [224] -> 0xE0
+    "????",             // [225] -> 0xE1
+    "????",             // [226] -> 0xE2
+    "????",             // [227] -> 0xE3
+    "????",             // [228] -> 0xE4
+    "????",             // [229] -> 0xE5
+    "????",             // [230] -> 0xE6
+    "????",             // [231] -> 0xE7
+    "????",             // [232] -> 0xE8
+    "????",             // [233] -> 0xE9
+    "????",             // [234] -> 0xEA
+    "????",             // [235] -> 0xEB
+    "????",             // [236] -> 0xEC
+    "????",             // [237] -> 0xED
+    "????",             // [238] -> 0xEE
+    "????",             // [239] -> 0xEF
+    "????",             // [240] -> 0xF0
+    "????",             // [241] -> 0xF1
+    "????",             // [242] -> 0xF2
+    "????",             // [243] -> 0xF3
+    "????",             // [244] -> 0xF4
+    "????",             // [245] -> 0xF5
+    "????",             // [246] -> 0xF6
+    "????",             // [247] -> 0xF7
+    "????",             // [248] -> 0xF8
+    "????",             // [249] -> 0xF9
+    "????",             // [250] -> 0xFA
+    "????",             // [251] -> 0xFB
+    "????",             // [252] -> 0xFC
+    "????",             // [253] -> 0xFD
+    "????",             // [254] -> 0xFE
+    "????"              // [255] -> 0xFF
+}; 
+
+// Everything known about one volume.  The library functions work on the volume of the calling
+// thread, set by each fg_ entry point, so two volumes can be analyzed at once on different threads.
+struct fg_volume {
+    fg_options args;
+    int fp;
+    int fs_type;
+    struct mbr_sector *mbr;
+
+    // File system geometry
+    uint32_t bps; // Bytes Per Sector
+    uint32_t spc; // Sectors Per Cluster
+    uint32_t reserved_and_fats;
+    uint32_t root_dir_off; // Offset in Bytes from start of disk image
+    struct fat_boot_sector *fat_bs;
+    uint8_t *boot_region; // the start of the reserved area, with the boot records and their backups
+    uint32_t boot_region_size;
+    uint8_t *fat1;
+    uint8_t *fat2;
+    uint32_t fat_size_in_bytes;
+
+    image_backend image;
+    block_cache cache;
+    hash_pool hashes;
+    timeline events;
+    path_index paths;
+    recovery recovered;
+    extraction extracted;
+    pattern_matcher matcher;
+    extent_list free_space;
+    extent_list bad_clusters;
+    layout_stats layout;
+    finding_list findings;
+    sampler sample;
+    checkpoint ckpt;
+    progress_report progress;
+    arena tree_arena;
+    fat_page_cache fat_cache;
+    dir_queue dirs;
+    bool hidden_data_found;
+
+    // Where the report goes, NULL for nowhere
+    FILE *out;
+    fg_finding_callback on_finding;
+    void *on_finding_user;
+
+    // Fatal errors on the thread inside an fg_ call return here instead of ending the process
+    jmp_buf fail;
+    pthread_t api_thread;
+    bool failed;
+    bool worker_failed; // a worker thread gave up on a job, the fg_ call waiting for it fails
+};
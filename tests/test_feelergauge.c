@@ -0,0 +1,1583 @@
+// Tests of the internals of feelergauge.c.  They are static, so the file is included whole.
+#include "../feelergauge.c"
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if (!(condition)){ \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+// FAT1 of a volume of 18 clusters with chains, free and bad clusters, and links that are not valid
+static uint32_t sample_fat[20] = {
+    0x0ffffff8, 0xffffffff,
+    3, 4, FAT32_EOF, // 2 to 4: a contiguous file
+    0, 0, // 5 and 6: free
+    9, // 7: continues at 9
+    10, // 8: links to a free cluster
+    FAT32_EOF, // 9
+    0, 0, // 10 and 11: free
+    13, // 12: links to a bad cluster
+    FAT32_BAD, // 13
+    0xf000000f, FAT32_EOF, // 14 to 15: the reserved bits of 14 are set
+    100, // 16: links outside the volume
+    0, 0, 0 // 17 to 19: free
+};
+
+/**
+ * @brief Sets up a FAT32 volume of one sector clusters, with no reserved area or FATs, whose FAT1
+ * is sample_fat.  That is enough for read_alloctable and data_cluster_count.
+ */
+static void use_sample_fat(struct fg_volume *volume, struct fat_boot_sector *boot){
+    memset(volume, 0, sizeof(*volume));
+    memset(boot, 0, sizeof(*boot));
+    boot->is_fat32 = true;
+    boot->sector_count_32b = 18;
+    volume->bps = 512;
+    volume->spc = 1;
+    volume->fat_bs = boot;
+    volume->fat1 = (uint8_t *)sample_fat;
+    volume->fat_size_in_bytes = sizeof(sample_fat);
+    fg = volume;
+}
+
+/**
+ * @brief Checks the runs next_fat_run finds in sample_fat
+ */
+static void test_next_fat_run(void){
+    struct fg_volume volume;
+    struct fat_boot_sector boot;
+    struct {
+        uint64_t start;
+        uint64_t after;
+        int type;
+        uint32_t next;
+    } runs[] = {
+        {2, 5, EXTENT_EOF, FAT32_EOF},
+        {5, 7, EXTENT_FREE, 0},
+        {7, 8, EXTENT_CHAIN, 9},
+        {8, 9, EXTENT_INVALID, 10},
+        {9, 10, EXTENT_EOF, FAT32_EOF},
+        {10, 12, EXTENT_FREE, 0},
+        {12, 13, EXTENT_INVALID, 13},
+        {13, 14, EXTENT_BAD, FAT32_BAD},
+        {14, 16, EXTENT_EOF, FAT32_EOF},
+        {16, 17, EXTENT_INVALID, 100},
+        {17, 20, EXTENT_FREE, 0}
+    };
+    uint64_t cluster = 2;
+
+    use_sample_fat(&volume, &boot);
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++){
+        int type;
+        uint32_t next;
+        CHECK(cluster == runs[i].start);
+        cluster = next_fat_run(&boot, cluster, 20, &type, &next);
+        CHECK(cluster == runs[i].after);
+        CHECK(type == runs[i].type);
+        CHECK(next == runs[i].next);
+    }
+    fg = NULL;
+}
+
+/**
+ * @brief Checks the totals analyze_layout always counts, and that the chains are only counted
+ * when asked for
+ */
+static void test_analyze_layout(void){
+    struct fg_volume volume;
+    struct fat_boot_sector boot;
+    struct layout_stats stats;
+
+    use_sample_fat(&volume, &boot);
+    analyze_layout(&boot, &stats, false);
+    CHECK(stats.valid);
+    CHECK(!stats.per_chain);
+    CHECK(stats.allocated_runs == 7);
+    CHECK(stats.allocated_clusters == 10);
+    CHECK(stats.weighted_run_sum == 18);
+    CHECK(stats.seeks == 1);
+    CHECK(stats.seek_distance == 1);
+    CHECK(stats.free_runs == 3);
+    CHECK(stats.free_clusters == 7);
+    CHECK(stats.largest_free_start == 17);
+    CHECK(stats.largest_free_count == 3);
+    CHECK(stats.chains == 0);
+
+    // 7 continues at 9, every other run is a chain of its own
+    analyze_layout(&boot, &stats, true);
+    CHECK(stats.valid);
+    CHECK(stats.per_chain);
+    CHECK(stats.allocated_clusters == 10);
+    CHECK(stats.chains == 6);
+    CHECK(stats.fragmented_chains == 1);
+    CHECK(stats.max_extents == 2);
+    CHECK(stats.histogram[0] == 5);
+    CHECK(stats.histogram[1] == 1);
+    fg = NULL;
+}
+
+/**
+ * @brief Checks the UTF-8 put_utf8 writes for each length, and that it writes nothing when the
+ * character does not fit
+ */
+static void test_put_utf8(void){
+    char out[4];
+
+    CHECK(put_utf8('A', out, 4) == 1 && out[0] == 'A');
+    CHECK(put_utf8(0xe9, out, 4) == 2 && !memcmp(out, "\xc3\xa9", 2));
+    CHECK(put_utf8(0x7ff, out, 4) == 2 && !memcmp(out, "\xdf\xbf", 2));
+    CHECK(put_utf8(0x20ac, out, 4) == 3 && !memcmp(out, "\xe2\x82\xac", 3));
+    CHECK(put_utf8(0xfffd, out, 4) == 3 && !memcmp(out, "\xef\xbf\xbd", 3));
+    CHECK(put_utf8(0x1f600, out, 4) == 4 && !memcmp(out, "\xf0\x9f\x98\x80", 4));
+    CHECK(put_utf8('A', out, 0) == 0);
+    CHECK(put_utf8(0xe9, out, 1) == 0);
+    CHECK(put_utf8(0x20ac, out, 2) == 0);
+    CHECK(put_utf8(0x1f600, out, 3) == 0);
+}
+
+/**
+ * @brief Writes a long name as the entries in front of an 8.3 entry, the end of the name first
+ *
+ * @param deleted marks the entries the way deleting the file does
+ * @return uint32_t : the number of entries
+ */
+static uint32_t make_long_name(uint8_t (*lfn)[32], const uint16_t *units, uint32_t length, uint8_t checksum, bool deleted){
+    uint32_t count = (length + LFN_CHARS_PER_ENTRY) / LFN_CHARS_PER_ENTRY;
+
+    // A name that fills its last entry has no NUL after it
+    if (length % LFN_CHARS_PER_ENTRY == 0)
+        count--;
+    memset(lfn, 0, count * 32);
+    for (uint32_t k = 0; k < count; k++){
+        uint8_t *entry = lfn[count - 1 - k];
+        entry[LFN_SEQUENCE] = deleted ? UNALLOCATED : (k + 1) | (k == count - 1 ? LFN_LAST_ENTRY : 0);
+        entry[FILE_ATTRIBUTES] = FLAG_FAT_LONG_FILE_NAME;
+        entry[LFN_CHECKSUM] = checksum;
+        for (uint32_t j = 0; j < LFN_CHARS_PER_ENTRY; j++){
+            uint32_t i = k * LFN_CHARS_PER_ENTRY + j;
+            uint32_t offset = j < 5 ? LFN_CHARS_1 + j * 2 : j < 11 ? LFN_CHARS_2 + (j - 5) * 2 : LFN_CHARS_3 + (j - 11) * 2;
+            uint16_t unit = i < length ? units[i] : i == length ? 0 : 0xffff;
+            entry[offset] = unit & 0xff;
+            entry[offset + 1] = unit >> 8;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief make_long_name for an ASCII name
+ */
+static uint32_t make_ascii_long_name(uint8_t (*lfn)[32], const char *name, uint8_t checksum, bool deleted){
+    uint16_t units[LFN_MAX_ENTRIES * LFN_CHARS_PER_ENTRY];
+    uint32_t length = strlen(name);
+
+    for (uint32_t i = 0; i < length; i++)
+        units[i] = (uint8_t)name[i];
+    return make_long_name(lfn, units, length, checksum, deleted);
+}
+
+/**
+ * @brief Checks that decode_long_name takes only complete runs of entries with the checksum of the
+ * 8.3 name, pairs surrogates, and refuses names that would not make a usable path
+ */
+static void test_decode_long_name(void){
+    uint8_t lfn[LFN_MAX_ENTRIES + 1][32];
+    uint8_t sfn[32] = "HELLOW~1TXT";
+    uint8_t checksum = lfn_checksum(sfn);
+    char out[LFN_NAME_SIZE];
+    uint32_t count;
+
+    count = make_ascii_long_name(lfn, "hello world.txt", checksum, false);
+    CHECK(count == 2);
+    CHECK(decode_long_name(lfn, count, sfn, out) && !strcmp(out, "hello world.txt"));
+    CHECK(!decode_long_name(lfn, 0, sfn, out));
+
+    // A name that exactly fills its entries
+    count = make_ascii_long_name(lfn, "abcdefghijklmnopqrstuvwxyz", checksum, false);
+    CHECK(count == 2);
+    CHECK(decode_long_name(lfn, count, sfn, out) && !strcmp(out, "abcdefghijklmnopqrstuvwxyz"));
+
+    // Entries left by another 8.3 name
+    count = make_ascii_long_name(lfn, "hello world.txt", checksum + 1, false);
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+    count = make_ascii_long_name(lfn, "hello world.txt", checksum, false);
+    lfn[1][LFN_CHECKSUM]++;
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+
+    // Entries out of sequence, or a run that is missing its last entry
+    count = make_ascii_long_name(lfn, "hello world.txt", checksum, false);
+    memcpy(lfn[LFN_MAX_ENTRIES], lfn[0], 32);
+    memcpy(lfn[0], lfn[1], 32);
+    memcpy(lfn[1], lfn[LFN_MAX_ENTRIES], 32);
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+    count = make_ascii_long_name(lfn, "hello world.txt", checksum, false);
+    lfn[0][LFN_SEQUENCE] &= ~LFN_LAST_ENTRY;
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+    count = make_ascii_long_name(lfn, "hello world.txt", checksum, false);
+    CHECK(!decode_long_name(lfn + 1, count - 1, sfn, out));
+
+    // More entries than a 255 character name needs
+    for (uint32_t i = 0; i <= LFN_MAX_ENTRIES; i++){
+        memset(lfn[i], 'a', 32);
+        lfn[i][LFN_SEQUENCE] = (LFN_MAX_ENTRIES + 1 - i) | (i == 0 ? LFN_LAST_ENTRY : 0);
+        lfn[i][LFN_CHECKSUM] = checksum;
+    }
+    CHECK(!decode_long_name(lfn, LFN_MAX_ENTRIES + 1, sfn, out));
+
+    // Surrogate pairs become one character, unpaired halves U+FFFD
+    {
+        const uint16_t pair[] = {'a', 0xd83d, 0xde00, '.', 't'};
+        const uint16_t high[] = {'a', 0xd83d, 'b'};
+        const uint16_t low[] = {0xde00};
+        count = make_long_name(lfn, pair, 5, checksum, false);
+        CHECK(decode_long_name(lfn, count, sfn, out) && !strcmp(out, "a\xf0\x9f\x98\x80.t"));
+        count = make_long_name(lfn, high, 3, checksum, false);
+        CHECK(decode_long_name(lfn, count, sfn, out) && !strcmp(out, "a\xef\xbf\xbd" "b"));
+        count = make_long_name(lfn, low, 1, checksum, false);
+        CHECK(decode_long_name(lfn, count, sfn, out) && !strcmp(out, "\xef\xbf\xbd"));
+    }
+
+    // Names with a slash or a control character
+    count = make_ascii_long_name(lfn, "../x", checksum, false);
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+    count = make_ascii_long_name(lfn, "a\tb", checksum, false);
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+}
+
+/**
+ * @brief Checks that the lost first character of a deleted file's 8.3 name is made again from its
+ * long name, rather than taken from whatever value matches the checksum
+ */
+static void test_decode_deleted_long_name(void){
+    uint8_t lfn[LFN_MAX_ENTRIES][32];
+    uint8_t sfn[32] = "DELETE~1JPG";
+    uint8_t deleted[32];
+    char out[LFN_NAME_SIZE];
+    uint32_t count;
+
+    memcpy(deleted, sfn, 32);
+    deleted[0] = UNALLOCATED;
+    count = make_ascii_long_name(lfn, "Deleted long name.jpg", lfn_checksum(sfn), true);
+    CHECK(decode_long_name(lfn, count, deleted, out) && !strcmp(out, "Deleted long name.jpg"));
+
+    // The same entries in front of a live 8.3 entry have lost their sequence numbers
+    CHECK(!decode_long_name(lfn, count, sfn, out));
+
+    // The checksum of another first character
+    sfn[0] = 'X';
+    count = make_ascii_long_name(lfn, "Deleted long name.jpg", lfn_checksum(sfn), true);
+    CHECK(!decode_long_name(lfn, count, deleted, out));
+
+    // Leading dots and spaces are dropped and characters not allowed in 8.3 names become _
+    memcpy(sfn, "HIDDEN  TXT", 11);
+    memcpy(deleted + 1, sfn + 1, 10);
+    count = make_ascii_long_name(lfn, " .hidden.txt", lfn_checksum(sfn), true);
+    CHECK(decode_long_name(lfn, count, deleted, out) && !strcmp(out, " .hidden.txt"));
+    memcpy(sfn, "_PLUS   TXT", 11);
+    memcpy(deleted + 1, sfn + 1, 10);
+    count = make_ascii_long_name(lfn, "+plus.txt", lfn_checksum(sfn), true);
+    CHECK(decode_long_name(lfn, count, deleted, out) && !strcmp(out, "+plus.txt"));
+
+    // A first character outside ASCII depends on the code page
+    {
+        const uint16_t name[] = {0xe9, 't', 0xe9, '.', 't', 'x', 't'};
+        memcpy(sfn, "\x90T\x90     TXT", 11);
+        memcpy(deleted + 1, sfn + 1, 10);
+        count = make_long_name(lfn, name, 7, lfn_checksum(sfn), true);
+        CHECK(!decode_long_name(lfn, count, deleted, out));
+    }
+}
+
+/**
+ * @brief Makes a directory for the files a test writes, and points fg at a volume that fatal can
+ * return to.  The caller must setjmp(volume->fail) before using it.
+ */
+static void use_temp_volume(struct fg_volume *volume, char *dir){
+    memset(volume, 0, sizeof(*volume));
+    strcpy(dir, "/tmp/fg_test_XXXXXX");
+    if (mkdtemp(dir) == NULL){
+        perror("mkdtemp");
+        exit(1);
+    }
+    enter_volume(volume);
+}
+
+/**
+ * @brief Fills a buffer with data that compresses, but not to nothing, so gzip writes many
+ * deflate blocks
+ */
+static void fill_test_data(uint8_t *data, size_t length, uint32_t seed){
+    for (size_t i = 0; i < length; i++){
+        seed = seed * 1103515245 + 12345;
+        data[i] = (seed >> 16) % 4 ? "feeler gauge "[i % 13] : seed >> 24;
+    }
+}
+
+/**
+ * @brief Writes a gzip file made of one member per part
+ */
+static void write_gzip(const char *path, const uint8_t *data, const size_t *parts, int part_count){
+    size_t done = 0;
+
+    unlink(path);
+    for (int i = 0; i < part_count; i++){
+        gzFile file = gzopen(path, "ab");
+        if (file == NULL || gzwrite(file, data + done, parts[i]) != (int)parts[i] || gzclose(file) != Z_OK){
+            fprintf(stderr, "Could not write %s\n", path);
+            exit(1);
+        }
+        done += parts[i];
+    }
+}
+
+/**
+ * @brief Checks reads of a two member gzip image against the data it holds, including reads
+ * across block and member boundaries, and that the saved access point index is used on the
+ * next open
+ */
+static void test_gzip_image(void){
+    struct fg_volume volume;
+    struct fg_options args = {0};
+    char dir[32];
+    char index_path[PATH_MAX];
+    size_t parts[] = {GZIP_INDEX_SPAN * 5 / 2, GZIP_INDEX_SPAN / 2};
+    size_t length = parts[0] + parts[1];
+    uint8_t *data = malloc(length);
+    uint8_t *read_back = malloc(length);
+    uint64_t *block_start;
+    uint64_t block_count;
+    int fp;
+
+    use_temp_volume(&volume, dir);
+    if (setjmp(volume.fail)){
+        CHECK(!"the gzip image could not be opened");
+        return;
+    }
+    fill_test_data(data, length, 1);
+    snprintf(args.image_path, sizeof(args.image_path), "%s/image.gz", dir);
+    snprintf(index_path, sizeof(index_path), "%s.fgzi", args.image_path);
+    write_gzip(args.image_path, data, parts, 2);
+    fp = open(args.image_path, O_RDONLY);
+    CHECK(fp >= 0);
+
+    open_image_backend(fp, &args);
+    CHECK(volume.image.format == IMAGE_GZIP);
+    CHECK(volume.image.size == length);
+    // An access point at least every span, and one at the start of the second member
+    CHECK(volume.image.block_count >= 4);
+    bool member_start = false;
+    for (uint64_t i = 0; i < volume.image.block_count; i++)
+        member_start |= volume.image.block_start[i] == parts[0];
+    CHECK(member_start);
+    CHECK(access(index_path, R_OK) == 0);
+
+    CHECK(image_pread(fp, read_back, length, 0) == (ssize_t)length);
+    CHECK(!memcmp(read_back, data, length));
+    for (uint64_t i = 1; i < volume.image.block_count; i++){
+        uint64_t boundary = volume.image.block_start[i];
+        CHECK(image_pread(fp, read_back, 4096, boundary - 100) == 4096);
+        CHECK(!memcmp(read_back, data + boundary - 100, 4096));
+    }
+    // Reads stop at the end of the decompressed data
+    CHECK(image_pread(fp, read_back, 4096, length - 10) == 10);
+    CHECK(!memcmp(read_back, data + length - 10, 10));
+    CHECK(image_pread(fp, read_back, 4096, length) == 0);
+
+    block_count = volume.image.block_count;
+    block_start = malloc((block_count + 1) * sizeof(uint64_t));
+    memcpy(block_start, volume.image.block_start, (block_count + 1) * sizeof(uint64_t));
+    close_image_backend(&volume.image);
+
+    // Opened again from the saved index, which is then kept as it is
+    struct stat before;
+    stat(index_path, &before);
+    memset(&volume.image, 0, sizeof(volume.image));
+    open_image_backend(fp, &args);
+    CHECK(volume.image.block_count == block_count);
+    CHECK(!memcmp(volume.image.block_start, block_start, (block_count + 1) * sizeof(uint64_t)));
+    CHECK(image_pread(fp, read_back, parts[1] + 100, parts[0] - 100) == (ssize_t)parts[1] + 100);
+    CHECK(!memcmp(read_back, data + parts[0] - 100, parts[1] + 100));
+    close_image_backend(&volume.image);
+    struct stat after;
+    stat(index_path, &after);
+    CHECK(after.st_ino == before.st_ino);
+
+    // A damaged index is rebuilt
+    FILE *damaged = fopen(index_path, "r+b");
+    fseek(damaged, sizeof(struct gzip_index_header) + 8, SEEK_SET);
+    fwrite("\xff\xff\xff\xff\xff\xff\xff\xff", 8, 1, damaged);
+    fclose(damaged);
+    memset(&volume.image, 0, sizeof(volume.image));
+    open_image_backend(fp, &args);
+    CHECK(volume.image.block_count == block_count);
+    CHECK(!memcmp(volume.image.block_start, block_start, (block_count + 1) * sizeof(uint64_t)));
+    CHECK(image_pread(fp, read_back, length, 0) == (ssize_t)length);
+    CHECK(!memcmp(read_back, data, length));
+    close_image_backend(&volume.image);
+    stat(index_path, &after);
+    CHECK(after.st_ino != before.st_ino);
+
+    close(fp);
+    unlink(index_path);
+    unlink(args.image_path);
+    rmdir(dir);
+    free(block_start);
+    free(read_back);
+    free(data);
+}
+
+static void set_le32(uint8_t *p, uint32_t value){
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+}
+
+/**
+ * @brief Writes padding and then frames of the given compressed sizes followed by a zstd
+ * seekable seek table listing them, and indexes the file.  The frames themselves are not read.
+ */
+static int index_seek_table(struct image_backend *img, const char *path, const uint32_t (*frames)[2], uint32_t count,
+    uint32_t table_frames, uint32_t padding){
+    uint8_t entry[12] = {0};
+    uint8_t skippable[8];
+    uint8_t footer[ZSTD_SEEK_TABLE_FOOTER_SIZE];
+    FILE *file = fopen(path, "wb");
+    int ret;
+
+    for (uint32_t j = 0; j < padding; j++)
+        fputc(0, file);
+    for (uint32_t i = 0; i < count; i++)
+        for (uint32_t j = 0; j < frames[i][0]; j++)
+            fputc(0x5a, file);
+    set_le32(skippable, ZSTD_SKIPPABLE_SIG | 0xe);
+    set_le32(skippable + 4, count * 12 + ZSTD_SEEK_TABLE_FOOTER_SIZE);
+    fwrite(skippable, 8, 1, file);
+    for (uint32_t i = 0; i < count; i++){
+        set_le32(entry, frames[i][0]);
+        set_le32(entry + 4, frames[i][1]);
+        fwrite(entry, 12, 1, file);
+    }
+    set_le32(footer, table_frames);
+    footer[4] = 0x80; // entries with checksums
+    set_le32(footer + 5, ZSTD_SEEKABLE_SIG);
+    fwrite(footer, ZSTD_SEEK_TABLE_FOOTER_SIZE, 1, file);
+    fclose(file);
+
+    memset(img, 0, sizeof(*img));
+    img->fp = open(path, O_RDONLY);
+    img->file_size = lseek(img->fp, 0, SEEK_END);
+    ret = build_zstd_index(img);
+    close(img->fp);
+    return ret;
+}
+
+static void free_seek_table(struct image_backend *img){
+    free(img->block_start);
+    free(img->frame_offset);
+    free(img->points);
+}
+
+/**
+ * @brief Checks the zstd seek table parser on hand made tables
+ */
+static void test_zstd_seek_table(void){
+    struct fg_volume volume;
+    struct image_backend img;
+    char dir[32];
+    char path[64];
+    const uint32_t frames[][2] = {{10, 100}, {20, 200}, {5, ZSTD_MAX_FRAME_SIZE}};
+    const uint32_t large[][2] = {{10, 100}, {20, ZSTD_MAX_FRAME_SIZE + 1}};
+
+    use_temp_volume(&volume, dir);
+    snprintf(path, sizeof(path), "%s/image.zst", dir);
+
+    CHECK(index_seek_table(&img, path, frames, 3, 3, 0) == 0);
+    CHECK(img.block_count == 3);
+    CHECK(img.block_start[0] == 0 && img.block_start[1] == 100 && img.block_start[2] == 300);
+    CHECK(img.block_start[3] == 300 + ZSTD_MAX_FRAME_SIZE);
+    CHECK(img.frame_offset[0] == 0 && img.frame_offset[1] == 10 && img.frame_offset[2] == 30 && img.frame_offset[3] == 35);
+    free_seek_table(&img);
+
+    // A frame count that does not match the table
+    CHECK(index_seek_table(&img, path, frames, 3, 2, 0) == -1);
+    free_seek_table(&img);
+    CHECK(index_seek_table(&img, path, frames, 3, 4, 0) == -1);
+    free_seek_table(&img);
+    // Frame sizes that do not add up to where the seek table starts
+    CHECK(index_seek_table(&img, path, frames, 3, 3, 1) == -1);
+    free_seek_table(&img);
+    // A frame too large to be cached whole
+    CHECK(index_seek_table(&img, path, large, 2, 2, 0) == -1);
+    free_seek_table(&img);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief A small FAT32 volume built in memory by the tests: 512 byte sectors, one sector clusters,
+ * 32 reserved sectors with the backup boot record at sector 6, and two FATs.  The root directory is
+ * cluster 2.
+ */
+struct test_image {
+    uint8_t *data;
+    size_t size;
+    uint32_t clusters;
+    uint32_t fat_sectors;
+    uint32_t *fat; // FAT1, copied to FAT2 when saved
+};
+
+static void set_le16(uint8_t *p, uint16_t value){
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void test_image_init(struct test_image *img, uint32_t clusters){
+    uint8_t *boot;
+    uint8_t *fsinfo;
+
+    // With fewer clusters the volume would be FAT12 or FAT16, whatever its boot sector says
+    img->clusters = clusters > 65525 ? clusters : 65525;
+    img->fat_sectors = ((img->clusters + 2) * 4 + 511) / 512;
+    img->size = (32 + 2 * img->fat_sectors + img->clusters) * 512;
+    img->data = calloc(1, img->size);
+    img->fat = calloc(img->fat_sectors * 128, sizeof(uint32_t));
+    boot = img->data;
+    memcpy(boot, "\xeb\x58\x90" "MSWIN4.1", 11);
+    set_le16(boot + 11, 512);
+    boot[13] = 1;
+    set_le16(boot + 14, 32);
+    boot[16] = 2;
+    boot[21] = 0xf8;
+    set_le16(boot + 24, 63);
+    set_le16(boot + 26, 255);
+    set_le32(boot + 32, img->size / 512);
+    set_le32(boot + 36, img->fat_sectors);
+    set_le32(boot + 44, 2);
+    set_le16(boot + 48, 1);
+    set_le16(boot + 50, 6);
+    boot[64] = 0x80;
+    boot[66] = 0x29;
+    set_le32(boot + 67, 0x12345678);
+    memcpy(boot + 71, "TEST VOLUMEFAT32   ", 19);
+    set_le16(boot + 510, 0xaa55);
+    fsinfo = img->data + 512;
+    set_le32(fsinfo, 0x41615252);
+    set_le32(fsinfo + 484, 0x61417272);
+    set_le32(fsinfo + 488, 0xffffffff);
+    set_le32(fsinfo + 492, 0xffffffff);
+    set_le32(fsinfo + 508, 0xaa550000);
+    img->fat[0] = 0x0ffffff8;
+    img->fat[1] = 0x0fffffff;
+    img->fat[2] = FAT32_EOF;
+}
+
+static uint8_t* test_cluster(struct test_image *img, uint32_t cluster){
+    return img->data + (32 + 2 * img->fat_sectors + cluster - 2) * 512;
+}
+
+/**
+ * @brief Links count clusters from first into one chain
+ */
+static void test_chain(struct test_image *img, uint32_t first, uint32_t count){
+    for (uint32_t i = 0; i < count; i++)
+        img->fat[first + i] = i + 1 < count ? first + i + 1 : FAT32_EOF;
+}
+
+/**
+ * @brief Writes an 8.3 directory entry into a slot of a one cluster directory
+ */
+static uint8_t* test_entry(struct test_image *img, uint32_t dir, uint32_t slot, const char *name, uint8_t attributes, uint32_t cluster, uint32_t size){
+    uint8_t *entry = test_cluster(img, dir) + slot * 32;
+
+    memcpy(entry, name, 11);
+    entry[11] = attributes;
+    set_le16(entry + 20, cluster >> 16);
+    set_le16(entry + 22, 0x6000); // 12:00:00
+    set_le16(entry + 24, 0x5a21); // 2025-01-01
+    set_le16(entry + 26, cluster);
+    set_le32(entry + 28, size);
+    return entry;
+}
+
+/**
+ * @brief Adds a file of size bytes in a chain from first, filled with a byte that depends on it.
+ * The slack after the end of the file is left zero.
+ */
+static void test_file(struct test_image *img, uint32_t dir, uint32_t slot, const char *name, uint32_t first, uint32_t size){
+    uint32_t count = size ? (size + 511) / 512 : 0;
+
+    test_entry(img, dir, slot, name, 0x20, count ? first : 0, size);
+    if (count == 0)
+        return;
+    test_chain(img, first, count);
+    for (uint32_t i = 0; i < size; i++)
+        test_cluster(img, first + i / 512)[i % 512] = 'a' + first % 26;
+}
+
+/**
+ * @brief Adds a one cluster directory with its . and .. entries
+ */
+static void test_directory(struct test_image *img, uint32_t parent, uint32_t slot, const char *name, uint32_t cluster){
+    test_entry(img, parent, slot, name, 0x10, cluster, 0);
+    test_chain(img, cluster, 1);
+    test_entry(img, cluster, 0, ".          ", 0x10, cluster, 0);
+    test_entry(img, cluster, 1, "..         ", 0x10, parent == 2 ? 0 : parent, 0);
+}
+
+/**
+ * @brief Writes the long name entries of a file followed by its 8.3 entry and data, and returns
+ * the slot after them
+ */
+static uint32_t test_long_file(struct test_image *img, uint32_t dir, uint32_t slot, const char *long_name, const char *name,
+    uint32_t first, uint32_t size){
+    uint8_t lfn[LFN_MAX_ENTRIES][32];
+    uint32_t count = make_ascii_long_name(lfn, long_name, lfn_checksum((const uint8_t *)name), false);
+
+    memcpy(test_cluster(img, dir) + slot * 32, lfn, count * 32);
+    test_file(img, dir, slot + count, name, first, size);
+    return slot + count + 1;
+}
+
+/**
+ * @brief Writes the image out with both FATs and the backup boot record filled in
+ */
+static void test_image_save(struct test_image *img, const char *path){
+    FILE *file = fopen(path, "wb");
+
+    memcpy(img->data + 6 * 512, img->data, 3 * 512);
+    for (uint32_t i = 0; i < 2; i++){
+        uint8_t *fat = img->data + (32 + i * img->fat_sectors) * 512;
+        for (uint32_t c = 0; c < img->clusters + 2; c++)
+            set_le32(fat + c * 4, img->fat[c]);
+    }
+    if (file == NULL || fwrite(img->data, 1, img->size, file) != img->size || fclose(file)){
+        fprintf(stderr, "Could not write %s\n", path);
+        exit(1);
+    }
+}
+
+static void test_image_free(struct test_image *img){
+    free(img->data);
+    free(img->fat);
+}
+
+/**
+ * @brief The findings and report of a run on a test image
+ */
+struct test_run {
+    char *report;
+    size_t report_size;
+    char labels[4096]; // labels of the findings, one per line
+    uint32_t findings;
+    uint32_t slack_findings;
+};
+
+static void collect_finding(const struct fg_finding *finding, void *user){
+    struct test_run *run = user;
+    size_t used = strlen(run->labels);
+
+    snprintf(run->labels + used, sizeof(run->labels) - used, "%s: %s\n", finding->region, finding->label);
+    run->findings++;
+}
+
+/**
+ * @brief Opens an image with the given options, runs every stage on it and keeps the report.
+ * The volume is returned open so its state can be checked, and must be closed with fg_close.
+ */
+static fg_volume* run_test_image(struct fg_options *options, struct test_run *run){
+    FILE *out;
+    fg_volume *volume;
+
+    memset(run, 0, sizeof(*run));
+    out = open_memstream(&run->report, &run->report_size);
+    volume = fg_open(options);
+    if (volume == NULL){
+        fclose(out);
+        return NULL;
+    }
+    fg_set_output(volume, out);
+    fg_set_finding_callback(volume, collect_finding, run);
+    CHECK(fg_parse(volume) == 0);
+    CHECK(fg_scan(volume) == 0);
+    CHECK(fg_walk(volume) == 0);
+    CHECK(fg_summarize(volume) == 0);
+    fg_set_output(volume, NULL);
+    fclose(out);
+    return volume;
+}
+
+static void test_options(struct fg_options *options, const char *path){
+    fg_default_options(options);
+    snprintf(options->image_path, sizeof(options->image_path), "%s", path);
+    strcpy(options->file_system, "fat32");
+    options->h_flag = true;
+}
+
+/**
+ * @brief Checks the sample sizes, the picks from each bin and the confidence bound
+ */
+static void test_sample_math(void){
+    struct sampler s = {.fraction = 0.1, .rng = 5};
+    uint64_t last = 0;
+
+    CHECK(sample_target(&s, 0) == 0);
+    CHECK(sample_target(&s, 2) == 1);
+    CHECK(sample_target(&s, 10) == 1);
+    CHECK(sample_target(&s, 11) == 2);
+    CHECK(sample_target(&s, 100) == 10);
+    s.fraction = 1;
+    CHECK(sample_target(&s, 7) == 7);
+
+    // One pick from each of the equal bins
+    for (uint64_t bin = 0; bin < 7; bin++){
+        uint64_t pick = sample_pick(&s, 100, 7, bin);
+        CHECK(pick >= bin * 100 / 7 && pick < (bin + 1) * 100 / 7);
+        CHECK(bin == 0 || pick > last);
+        last = pick;
+    }
+    for (uint64_t bin = 0; bin < 3; bin++)
+        CHECK(sample_pick(&s, 3, 3, bin) == bin);
+
+    // The same seed gives the same picks
+    {
+        struct sampler a = {.rng = 42};
+        struct sampler b = {.rng = 42};
+        bool same = true;
+        for (uint64_t bin = 0; bin < 50; bin++)
+            same &= sample_pick(&a, 100000, 50, bin) == sample_pick(&b, 100000, 50, bin);
+        CHECK(same);
+    }
+
+    // The one sided 95% Wilson bound
+    CHECK(sample_upper_bound(0, 0) == 1);
+    CHECK(fabs(sample_upper_bound(0, 100) - 0.026348) < 1e-5);
+    CHECK(fabs(sample_upper_bound(50, 100) - 0.581159) < 1e-5);
+    CHECK(sample_upper_bound(100, 100) == 1);
+    CHECK(sample_upper_bound(0, 1) > sample_upper_bound(0, 10));
+    CHECK(sample_upper_bound(1, 100) > sample_upper_bound(0, 100));
+}
+
+/**
+ * @brief Builds a volume of directories of files that all have data in their slack
+ */
+static void make_slack_image(const char *path, uint32_t directories, uint32_t files){
+    struct test_image img;
+    uint32_t next = 3 + directories;
+
+    test_image_init(&img, next + directories * files + 16);
+    for (uint32_t d = 0; d < directories; d++){
+        char name[12];
+        snprintf(name, sizeof(name), "DIR%-8u", d);
+        test_directory(&img, 2, d, name, 3 + d);
+        for (uint32_t f = 0; f < files; f++){
+            snprintf(name, sizeof(name), "FILE%-4uTXT", f);
+            test_file(&img, 3 + d, 2 + f, name, next, 100);
+            test_cluster(&img, next)[300] = 'x';
+            next++;
+        }
+    }
+    test_image_save(&img, path);
+    test_image_free(&img);
+}
+
+/**
+ * @brief Checks that file slack is sampled across all the files of the volume, so a volume with
+ * few files still gets checked, and that a seed always picks the same files
+ */
+static void test_sample_file_slack(void){
+    struct fg_volume scratch;
+    struct fg_options options;
+    struct test_run first, again;
+    struct sample_stratum *stratum;
+    char dir[32];
+    char path[64];
+    fg_volume *volume;
+    bool differs = false;
+
+    use_temp_volume(&scratch, dir);
+    snprintf(path, sizeof(path), "%s/slack.img", dir);
+
+    // Two files in two directories at 10% still check one
+    make_slack_image(path, 2, 1);
+    test_options(&options, path);
+    options.sample_percent = 10;
+    volume = run_test_image(&options, &first);
+    CHECK(volume != NULL);
+    stratum = &volume->sample.strata[STRATUM_FILE_SLACK];
+    CHECK(stratum->population == 2 && stratum->sampled == 1 && stratum->positive == 1);
+    CHECK(strstr(first.report, "file slack: checked 1 of 2 units, 1 held data") != NULL);
+    fg_close(volume);
+    free(first.report);
+
+    // 40 files in directories of 10 at 10% check 4, the same 4 for the same seed
+    make_slack_image(path, 4, 10);
+    options.seed = 3;
+    volume = run_test_image(&options, &first);
+    stratum = &volume->sample.strata[STRATUM_FILE_SLACK];
+    CHECK(stratum->population == 40 && stratum->sampled == 4 && stratum->positive == 4);
+    CHECK(first.findings == 4);
+    fg_close(volume);
+    volume = run_test_image(&options, &again);
+    CHECK(!strcmp(first.labels, again.labels));
+    fg_close(volume);
+    free(again.report);
+    for (options.seed = 4; options.seed < 8; options.seed++){
+        volume = run_test_image(&options, &again);
+        differs |= strcmp(first.labels, again.labels) != 0;
+        fg_close(volume);
+        free(again.report);
+    }
+    CHECK(differs);
+    free(first.report);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Stops the walk, as a crash would, at the third file slack finding
+ */
+static void crash_on_finding(const struct fg_finding *finding, void *user){
+    struct test_run *run = user;
+
+    collect_finding(finding, user);
+    if (strstr(finding->region, "slack") && ++run->slack_findings == 3)
+        fatal();
+}
+
+/**
+ * @brief Returns the ranked findings part of a report
+ */
+static const char* ranked_findings(const char *report){
+    const char *ranked = strstr(report, "Findings ranked by suspicion");
+
+    return ranked != NULL ? ranked : "";
+}
+
+/**
+ * @brief Checks that a scan stopped partway through the walk resumes from its last checkpoint
+ * and ends with the same findings as a scan that was never stopped
+ */
+static void test_checkpoint_resume(void){
+    struct fg_volume scratch;
+    struct fg_options options;
+    struct test_image img;
+    struct test_run full, stopped, resumed;
+    char dir[32];
+    char path[64];
+    char checkpoint[80];
+    fg_volume *volume;
+    FILE *out;
+    uint32_t next = 20;
+
+    use_temp_volume(&scratch, dir);
+    snprintf(path, sizeof(path), "%s/walk.img", dir);
+    snprintf(checkpoint, sizeof(checkpoint), "%s/walk.checkpoint", dir);
+
+    // Data in the reserved area and a free cluster, found before the walk, and six directories of
+    // files with data in their slack, one with a subdirectory
+    test_image_init(&img, 0);
+    img.data[20 * 512 + 7] = 0x42;
+    test_cluster(&img, 1000)[0] = 0x42;
+    for (uint32_t d = 0; d < 6; d++){
+        char name[12];
+        snprintf(name, sizeof(name), "DIR%-8u", d);
+        test_directory(&img, 2, d, name, 3 + d);
+        for (uint32_t f = 0; f < 2; f++){
+            snprintf(name, sizeof(name), "FILE%-4uTXT", f);
+            test_file(&img, 3 + d, 2 + f, name, next, 100);
+            test_cluster(&img, next++)[300] = 'x';
+        }
+    }
+    test_directory(&img, 3, 4, "SUBDIR     ", 9);
+    test_file(&img, 9, 2, "DEEP    TXT", next, 700);
+    test_cluster(&img, next + 1)[400] = 'y';
+    test_image_save(&img, path);
+    test_image_free(&img);
+
+    test_options(&options, path);
+    volume = run_test_image(&options, &full);
+    CHECK(full.findings == 15);
+    CHECK(*ranked_findings(full.report));
+    fg_close(volume);
+
+    // The first run checkpoints after every directory and stops while reading the second one, a
+    // subdirectory, so the checkpoint has to rebuild its path
+    snprintf(options.checkpoint_path, sizeof(options.checkpoint_path), "%s", checkpoint);
+    options.checkpoint_interval = 0;
+    memset(&stopped, 0, sizeof(stopped));
+    out = open_memstream(&stopped.report, &stopped.report_size);
+    volume = fg_open(&options);
+    fg_set_output(volume, out);
+    fg_set_finding_callback(volume, crash_on_finding, &stopped);
+    CHECK(fg_parse(volume) == 0);
+    CHECK(fg_scan(volume) == 0);
+    CHECK(fg_walk(volume) == -1);
+    fg_close(volume);
+    fclose(out);
+    CHECK(stopped.findings == 5);
+    CHECK(access(checkpoint, R_OK) == 0);
+
+    // The second picks up from the last checkpoint without redoing the passes before the walk
+    options.resume = true;
+    volume = run_test_image(&options, &resumed);
+    CHECK(volume != NULL);
+    CHECK(strstr(resumed.report, "Resuming from the checkpoint") != NULL);
+    CHECK(strstr(resumed.report, "4 findings so far, 6 directories queued") != NULL);
+    CHECK(strstr(resumed.labels, "reserved") == NULL && strstr(resumed.labels, "free") == NULL);
+    CHECK(strstr(resumed.labels, "DEEP.TXT") != NULL);
+    CHECK(!strcmp(ranked_findings(full.report), ranked_findings(resumed.report)));
+    CHECK(access(checkpoint, F_OK) != 0);
+    fg_close(volume);
+
+    free(full.report);
+    free(stopped.report);
+    free(resumed.report);
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Checks that file slack is split into RAM slack, up to the end of the file's last sector,
+ * and drive slack, the sectors after it, and that data in each is reported as such
+ */
+static void test_slack_split(void){
+    struct fg_volume volume;
+    struct fat_dir_entry entry = {0};
+    struct {
+        uint32_t offset; // of a byte of data in the cluster, 0 for none
+        uint32_t second;
+        int first_type;
+        uint64_t findings;
+    } cases[] = {
+        {0, 0, 0, 0},
+        {800, 0, REGION_RAM_SLACK, 1}, // after the 700 byte file, in its second sector
+        {1600, 0, REGION_DRIVE_SLACK, 1}, // in the fourth sector
+        {1023, 1024, REGION_RAM_SLACK, 2} // the last byte of RAM slack and the first of drive slack
+    };
+    uint8_t cluster[2048];
+    char dir[32];
+    char path[64];
+
+    use_temp_volume(&volume, dir);
+    snprintf(path, sizeof(path), "%s/cluster.img", dir);
+    volume.bps = 512;
+    volume.spc = 4;
+    memcpy(entry.info.filename, "SLACK   TXT", 11);
+    entry.name = "SLACK.TXT";
+    entry.file_size = 700;
+    entry.cluster_addr = 2;
+    entry.last_cluster = 2;
+    CHECK(slack_length(&entry) == 2048 - 700);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        FILE *file = fopen(path, "wb");
+        memset(cluster, 'f', 700);
+        memset(cluster + 700, 0, sizeof(cluster) - 700);
+        if (cases[i].offset)
+            cluster[cases[i].offset] = 0x42;
+        if (cases[i].second)
+            cluster[cases[i].second] = 0x42;
+        fwrite(cluster, sizeof(cluster), 1, file);
+        fclose(file);
+        volume.fp = open(path, O_RDONLY);
+        volume.findings.count = 0;
+
+        CHECK(check_for_hidden_data(volume.fp, &entry) == (cases[i].findings > 0));
+        CHECK(volume.findings.count == cases[i].findings);
+        if (cases[i].findings){
+            struct finding *f = &volume.findings.items[0];
+            CHECK(f->type == cases[i].first_type);
+            CHECK(f->offset == cases[i].offset && f->nonzero == 1);
+            CHECK(!strcmp(f->label, "SLACK.TXT"));
+        }
+        if (cases[i].findings == 2){
+            CHECK(volume.findings.items[1].type == REGION_DRIVE_SLACK);
+            CHECK(volume.findings.items[1].offset == cases[i].second);
+        }
+        close(volume.fp);
+    }
+    free(volume.findings.items);
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Overwrites bytes of a saved test image
+ */
+static void patch_test_image(const char *path, uint64_t offset, const void *bytes, size_t length){
+    int fd = open(path, O_WRONLY);
+
+    CHECK(fd >= 0 && pwrite(fd, bytes, length, offset) == (ssize_t)length);
+    close(fd);
+}
+
+/**
+ * @brief Checks the field by field diff of the boot record with its backup copy
+ */
+static void test_backup_boot_sector(void){
+    struct fg_volume scratch;
+    struct fg_options options;
+    struct test_image img;
+    struct test_run run;
+    char dir[32];
+    char path[64];
+    fg_volume *volume;
+    uint8_t serial[4] = {0x21, 0x43, 0x65, 0x87};
+    uint8_t free_count[4] = {0x10, 0, 0, 0};
+
+    use_temp_volume(&scratch, dir);
+    snprintf(path, sizeof(path), "%s/boot.img", dir);
+    test_image_init(&img, 0);
+    test_image_save(&img, path);
+    test_image_free(&img);
+    test_options(&options, path);
+    options.h_flag = false;
+
+    volume = run_test_image(&options, &run);
+    CHECK(strstr(run.report, "does not match the primary") == NULL);
+    fg_close(volume);
+    free(run.report);
+
+    // A stale free cluster count in the backup FSINFO is normal and not counted
+    patch_test_image(path, 7 * 512 + 488, free_count, 4);
+    volume = run_test_image(&options, &run);
+    CHECK(strstr(run.report, "does not match the primary") == NULL);
+    fg_close(volume);
+    free(run.report);
+
+    patch_test_image(path, 6 * 512 + 3, "MSDOS5.0", 8);
+    patch_test_image(path, 6 * 512 + 67, serial, 4);
+    patch_test_image(path, 8 * 512 + 100, "\x90", 1);
+    volume = run_test_image(&options, &run);
+    CHECK(strstr(run.report, "Warning!  The backup boot record at sector 6 does not match the primary, a common sign of tampering.\n") != NULL);
+    CHECK(strstr(run.report, "  Boot Sector, OEM Name: primary 'MSWIN4.1' backup 'MSDOS5.0'\n") != NULL);
+    CHECK(strstr(run.report, "  Boot Sector, Volume Serial: primary 0x12345678 backup 0x87654321\n") != NULL);
+    CHECK(strstr(run.report, "  Boot Sector 2, Boot Code: 1 of 512 bytes differ, the first at offset 0x64\n") != NULL);
+    CHECK(strstr(run.report, "Free Cluster Count") == NULL);
+    CHECK(strstr(run.report, "3 fields of the backup boot record differ from the primary.\n") != NULL);
+    fg_close(volume);
+    free(run.report);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Checks that FAT12 entries, two to every three bytes, are unpacked the same way by
+ * read_alloctable and by the FAT dump, from memory and streamed from the image
+ */
+static void test_fat12_dump(void){
+    struct fg_volume volume;
+    struct fat_boot_sector boot;
+    const uint16_t entries[16] = {
+        0xff8, 0xfff, 0x003, 0xabc, 0xfff, 0x000, 0x123, 0xff7,
+        0x00f, 0xf00, 0x0f0, 0x801, 0x000, 0x000, 0xfff, 0x456
+    };
+    uint8_t fat[1024] = {0}; // the FAT is at sector 1 of the streamed image
+    char *dumped[2];
+    size_t dumped_size[2];
+    char dir[32];
+    char path[64];
+
+    for (int i = 0; i < 16; i += 2){
+        uint8_t *p = fat + 512 + i * 3 / 2;
+        p[0] = entries[i];
+        p[1] = (entries[i] >> 8) | (entries[i + 1] << 4);
+        p[2] = entries[i + 1] >> 4;
+    }
+    use_temp_volume(&volume, dir);
+    memset(&boot, 0, sizeof(boot));
+    boot.is_fat12 = true;
+    boot.reserved_area_size = 1;
+    volume.bps = 512;
+    volume.fat_bs = &boot;
+    volume.fat1 = fat + 512;
+    volume.fat_size_in_bytes = 24;
+    for (uint32_t i = 0; i < 16; i++)
+        CHECK(read_alloctable(i) == entries[i]);
+
+    snprintf(path, sizeof(path), "%s/fat12.img", dir);
+    FILE *file = fopen(path, "wb");
+    fwrite(fat, sizeof(fat), 1, file);
+    fclose(file);
+    volume.fp = open(path, O_RDONLY);
+    for (int streamed = 0; streamed < 2; streamed++){
+        volume.out = open_memstream(&dumped[streamed], &dumped_size[streamed]);
+        print_full_fat_tables(streamed ? NULL : fat + 512, NULL, &boot);
+        fclose(volume.out);
+    }
+    volume.out = NULL;
+    close(volume.fp);
+
+    CHECK(strstr(dumped[0], "FAT 1 (FAT12)") != NULL);
+    for (int row = 0; row < 2; row++){
+        char line[128];
+        int used = snprintf(line, sizeof(line), " 0x%08x |", row * 8);
+        for (int j = 0; j < 8; j++)
+            used += snprintf(line + used, sizeof(line) - used, " 0x%03x |", entries[row * 8 + j]);
+        CHECK(strstr(dumped[0], line) != NULL);
+    }
+    CHECK(strstr(dumped[0], " 0x00000010 |") != NULL); // the end of the FAT, after 16 entries
+    CHECK(!strcmp(dumped[0], dumped[1]));
+
+    free(dumped[0]);
+    free(dumped[1]);
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Compares two saved test images the way --diff does and returns the report, which the
+ * caller frees
+ */
+static char* diff_test_images(const char *before_path, const char *after_path){
+    struct fg_options options;
+    fg_volume *before, *after;
+    char *text = NULL;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
+
+    test_options(&options, before_path);
+    options.h_flag = false;
+    before = fg_open(&options);
+    snprintf(options.image_path, sizeof(options.image_path), "%s", after_path);
+    after = fg_open(&options);
+    CHECK(before != NULL && after != NULL);
+    fg_set_output(before, NULL);
+    fg_set_output(after, NULL);
+    CHECK(fg_parse(before) == 0 && fg_parse(after) == 0);
+    fg_set_output(before, out);
+    CHECK(fg_diff(before, after) == 0);
+    fg_close(after);
+    fg_close(before);
+    fclose(out);
+    return text;
+}
+
+/**
+ * @brief Checks that the diff reports the runs of FAT1 entries that changed, how they changed, and
+ * the directory entries that were modified, removed and added
+ */
+static void test_diff_fat_and_entries(void){
+    struct fg_volume scratch;
+    struct test_image img;
+    char dir[32];
+    char before[64], after[64];
+    char *report;
+
+    use_temp_volume(&scratch, dir);
+    snprintf(before, sizeof(before), "%s/before.img", dir);
+    snprintf(after, sizeof(after), "%s/after.img", dir);
+    test_image_init(&img, 0);
+    test_file(&img, 2, 0, "A       TXT", 10, 700);
+    test_file(&img, 2, 1, "B       TXT", 20, 1200);
+    test_file(&img, 2, 2, "C       TXT", 30, 100);
+    test_image_save(&img, before);
+
+    // A grows by a cluster, B is deleted, cluster 0x28 is marked bad, and D is added
+    test_file(&img, 2, 0, "A       TXT", 10, 1300);
+    test_cluster(&img, 2)[32] = 0xe5;
+    for (uint32_t c = 20; c < 23; c++)
+        img.fat[c] = 0;
+    img.fat[40] = FAT32_BAD;
+    test_file(&img, 2, 3, "D       TXT", 50, 10);
+    test_image_save(&img, after);
+    test_image_free(&img);
+
+    report = diff_test_images(before, after);
+    CHECK(strstr(report, "Changes in FAT 1:\n"
+        "  Cluster 0xb: relinked (0xffffff8 -> 0xc)\n"
+        "  Cluster 0xc: allocated (0x0 -> 0xffffff8)\n"
+        "  Clusters 0x14 to 0x16: freed (0x15 -> 0x0 at cluster 0x14)\n"
+        "  Cluster 0x28: marked bad (0x0 -> 0xffffff7)\n"
+        "  Cluster 0x32: allocated (0x0 -> 0xffffff8)\n"
+        "FAT 2: ") != NULL);
+    CHECK(strstr(report, "  Modified /A.TXT: size 700 -> 1300\n") != NULL);
+    CHECK(strstr(report, "  Contents of /A.TXT changed in 2 of 3 clusters\n") != NULL);
+    CHECK(strstr(report, "  Removed /B.TXT\n") != NULL);
+    CHECK(strstr(report, "  Added /D.TXT (10 bytes)\n") != NULL);
+    CHECK(strstr(report, "C.TXT") == NULL);
+    // The FAT entries share a block with the reserved area, which did not change
+    CHECK(strstr(report, "Changed blocks: 0 in the reserved area, 2 in the FATs, 1 in the root directory and data area, 0 past the end of the volume.\n") != NULL);
+    free(report);
+
+    unlink(before);
+    unlink(after);
+    rmdir(dir);
+}
+
+/**
+ * @brief Checks that the diff pairs entries by long name, so a new 8.3 name alone is a modification,
+ * and reports an entry whose long name changed but kept its clusters as a rename
+ */
+static void test_diff_long_names(void){
+    struct fg_volume scratch;
+    struct test_image img;
+    uint8_t lfn[LFN_MAX_ENTRIES][32];
+    char dir[32];
+    char paths[2][64];
+    char *report;
+    uint32_t slot;
+    uint32_t count;
+
+    use_temp_volume(&scratch, dir);
+    snprintf(paths[0], sizeof(paths[0]), "%s/before.img", dir);
+    snprintf(paths[1], sizeof(paths[1]), "%s/after.img", dir);
+    for (int after = 0; after < 2; after++){
+        // The after image gives the photo a new 8.3 name, renames hello_world.txt, and renames and
+        // grows FRAG.BIN
+        test_image_init(&img, 0);
+        slot = test_long_file(&img, 2, 0, "Holiday Photo.JPG", after ? "HOLIDA~2JPG" : "HOLIDA~1JPG", 10, 100);
+        slot = test_long_file(&img, 2, slot, after ? "jello_world.txt" : "hello_world.txt", after ? "JELLO_~1TXT" : "HELLO_~1TXT", 11, 100);
+        count = make_ascii_long_name(lfn, "Sub Directory", lfn_checksum((const uint8_t *)"SUBDIR~1   "), false);
+        memcpy(test_cluster(&img, 2) + slot * 32, lfn, count * 32);
+        slot += count;
+        test_directory(&img, 2, slot, "SUBDIR~1   ", 3);
+        test_file(&img, 3, 2, after ? "FRAX    BIN" : "FRAG    BIN", 12, after ? 200 : 100);
+        test_file(&img, 3, 3, "KEEP    BIN", 13, 100);
+        test_image_save(&img, paths[after]);
+        test_image_free(&img);
+    }
+
+    report = diff_test_images(paths[0], paths[1]);
+    CHECK(strstr(report, "  Modified /Holiday Photo.JPG: 8.3 name HOLIDA~1.JPG -> HOLIDA~2.JPG\n") != NULL);
+    CHECK(strstr(report, "  Renamed /hello_world.txt to /jello_world.txt\n") != NULL);
+    CHECK(strstr(report, "  Renamed /Sub Directory/FRAG.BIN to /Sub Directory/FRAX.BIN: size 100 -> 200\n") != NULL);
+    CHECK(strstr(report, "  Removed ") == NULL);
+    CHECK(strstr(report, "  Added ") == NULL);
+    CHECK(strstr(report, "KEEP.BIN") == NULL);
+    free(report);
+
+    unlink(paths[0]);
+    unlink(paths[1]);
+    rmdir(dir);
+}
+
+static int compare_keys(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Checks that the timeline radix sort orders the keys by time, keeps keys with the same
+ * time in the order they were added, and gives the same result on one thread and on several
+ */
+static void test_sort_timeline_keys(void){
+    const uint64_t count = TIMELINE_SORT_MIN_PER_THREAD * 4 + 123;
+    uint64_t *added = malloc(count * sizeof(uint64_t));
+    uint64_t *expected = malloc(count * sizeof(uint64_t));
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    uint64_t *scratch = malloc(count * sizeof(uint64_t));
+    uint64_t rng = 7;
+
+    // The low 32 bits count up, so sorting by the whole key is the stable sort by time.  Few
+    // distinct times make many ties, and the year byte is the same in every key.
+    for (uint64_t i = 0; i < count; i++){
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint16_t date = 0x5a00 | (rng >> 59);
+        uint16_t time = (rng >> 40) & 0x3f;
+        added[i] = timeline_key(date, time, i, i & 3);
+    }
+    memcpy(expected, added, count * sizeof(uint64_t));
+    qsort(expected, count, sizeof(uint64_t), compare_keys);
+    for (uint32_t threads = 1; threads <= 4; threads += 3){
+        uint64_t *sorted;
+        memcpy(keys, added, count * sizeof(uint64_t));
+        sorted = sort_timeline_keys(keys, scratch, count, threads);
+        CHECK(sorted == keys || sorted == scratch);
+        CHECK(!memcmp(sorted, expected, count * sizeof(uint64_t)));
+    }
+
+    // Nothing to sort, and keys that all have the same time
+    CHECK(sort_timeline_keys(keys, scratch, 0, 4) != NULL);
+    for (uint64_t i = 0; i < 1000; i++)
+        keys[i] = timeline_key(0x5a21, 0x6000, 999 - i, 0);
+    memcpy(expected, keys, 1000 * sizeof(uint64_t));
+    CHECK(!memcmp(sort_timeline_keys(keys, scratch, 1000, 2), expected, 1000 * sizeof(uint64_t)));
+
+    free(added);
+    free(expected);
+    free(keys);
+    free(scratch);
+}
+
+/**
+ * @brief Returns the part of a report listing the paths matching --find
+ */
+static char* find_section(struct test_run *run){
+    char *found = strstr(run->report, "\nPaths with file names matching ");
+
+    return found != NULL ? found : "";
+}
+
+/**
+ * @brief Checks --find wildcard matching on long and 8.3 names, ignoring case, with the path
+ * index built by the walk and loaded from its file
+ */
+static void test_find_paths(void){
+    struct fg_volume scratch;
+    struct fg_options options;
+    struct test_image img;
+    struct test_run run;
+    char dir[32];
+    char path[64];
+    char index[80];
+    fg_volume *volume;
+    uint32_t slot;
+    struct {
+        const char *pattern;
+        const char *found[4];
+    } cases[] = {
+        {"*.jpg", {"/Holiday Photo.JPG", "/DCIM/IMG_0001.JPG", "/?LD.JPG"}}, // a deleted name loses its first letter
+        {"img_000?.*", {"/DCIM/IMG_0001.JPG", "/DCIM/img_0002.jpeg"}},
+        {"HOLIDAY*", {"/Holiday Photo.JPG"}},
+        {"*[0-9].JPEG", {"/DCIM/img_0002.jpeg"}},
+        {"notes.txt", {"/NOTES.TXT"}},
+        {"dcim", {"/DCIM"}},
+        {"*.gif", {NULL}}
+    };
+
+    use_temp_volume(&scratch, dir);
+    snprintf(path, sizeof(path), "%s/find.img", dir);
+    snprintf(index, sizeof(index), "%s/find.index", dir);
+    test_image_init(&img, 0);
+    slot = test_long_file(&img, 2, 0, "Holiday Photo.JPG", "HOLIDA~1JPG", 10, 100);
+    test_file(&img, 2, slot++, "NOTES   TXT", 11, 100);
+    test_directory(&img, 2, slot++, "DCIM       ", 3);
+    test_file(&img, 2, slot, "OLD     JPG", 12, 100);
+    test_cluster(&img, 2)[slot * 32] = 0xe5;
+    test_file(&img, 3, 2, "IMG_0001JPG", 13, 100);
+    test_long_file(&img, 3, 3, "img_0002.jpeg", "IMG_00~1JPE", 14, 100);
+    test_image_save(&img, path);
+    test_image_free(&img);
+
+    test_options(&options, path);
+    options.h_flag = false;
+    for (int pass = 0; pass < 2; pass++){
+        // The first pass builds the index with the walk and saves it, the second loads it
+        if (pass == 1){
+            snprintf(options.index_path, sizeof(options.index_path), "%s", index);
+            volume = run_test_image(&options, &run);
+            fg_close(volume);
+            free(run.report);
+            CHECK(access(index, R_OK) == 0);
+        }
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+            uint32_t expected = 0;
+            char *found;
+            char count[32];
+            snprintf(options.find_name, sizeof(options.find_name), "%s", cases[i].pattern);
+            volume = run_test_image(&options, &run);
+            found = find_section(&run);
+            CHECK(pass == 0 || strstr(run.report, "Starting to read") == NULL);
+            for (int j = 0; j < 4 && cases[i].found[j] != NULL; j++){
+                char line[80];
+                snprintf(line, sizeof(line), "\n  %s  (", cases[i].found[j]);
+                CHECK(strstr(found, line) != NULL);
+                expected++;
+            }
+            snprintf(count, sizeof(count), "\n%u found.\n", expected);
+            CHECK(strstr(found, count) != NULL);
+            fg_close(volume);
+            free(run.report);
+        }
+    }
+    unlink(index);
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Checks --recover copies a deleted file whose clusters are still free, and leaves one whose
+ * start cluster was given to a new file
+ */
+static void test_recover_reused(void){
+    struct fg_volume scratch;
+    struct fg_options options;
+    struct test_image img;
+    struct test_run run;
+    char dir[32];
+    char path[64];
+    char recover[64];
+    char copy[96];
+    char gone[96];
+    char line[256];
+    char data[1300];
+    fg_volume *volume;
+    FILE *file;
+    size_t length;
+
+    use_temp_volume(&scratch, dir);
+    snprintf(path, sizeof(path), "%s/recover.img", dir);
+    snprintf(recover, sizeof(recover), "%s/recovered", dir);
+    test_image_init(&img, 0);
+    test_file(&img, 2, 0, "GONE    JPG", 10, 1200);
+    test_file(&img, 2, 1, "OLD     JPG", 20, 1000);
+    for (uint32_t c = 10; c < 22; c++)
+        img.fat[c] = 0;
+    test_cluster(&img, 2)[0] = 0xe5;
+    test_cluster(&img, 2)[32] = 0xe5;
+    test_file(&img, 2, 2, "NEW     TXT", 20, 100);
+    test_image_save(&img, path);
+    test_image_free(&img);
+
+    test_options(&options, path);
+    options.h_flag = false;
+    snprintf(options.recover_path, sizeof(options.recover_path), "%s", recover);
+    volume = run_test_image(&options, &run);
+    snprintf(line, sizeof(line), "\n  /?ONE.JPG -> %s/0000000a__ONE.JPG (1200 bytes)\n", recover);
+    CHECK(strstr(run.report, line) != NULL);
+    CHECK(strstr(run.report, "\n  /?LD.JPG (first cluster: 0x14, size: 1000 bytes) not recovered, clusters reallocated\n") != NULL);
+    CHECK(strstr(run.report, "\nRecovered 1 of 2 deleted files, 1200 bytes.\n") != NULL);
+    fg_close(volume);
+    free(run.report);
+
+    snprintf(copy, sizeof(copy), "%s/0000000a__ONE.JPG", recover);
+    snprintf(gone, sizeof(gone), "%s/00000014__LD.JPG", recover);
+    file = fopen(copy, "rb");
+    CHECK(file != NULL);
+    if (file != NULL){
+        length = fread(data, 1, sizeof(data), file);
+        CHECK(length == 1200);
+        for (size_t i = 0; i < length; i++){
+            if (data[i] != 'a' + 10){
+                CHECK(data[i] == 'a' + 10);
+                break;
+            }
+        }
+        fclose(file);
+    }
+    CHECK(access(gone, F_OK) != 0);
+    unlink(copy);
+    rmdir(recover);
+    unlink(path);
+    rmdir(dir);
+}
+
+/**
+ * @brief Checks names from the image are escaped in the output directory, and that extraction does
+ * not write through symlinks already in it
+ */
+static void test_output_names(void){
+    struct fg_volume scratch;
+    struct fg_options options;
+    struct test_image img;
+    struct test_run run;
+    struct fat_dir_entry root = {0};
+    struct fat_dir_entry sub = {.parent_dir = &root};
+    struct fat_dir_entry file = {.parent_dir = &sub};
+    char dir[32];
+    char path[64];
+    char out[64];
+    char outside[64];
+    char target[80];
+    char link[96];
+    char name[PATH_INDEX_PATH_SIZE];
+    char data[8];
+    fg_volume *volume;
+    FILE *f;
+    struct {
+        const char *dir;
+        const char *file;
+        const char *output;
+    } cases[] = {
+        {"DCIM", "IMG.JPG", "/DCIM/IMG.JPG"},
+        {"..", "..", "/_../_.."},
+        {".", "", "/_./_"},
+        {"a/b", "../c", "/a_b/.._c"}
+    };
+
+    use_temp_volume(&scratch, dir);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        sub.name = cases[i].dir;
+        file.name = cases[i].file;
+        output_path(&file, name, sizeof(name));
+        CHECK(!strcmp(name, cases[i].output));
+    }
+    copy_name("/DCIM/?MG.JPG", 0x1234, name, sizeof(name));
+    CHECK(!strcmp(name, "00001234__MG.JPG"));
+    copy_name("/DCIM/long_name.jpg", 7, name, 14);
+    CHECK(!strcmp(name, "00000007_long"));
+
+    // A symlink in the output directory in place of a directory, and one in place of a file
+    snprintf(path, sizeof(path), "%s/links.img", dir);
+    snprintf(out, sizeof(out), "%s/out", dir);
+    snprintf(outside, sizeof(outside), "%s/outside", dir);
+    test_image_init(&img, 0);
+    test_directory(&img, 2, 0, "DIR        ", 3);
+    test_file(&img, 3, 2, "FILE    TXT", 10, 100);
+    test_file(&img, 2, 1, "TOP     TXT", 11, 100);
+    test_file(&img, 2, 2, "A/B     TXT", 12, 100);
+    test_image_save(&img, path);
+    test_image_free(&img);
+    CHECK(mkdir(out, 0755) == 0 && mkdir(outside, 0755) == 0);
+    snprintf(link, sizeof(link), "%s/DIR", out);
+    CHECK(symlink(outside, link) == 0);
+    snprintf(target, sizeof(target), "%s/TOP.TXT", outside);
+    f = fopen(target, "wb");
+    CHECK(f != NULL && fputs("keep", f) >= 0 && fclose(f) == 0);
+    snprintf(link, sizeof(link), "%s/TOP.TXT", out);
+    CHECK(symlink(target, link) == 0);
+
+    test_options(&options, path);
+    options.h_flag = false;
+    options.extract_all = true;
+    snprintf(options.extract_dir, sizeof(options.extract_dir), "%s", out);
+    volume = run_test_image(&options, &run);
+    CHECK(strstr(run.report, "\n  /DIR/FILE.TXT (100 bytes, 0 copied) could not be written\n") != NULL);
+    CHECK(strstr(run.report, "\n  /TOP.TXT (100 bytes, 0 copied) could not be written\n") != NULL);
+    CHECK(strstr(run.report, "\nExtracted 1 of 3 files, 100 bytes to ") != NULL);
+    fg_close(volume);
+    free(run.report);
+
+    snprintf(name, sizeof(name), "%s/A_B.TXT", out);
+    CHECK(access(name, F_OK) == 0);
+    unlink(name);
+    snprintf(name, sizeof(name), "%s/FILE.TXT", outside);
+    CHECK(access(name, F_OK) != 0);
+    f = fopen(target, "rb");
+    CHECK(f != NULL && fread(data, 1, sizeof(data), f) == 4 && !memcmp(data, "keep", 4));
+    if (f != NULL)
+        fclose(f);
+    unlink(target);
+    unlink(link);
+    snprintf(link, sizeof(link), "%s/DIR", out);
+    unlink(link);
+    rmdir(outside);
+    rmdir(out);
+    unlink(path);
+    rmdir(dir);
+}
+
+int main(void){
+    test_next_fat_run();
+    test_analyze_layout();
+    test_put_utf8();
+    test_decode_long_name();
+    test_decode_deleted_long_name();
+    test_gzip_image();
+    test_zstd_seek_table();
+    test_sample_math();
+    test_sample_file_slack();
+    test_checkpoint_resume();
+    test_slack_split();
+    test_backup_boot_sector();
+    test_fat12_dump();
+    test_diff_fat_and_entries();
+    test_diff_long_names();
+    test_sort_timeline_keys();
+    test_find_paths();
+    test_recover_reused();
+    test_output_names();
+    if (failures){
+        fprintf(stderr, "%d checks failed.\n", failures);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}